@@ -5,9 +5,12 @@
     uniform mat4 worldview;
     uniform mat4 view_to_light;
 
+    uniform vec4 mesh_colour;
+
     out vec2 tex;
     out vec4 light_pos;
     out float NdotL;
+    out vec4 colour_in;
 
     layout (location = 0) in vec3 position;
     layout (location = 1) in vec3 normal;
@@ -19,21 +22,52 @@
       NdotL = dot(normal, vec3(0.485, 0.485, 0.727));
 
       tex = uv;
+      colour_in = mesh_colour;
 
       // transform the position to light projection space
       vec4 view_pos = worldview * vec4(position, 1);
       light_pos = view_to_light * view_pos;
     }
   ]]></source>
+  <source name="vertex-instanced"><![CDATA[
+    uniform mat4 viewproj;
+    uniform mat4 view;
+    uniform mat4 view_to_light;
+
+    out vec2 tex;
+    out vec4 light_pos;
+    out float NdotL;
+    out vec4 colour_in;
+
+    layout (location = 0) in vec3 position;
+    layout (location = 1) in vec3 normal;
+    layout (location = 2) in vec2 uv;
+    layout (location = 3) in mat4 world;
+    layout (location = 7) in vec4 instance_colour;
+
+    void main() {
+      vec4 world_pos = world * vec4(position, 1);
+      gl_Position = viewproj * world_pos;
+
+      NdotL = dot(normal, vec3(0.485, 0.485, 0.727));
+
+      tex = uv;
+      colour_in = instance_colour;
+
+      // transform the position to light projection space
+      vec4 view_pos = view * world_pos;
+      light_pos = view_to_light * view_pos;
+    }
+  ]]></source>
   <source name="fragment"><![CDATA[
     in vec2 tex;
     in vec4 light_pos;
     in float NdotL;
+    in vec4 colour_in;
 
     out vec4 colour;
 
     uniform sampler2D entity_texture;
-    uniform vec4 mesh_colour;
 
     void main() {
       // work out how much this pixel is being affected by shadow(s)
@@ -43,7 +77,7 @@
       vec4 base_colour = texture(entity_texture, tex);
 
       // blend the colour with the "mesh" colour based on the texture's alpha channel
-      base_colour.rgb = (base_colour.rgb * base_colour.a) + (mesh_colour.rgb * (1 - base_colour.a));
+      base_colour.rgb = (base_colour.rgb * base_colour.a) + (colour_in.rgb * (1 - base_colour.a));
       base_colour.a   = 1.0;
 
       // then figure out the "real" colour by applying the light calculation
@@ -61,4 +95,11 @@
     <state name="z-test" value="on" />
     <state name="blend" value="off" />
   </program>
+  <program name="instanced">
+    <vertex-shader source="vertex-instanced" />
+    <fragment-shader source="fragment" />
+    <state name="z-write" value="on" />
+    <state name="z-test" value="on" />
+    <state name="blend" value="off" />
+  </program>
 </shader>
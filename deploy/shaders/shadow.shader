@@ -10,6 +10,17 @@
       val = gl_Position.zw;
     }
   ]]></source>
+  <source name="vertex-instanced"><![CDATA[
+    uniform mat4 viewproj;
+    layout (location = 0) in vec3 position;
+    layout (location = 3) in mat4 world;
+    out vec2 val;
+
+    void main() {
+      gl_Position = viewproj * world * vec4(position, 1);
+      val = gl_Position.zw;
+    }
+  ]]></source>
   <source name="fragment"><![CDATA[
     in vec2 val;
     out vec4 colour;
@@ -25,4 +36,11 @@
     <state name="z-test" value="on" />
     <state name="blend" value="off" />
   </program>
+  <program name="instanced">
+    <vertex-shader source="vertex-instanced" />
+    <fragment-shader source="fragment" />
+    <state name="z-write" value="on" />
+    <state name="z-test" value="on" />
+    <state name="blend" value="off" />
+  </program>
 </shader>
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+namespace fw {
+
+/**
+ * A frame_arena is a "bump" allocator for data that only lives for a single frame (e.g. the render queue). Allocating
+ * just advances a pointer into the current chunk, and nothing is ever freed individually: instead, reset() is called
+ * at the start of each frame and everything allocated in the previous frame is thrown away in one go. The chunks
+ * themselves are kept around, so once we've warmed up, a frame doesn't touch the heap at all.
+ *
+ * Because destructors are never run, only trivially-destructible types can be created in the arena. This is not
+ * thread-safe, it's meant to be used from the render thread only.
+ */
+class frame_arena : private boost::noncopyable {
+public:
+  static const std::size_t CHUNK_SIZE = 64 * 1024;
+
+private:
+  struct chunk {
+    char *data;
+    std::size_t size;
+  };
+
+  std::vector<chunk> _chunks;
+  std::size_t _curr_chunk;
+  std::size_t _offset;
+
+  uint64_t _num_allocations;
+  uint64_t _bytes_allocated;
+  uint64_t _last_frame_allocations;
+  uint64_t _last_frame_bytes;
+
+public:
+  frame_arena();
+  ~frame_arena();
+
+  /** Allocates size bytes, aligned to the given alignment. The memory is valid until the next call to reset(). */
+  void *allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t));
+
+  /** Constructs a new T in the arena. */
+  template<typename T, typename... Args>
+  T *create(Args&&... args) {
+    static_assert(std::is_trivially_destructible<T>::value, "Objects in a frame_arena are never destructed.");
+    return new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+  }
+
+  /** Allocates an (uninitialized) array of count T's in the arena. */
+  template<typename T>
+  T *create_array(std::size_t count) {
+    static_assert(std::is_trivially_destructible<T>::value, "Objects in a frame_arena are never destructed.");
+    return static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+  }
+
+  /** Throws away everything that's been allocated since the last reset(). */
+  void reset();
+
+  /** Gets the number of allocations and bytes allocated in the last (complete) frame. */
+  uint64_t get_last_frame_allocations() const {
+    return _last_frame_allocations;
+  }
+  uint64_t get_last_frame_bytes() const {
+    return _last_frame_bytes;
+  }
+
+  /** Gets the total number of bytes the arena has reserved from the heap. */
+  std::size_t get_capacity() const;
+};
+
+}
@@ -19,6 +19,7 @@ class audio_manager;
 class lang;
 class cursor;
 class input;
+class frame_arena;
 
 namespace gui {
 class gui;
@@ -98,8 +99,16 @@ private:
   lang *_lang;
   font_manager *_font_manager;
   debug_view *_debug_view;
+  frame_arena *_frame_arena;
   volatile bool _running;
 
+  // statistics about the render queue for the last frame we rendered
+  int _last_frame_draw_items;
+  int _last_frame_draw_calls;
+  int _last_frame_nodes;
+  int _last_frame_visible_objects;
+  int _last_frame_culled_objects;
+
   // game updates happen (synchronized) on this thread in constant timestep
   void update_proc();
 
@@ -190,6 +199,26 @@ public:
   lang *get_lang() const {
     return _lang;
   }
+
+  // gets the arena that per-frame render data is allocated from, it's reset at the start of each frame
+  frame_arena &get_frame_arena() const {
+    return *_frame_arena;
+  }
+  int get_last_frame_draw_items() const {
+    return _last_frame_draw_items;
+  }
+  int get_last_frame_draw_calls() const {
+    return _last_frame_draw_calls;
+  }
+  int get_last_frame_nodes() const {
+    return _last_frame_nodes;
+  }
+  int get_last_frame_visible_objects() const {
+    return _last_frame_visible_objects;
+  }
+  int get_last_frame_culled_objects() const {
+    return _last_frame_culled_objects;
+  }
 };
 
 }
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <framework/vector.h>
+
+namespace fw {
+
+/**
+ * A view frustum, extracted from a (view * projection) matrix. We use it to cull things (represented by bounding
+ * spheres) that can't possibly be seen by a camera, before we bother trying to draw them.
+ */
+class frustum {
+private:
+  // the six planes (left, right, bottom, top, near, far), normalized and facing inwards
+  cml::vector4f _planes[6];
+
+public:
+  frustum();
+  frustum(matrix const &viewproj);
+
+  void set_matrix(matrix const &viewproj);
+
+  /** Returns true if the given sphere is at least partially inside the frustum. */
+  bool intersects_sphere(vector const &centre, float radius) const;
+};
+
+}
@@ -278,5 +278,19 @@ struct xyz_n {
   static std::function<void()> get_setup_function();
 };
 
+// This isn't really a vertex, it's the per-instance data for instanced draws: the world transform (in attribute
+// locations 3-6, one row each) and a colour (location 7). The attributes have a divisor of 1, so they advance once
+// per instance rather than once per vertex.
+struct instance {
+  float world[16];
+  float r, g, b, a;
+
+  // returns a function that'll set up an instance buffer
+  static std::function<void()> get_setup_function();
+
+  // disables the per-instance attributes again, so they don't affect non-instanced draws
+  static void cleanup();
+};
+
 }
 }
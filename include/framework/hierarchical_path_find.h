@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+
+#include <framework/path_find.h>
+
+namespace fw {
+
+/**
+ * A path_find that first searches an abstract graph built over the collision grid (so-called "HPA*"). The grid is
+ * divided up into square sectors, and every run of passable cells along the border between two sectors gets one or
+ * two "entrances". When we're constructed, we work out the cost of travelling between each pair of entrances within
+ * a sector. A query then only has to search that (much smaller) graph, and we refine just the segments along the
+ * abstract path with a full-resolution search confined to a single sector.
+ *
+ * When the passability of a cell changes, only the sectors that it touches are marked dirty; they're rebuilt the
+ * next time we're asked for a path.
+ */
+class hierarchical_path_find: public path_find {
+public:
+  static const int SECTOR_SIZE = 32;
+
+private:
+  struct abstract_edge {
+    int cell; // the cell index (z * width + x) of the node at the other end of this edge
+    float cost;
+  };
+
+  struct abstract_node {
+    int cell;
+    std::vector<abstract_edge> edges;
+  };
+
+  struct sector {
+    std::vector<abstract_node> nodes;
+    bool dirty;
+  };
+
+  int _sectors_wide;
+  int _sectors_long;
+  std::vector<sector> _sectors;
+  bool _any_dirty;
+
+  int get_sector_index(int cell) const;
+  region get_sector_region(int sector_index) const;
+  abstract_node *find_abstract_node(int sector_index, int cell);
+  void add_entrance(sector &sec, int cell, int other_cell);
+  void find_border_entrances(int sector_a, int sector_b, bool vertical, std::vector<std::pair<int, int>> &entrances);
+  void build_sector(int sector_index);
+  void mark_dirty(int sector_x, int sector_z);
+  float estimate_abstract_cost(int from_cell, int to_cell) const;
+  void connect_to_entrances(int cell, int sector_index, std::vector<abstract_edge> &edges);
+  bool find_abstract_path(std::vector<int> &abstract_path, int start_cell, int goal_cell);
+  fw::vector get_cell_loc(int cell) const;
+
+public:
+  hierarchical_path_find(int width, int length, std::vector<bool> const &passability);
+  virtual ~hierarchical_path_find();
+
+  virtual bool find(std::vector<fw::vector> &path, fw::vector const &start, fw::vector const &end);
+  virtual void set_passable(int x, int z, bool passable);
+
+  /** Rebuilds any sectors that have been marked dirty since the last rebuild. */
+  void rebuild_dirty_sectors();
+};
+
+}
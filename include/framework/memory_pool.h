@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+namespace fw {
+
+/**
+ * A memory_pool hands out small blocks of memory from free lists, one free list for each size class (allocations are
+ * rounded up to a multiple of GRANULARITY bytes). When a free list runs dry, we allocate a whole chunk of blocks from
+ * the heap in one go. Blocks are never given back to the heap (until the pool itself is destroyed), they just go
+ * back on the free list, which makes this a good fit for objects that are created and destroyed at a high rate.
+ *
+ * Allocations bigger than MAX_BLOCK_SIZE just go straight to the heap. All methods are thread-safe.
+ */
+class memory_pool : private boost::noncopyable {
+public:
+  static const std::size_t GRANULARITY = 16;
+  static const std::size_t MAX_BLOCK_SIZE = 512;
+  static const std::size_t BLOCKS_PER_CHUNK = 64;
+
+private:
+  static const std::size_t NUM_SIZE_CLASSES = MAX_BLOCK_SIZE / GRANULARITY;
+
+  std::mutex _mutex;
+  std::vector<void *> _free_lists[NUM_SIZE_CLASSES];
+  std::vector<char *> _chunks;
+
+  uint64_t _num_allocations;
+  uint64_t _num_heap_allocations;
+  uint64_t _num_live;
+
+  void refill(std::size_t size_class);
+
+public:
+  memory_pool();
+  ~memory_pool();
+
+  void *allocate(std::size_t size);
+
+  /** Returns the given block to the pool, size must be the same as what was passed to allocate(). */
+  void deallocate(void *ptr, std::size_t size);
+
+  /** Gets the total number of allocations we've made (whether from our free lists or the heap). */
+  uint64_t get_num_allocations() const {
+    return _num_allocations;
+  }
+
+  /** Gets the number of times we've had to go to the heap (for a new chunk, or a large block). */
+  uint64_t get_num_heap_allocations() const {
+    return _num_heap_allocations;
+  }
+
+  /** Gets the number of blocks that are currently allocated. */
+  uint64_t get_num_live() const {
+    return _num_live;
+  }
+};
+
+/**
+ * An allocator (for use with the standard containers, std::allocate_shared and so on) that allocates from a
+ * memory_pool.
+ */
+template<typename T>
+class pool_allocator {
+private:
+  memory_pool *_pool;
+
+public:
+  typedef T value_type;
+
+  pool_allocator(memory_pool *pool) :
+      _pool(pool) {
+  }
+
+  template<typename U>
+  pool_allocator(pool_allocator<U> const &other) :
+      _pool(other.get_pool()) {
+  }
+
+  T *allocate(std::size_t n) {
+    return static_cast<T *>(_pool->allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T *ptr, std::size_t n) {
+    _pool->deallocate(ptr, n * sizeof(T));
+  }
+
+  memory_pool *get_pool() const {
+    return _pool;
+  }
+
+  // these are needed by older standard libraries that don't fully use std::allocator_traits
+  template<typename U>
+  struct rebind {
+    typedef pool_allocator<U> other;
+  };
+};
+
+template<typename T, typename U>
+inline bool operator ==(pool_allocator<T> const &lhs, pool_allocator<U> const &rhs) {
+  return lhs.get_pool() == rhs.get_pool();
+}
+
+template<typename T, typename U>
+inline bool operator !=(pool_allocator<T> const &lhs, pool_allocator<U> const &rhs) {
+  return lhs.get_pool() != rhs.get_pool();
+}
+
+}
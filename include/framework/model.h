@@ -22,6 +22,10 @@ protected:
   std::shared_ptr<index_buffer> _ib;
   std::shared_ptr<shader> _shader;
 
+  // a bounding sphere around the mesh's vertices (in model space), calculated in setup_buffers
+  fw::vector _bounds_centre;
+  float _bounds_radius;
+
   virtual void setup_buffers() = 0;
 
 public:
@@ -40,6 +44,14 @@ public:
     setup_buffers();
     return _shader;
   }
+  fw::vector get_bounds_centre() {
+    setup_buffers();
+    return _bounds_centre;
+  }
+  float get_bounds_radius() {
+    setup_buffers();
+    return _bounds_radius;
+  }
 };
 
 /** A specialization of model_mesh that doesn't support animation. */
@@ -65,6 +77,13 @@ private:
   bool _wireframe;
   fw::colour _colour;
 
+  // a bounding sphere around the whole model (in model space), calculated the first time someone asks for it
+  bool _bounds_calculated;
+  fw::vector _bounds_centre;
+  float _bounds_radius;
+
+  void calculate_bounds();
+
 public:
   model();
   ~model();
@@ -92,8 +111,12 @@ public:
     return _colour;
   }
 
-  /** Renders the mesh to the given scenegraph. */
-  void render(sg::scenegraph &sg, fw::matrix const &transform = fw::identity());
+  /** Gets a bounding sphere around the model (in model space). A radius of 0 means the model has no meshes. */
+  fw::vector get_bounds_centre();
+  float get_bounds_radius();
+
+  /** Renders the mesh to the given scenegraph (if shadow_only is true, it's only drawn into the shadow map). */
+  void render(sg::scenegraph &sg, fw::matrix const &transform = fw::identity(), bool shadow_only = false);
 };
 
 }
@@ -18,10 +18,11 @@ private:
   model *_model;
   fw::colour _colour;
 
-protected:
-  /* Renders the model node. */
-  virtual void render(sg::scenegraph *sg, fw::matrix const &model_matrix = fw::identity());
+  // the bounding sphere of our mesh, in our local space
+  fw::vector _bounds_centre;
+  float _bounds_radius;
 
+protected:
   /** Called by clone() to populate the clone. */
   virtual void populate_clone(std::shared_ptr<sg::node> clone);
 public:
@@ -39,6 +40,24 @@ public:
 
   void set_colour(fw::colour colour);
 
+  /** Adds draw items for this node (if it has a mesh) and its children to the scenegraph's render queue. */
+  virtual void enqueue(sg::scenegraph &sg, fw::matrix const &model_matrix = fw::identity());
+
+  /**
+   * Adds draw items for this node and its children, using the given world matrix and colour instead of our own. This
+   * is how model::render draws many instances of the same model without modifying (or cloning) the shared nodes.
+   * If shadow_only is true, the draw items are only drawn into the shadow map.
+   */
+  void enqueue(sg::scenegraph &sg, fw::matrix const &model_matrix, fw::matrix const &world,
+      fw::colour const &colour, bool shadow_only = false);
+
+  /**
+   * Expands the given box to include the bounds of this node and its children, using the same transforms as enqueue.
+   * found is set to true once the box has anything in it.
+   */
+  void expand_bounds(fw::matrix const &model_matrix, fw::matrix const &world, bool &found, fw::vector &mins,
+      fw::vector &maxs);
+
   /** You can call this after setting mesh_index to set up the node. */
   void initialize(model *mdl);
 
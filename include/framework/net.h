@@ -6,6 +6,8 @@
 #include <boost/noncopyable.hpp>
 #include <enet/enet.h>
 
+#include <framework/packet_buffer.h>
+
 namespace fw {
 namespace net {
 class packet;
@@ -21,6 +23,10 @@ private:
   int _listen_port;
   std::vector<peer *> _new_connections;
 
+  // the total number of bytes of packet data we've sent and received (not including ENet's own overhead)
+  uint64_t _bytes_sent;
+  uint64_t _bytes_received;
+
   bool try_listen(int port);
   virtual void on_peer_connect(ENetPeer *peer);
 
@@ -43,6 +49,22 @@ public:
   int get_listen_port() const {
     return _listen_port;
   }
+
+  /** Gets the total number of bytes of packet data sent to (and received from) all our peers so far. */
+  uint64_t get_bytes_sent() const {
+    return _bytes_sent;
+  }
+  uint64_t get_bytes_received() const {
+    return _bytes_received;
+  }
+
+  /** Called by our peers to update get_bytes_sent() and get_bytes_received(). */
+  void add_bytes_sent(std::size_t bytes) {
+    _bytes_sent += bytes;
+  }
+  void add_bytes_received(std::size_t bytes) {
+    _bytes_received += bytes;
+  }
 };
 
 /** This is the base "peer" class that represents a connection to one of our peers in the game. */
@@ -54,6 +76,10 @@ protected:
   ENetPeer *_peer;
   bool _connected;
 
+  // if _compact is true, packets to and from this peer use the compact encoding (see packet_buffer::set_compact)
+  bool _compact;
+  compact_encoding _compact_state;
+
   std::function<void(std::shared_ptr<packet> const &)> _handler;
 
   virtual void on_connect();
@@ -75,6 +101,26 @@ public:
   bool is_connected() const {
     return _connected;
   }
+
+  /**
+   * Gets the round-trip time (and its variance) to this peer in milliseconds. ENet measures this from the
+   * acknowledgements of the reliable packets we send.
+   */
+  int get_round_trip_time() const {
+    return _peer == nullptr ? 0 : static_cast<int>(_peer->roundTripTime);
+  }
+  int get_round_trip_time_variance() const {
+    return _peer == nullptr ? 0 : static_cast<int>(_peer->roundTripTimeVariance);
+  }
+
+  /**
+   * Enables (or disables) the compact encoding for packets to and from this peer. Both sides must agree on this, so
+   * it should only be changed once we've both negotiated it.
+   */
+  void set_compact_encoding(bool compact);
+  bool is_compact_encoding() const {
+    return _compact;
+  }
 };
 }
 }
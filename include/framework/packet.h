@@ -17,7 +17,8 @@ class net_peer;
 /** The base packet class which represents the packets we send to/from our remote peers. */
 class packet {
 protected:
-  friend class peer;
+  friend void write_packet(packet &pkt, packet_buffer &buff);
+  friend std::shared_ptr<packet> read_packet(packet_buffer &buff);
 
   // serialize/deserialize ourselves to/from the given packet_buffer
   virtual void serialize(packet_buffer &buffer) = 0;
@@ -37,6 +38,15 @@ public:
 /** Creates the packet object from the given packet_buffer. */
 std::shared_ptr<packet> create_packet(packet_buffer &buff);
 
+/** Serializes the given packet into the given packet_buffer, which should've been created with its identifier. */
+void write_packet(packet &pkt, packet_buffer &buff);
+
+/**
+ * Creates the packet object from the given packet_buffer and deserializes it. Returns an empty pointer (and logs a
+ * warning) if the identifier is unknown or the packet was truncated.
+ */
+std::shared_ptr<packet> read_packet(packet_buffer &buff);
+
 /** Helper class that you use indirectly via the PACKET_REGISTER macro to register a packet with the packet_factory. */
 class packet_registrar {
 public:
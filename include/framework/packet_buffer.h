@@ -1,37 +1,162 @@
 #pragma once
 
-#include <sstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/noncopyable.hpp>
 #include <framework/colour.h>
 #include <framework/vector.h>
 
 namespace fw {
 namespace net {
 
-/* This class represents a "buffer" we use for reading/writing packets that get sent between net_peers. */
-class packet_buffer {
+/**
+ * The state that's kept for each peer when the "compact" encoding is enabled (see packet_buffer::set_compact). Because
+ * packets are delivered reliably and in order, both sides can build up the same string table as they go: the first
+ * time we send a string it goes in full, and after that we just send its index. A string only goes in the sender's
+ * table once the packet that introduced it has actually been sent (see packet_buffer::commit_strings).
+ */
+struct compact_encoding {
+  std::unordered_map<std::string, uint32_t> sent_strings;
+  std::vector<std::string> received_strings;
+};
+
+/**
+ * This class represents a "buffer" we use for reading/writing packets that get sent between net_peers. It's a flat
+ * block of memory: when writing, we grow it as needed and the peer hands the block straight to ENet (see release())
+ * so that it's never copied. When reading, we read directly out of the bytes we were given (which must stay alive
+ * for as long as we do).
+ */
+class packet_buffer : private boost::noncopyable {
 private:
-  bool _flushed;
-  std::string _value;
-  std::stringstream _buffer;
+  static const std::size_t INITIAL_CAPACITY = 256;
+
+  char *_data; // when writing, this is malloc'd and owned by us (until release() is called)
+  char const *_read_data;
+  std::size_t _size;
+  std::size_t _capacity;
+  std::size_t _read_pos;
+  bool _overrun;
   uint16_t _packet_type;
+  compact_encoding *_compact;
 
-  void flush();
+  // strings we've written in full that aren't in _compact->sent_strings yet, in the order we wrote them
+  std::vector<std::string> _new_strings;
+
+  void grow(std::size_t min_capacity);
 
 public:
   packet_buffer(uint16_t packet_type);
   packet_buffer(char const *bytes, std::size_t n);
   ~packet_buffer();
 
-  void add_bytes(char const *bytes, std::size_t offset, std::size_t n);
-  void get_bytes(char *bytes, std::size_t offset, std::size_t n);
+  inline void add_bytes(char const *bytes, std::size_t offset, std::size_t n);
+  inline void get_bytes(char *bytes, std::size_t offset, std::size_t n);
+
+  /**
+   * Gets a pointer to the next n bytes and skips over them, without copying them out. Returns nullptr if there's
+   * less than n bytes remaining.
+   */
+  inline char const *read_bytes(std::size_t n);
 
-  char const *get_buffer();
-  std::size_t get_size();
+  char const *get_buffer() const {
+    return _read_data != nullptr ? _read_data : _data;
+  }
+  std::size_t get_size() const {
+    return _size;
+  }
   uint16_t get_packet_type() const {
     return _packet_type;
   }
+
+  /** Gets the number of bytes we've still got left to read. */
+  std::size_t get_remaining() const {
+    return _size - _read_pos;
+  }
+
+  /**
+   * Returns true if we tried to read past the end of the buffer (i.e. the packet was truncated or malformed). Any
+   * reads past the end return zeros.
+   */
+  bool is_overrun() const {
+    return _overrun;
+  }
+
+  /**
+   * Enables the "compact" encoding used by the write_xyz/read_xyz methods below, with the given state for the peer
+   * we're talking to. Without it, they fall back to the same (fixed-size) encoding the << and >> operators use.
+   */
+  void set_compact(compact_encoding *state) {
+    _compact = state;
+  }
+  bool is_compact() const {
+    return _compact != nullptr;
+  }
+
+  // In compact mode, unsigned values are written as LEB128 "varints" (7 bits per byte, so small values only take
+  // one byte) and signed values are "zigzag" encoded first so that small negative values are small, too.
+  void write_uint(uint32_t value);
+  uint32_t read_uint();
+  void write_int(int32_t value);
+  int32_t read_int();
+
+  // In compact mode, positions are quantized to POSITION_RESOLUTION units (which is plenty for positions on the map
+  // grid) and written as three varints. Use quantize_position() on any position you send so that the sender ends up
+  // with the same value as the receiver.
+  static const int POSITION_RESOLUTION = 16; // steps per world unit
+  void write_position(fw::vector const &pos);
+  fw::vector read_position();
+  static fw::vector quantize_position(fw::vector const &pos);
+
+  // In compact mode, strings are sent in full the first time, and after that as an index in the string table.
+  void write_string_ref(std::string const &str);
+  std::string read_string_ref();
+
+  /**
+   * Adds the strings this packet sent in full to the string table. Call this once the packet has been sent: if it
+   * never reaches our peer, they won't have those strings in their table either.
+   */
+  void commit_strings();
+
+  /**
+   * Gives up ownership of the bytes we've written (which were allocated with malloc, and must be freed with free).
+   * After this, we're empty, but we still remember the new strings for commit_strings().
+   */
+  char *release();
 };
 
+void packet_buffer::add_bytes(char const *bytes, std::size_t offset, std::size_t n) {
+  if (_size + n > _capacity) {
+    grow(_size + n);
+  }
+  memcpy(_data + _size, bytes + offset, n);
+  _size += n;
+}
+
+void packet_buffer::get_bytes(char *bytes, std::size_t offset, std::size_t n) {
+  char const *src = read_bytes(n);
+  if (src == nullptr) {
+    memset(bytes + offset, 0, n);
+  } else {
+    memcpy(bytes + offset, src, n);
+  }
+}
+
+char const *packet_buffer::read_bytes(std::size_t n) {
+  if (_read_pos + n > _size) {
+    _overrun = true;
+    _read_pos = _size;
+    return nullptr;
+  }
+
+  char const *src = get_buffer() + _read_pos;
+  _read_pos += n;
+  return src;
+}
+
 inline packet_buffer &operator <<(packet_buffer &lhs, int32_t rhs) {
   lhs.add_bytes(reinterpret_cast<char const *>(&rhs), 0, 4);
   return lhs;
@@ -152,15 +277,11 @@ inline packet_buffer &operator >>(packet_buffer &lhs, std::string &rhs) {
   uint16_t length;
   lhs >> length;
 
-  if (length < 80) { // If it's < 80 bytes, just allocate on the stack.
-    char *value = reinterpret_cast<char *>(alloca(length));
-    lhs.get_bytes(value, 0, length);
-    rhs = std::string(value, length);
+  char const *value = lhs.read_bytes(length);
+  if (value == nullptr) {
+    rhs.clear();
   } else {
-    char *value = new char[length];
-    lhs.get_bytes(value, 0, length);
-    rhs = std::string(value, length);
-    delete[] value;
+    rhs.assign(value, length);
   }
 
   return lhs;
@@ -7,19 +7,110 @@ struct path_node;
 
 /** Class for finding a path between point "A" and point "B" in a grid. */
 class path_find {
+public:
+  /**
+   * The kind of data structure we use for the A* open set. The binary heap is the default, the multiset is the
+   * original implementation which we keep around so that we can compare the two (see the editor's pathing tool).
+   */
+  enum open_set_kind {
+    open_set_heap,
+    open_set_multiset
+  };
+
+  /**
+   * The search algorithm find() uses. Jump point search always finds the shortest path (A*'s heuristic can
+   * overestimate, so its paths are sometimes longer) and visits far fewer nodes on open ground. Both produce a path
+   * with one entry per cell, so simplify_path works the same on either. path-test --verify checks JPS against A*.
+   */
+  enum search_mode {
+    search_astar,
+    search_jps
+  };
+
+  /**
+   * A rectangular region of the grid, which can wrap around the edges of the map. The region starts at (x, z) and
+   * covers width x length cells.
+   */
+  struct region {
+    int x, z;
+    int width, length;
+  };
+
 private:
   int _width;
   int _length;
   path_node *_nodes;
   int _run_no;
+  open_set_kind _open_set_kind;
+  search_mode _search_mode;
+
+  // the binary heap we use for the open set, preallocated to hold every node so find() never allocates
+  path_node **_open_heap;
+  int _open_heap_size;
 
   path_node *get_node(fw::vector const &loc) const;
+  path_node *get_node(int x, int z) const;
   bool is_passable(fw::vector const &start, fw::vector const &end) const;
 
+  template<typename open_set_type>
+  bool find_impl(open_set_type &open_set, std::vector<fw::vector> &path, fw::vector const &start,
+      fw::vector const &end, region const *rgn, float *cost);
+
+  bool find_jps(std::vector<fw::vector> &path, fw::vector const &start, fw::vector const &end);
+  bool is_cell_open(int x, int z) const;
+  bool has_forced_neighbours(int x, int z, int dx, int dz) const;
+  path_node *jump(path_node const *from, int dx, int dz, path_node const *goal, float &cost) const;
+  void construct_jps_path(std::vector<fw::vector> &path, path_node const *goal_node) const;
+
+  void flood(fw::vector const &from, std::vector<path_node *> const &targets, region const *rgn, bool guided);
+
+  friend class heap_open_set;
+
+protected:
+  /**
+   * Like find(), except we only ever look at nodes inside the given region and the path must end exactly at 'end'
+   * rather than just next to it. If 'cost' is non-null, it's populated with the cost of the path we found.
+   */
+  bool find_in_region(std::vector<fw::vector> &path, fw::vector const &start, fw::vector const &end,
+      region const &rgn, float *cost);
+
+  /**
+   * Floods outwards from 'start' (without leaving the given region) and populates 'costs' with the cost of the
+   * cheapest path to each of the given 'targets', or -1 if the target can't be reached.
+   */
+  void find_costs_in_region(fw::vector const &start, std::vector<fw::vector> const &targets, region const &rgn,
+      std::vector<float> &costs);
+
+  bool is_cell_passable(int x, int z) const;
+
 public:
   path_find(int width, int length, std::vector<bool> const &passability);
   virtual ~path_find();
 
+  void set_open_set_kind(open_set_kind kind) {
+    _open_set_kind = kind;
+  }
+  open_set_kind get_open_set_kind() const {
+    return _open_set_kind;
+  }
+
+  void set_search_mode(search_mode mode) {
+    _search_mode = mode;
+  }
+  search_mode get_search_mode() const {
+    return _search_mode;
+  }
+
+  int get_width() const {
+    return _width;
+  }
+  int get_length() const {
+    return _length;
+  }
+
+  /** Updates the passability of a single cell, for example when the collision data is edited. */
+  virtual void set_passable(int x, int z, bool passable);
+
   /**
    * Finds a path between the given 'start' and 'end' vectors. We ignore the y component of the vectors and just look
    * at the (x,y) components. The 'path' is populated with the path we found and we'll assume the agent will travel
@@ -38,6 +129,17 @@ public:
    * Note: the path in full_path is not modified, but the simplified path is built up in new_path.
    */
   virtual void simplify_path(std::vector<fw::vector> const &full_path, std::vector<fw::vector> &new_path);
+
+  /**
+   * Finds a path from each of the given 'starts' to the same 'goal'. Rather than doing one search per start, we do a
+   * single reverse Dijkstra search outwards from the goal, which gives us a "flow field" over the grid that each
+   * start just follows down to the goal.
+   *
+   * paths[i] is populated with the path for starts[i], or left empty if starts[i] can't reach the goal. Returns the
+   * number of paths we found.
+   */
+  int find_group(std::vector<std::vector<fw::vector>> &paths, std::vector<fw::vector> const &starts,
+      fw::vector const &goal);
 };
 
 /**
@@ -1,10 +1,12 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <stack>
 
 #include <framework/vector.h>
 #include <framework/colour.h>
+#include <framework/frustum.h>
 
 namespace fw {
 class camera;
@@ -14,6 +16,8 @@ class index_buffer;
 class shader;
 class shader_parameters;
 class framebuffer;
+class frame_arena;
+class shader_parameter_handle;
 
 namespace sg {
 
@@ -27,6 +31,53 @@ enum primitive_type {
   primitive_whatever
 };
 
+// opaque draw items are sorted by their render state (shader, parameters, buffers) so that draws which share state
+// are issued together. ordered draw items are drawn after all the opaque items, in the order they were added (this is
+// what you want for anything that's blended).
+enum render_layer {
+  render_layer_opaque,
+  render_layer_ordered
+};
+
+/**
+ * A single draw call in the scenegraph's render queue. Draw items are allocated from the frame_arena, so they're only
+ * valid for the frame they were added in. The buffers, shader and parameters are not owned by the draw item, whoever
+ * adds it must make sure they outlive the frame.
+ */
+struct draw_item {
+  render_layer layer;
+  uint32_t sequence;
+  uint64_t sort_key;
+
+  primitive_type primitive;
+  bool cast_shadows;
+
+  // static shadow casters (i.e. the terrain) are rendered into a cached shadow map that we only update when they (or
+  // the light) change, rather than every frame.
+  bool static_caster;
+
+  // shadow-only items are off screen, so they're only drawn into the shadow map (their shadow might still be on screen)
+  bool shadow_only;
+
+  // a world-space bounding sphere around the item, used to fit the shadow camera and to skip items that are outside
+  // the shadow camera's frustum. A radius of 0 means we don't know the bounds, and the item is always drawn.
+  fw::vector bounds_centre;
+  float bounds_radius;
+
+  fw::vertex_buffer *vb;
+  fw::index_buffer *ib;
+  fw::shader *shader;
+  fw::shader_parameters *shader_params;
+  fw::matrix transform;
+
+  // if not null, we set this colour parameter to the given colour just before drawing. This lets many draw items
+  // share the one shader_parameters with only the colour differing between them.
+  fw::shader_parameter_handle const *colour_param;
+  fw::colour colour;
+
+  draw_item *next;
+};
+
 // represents the properties of a light that we'll need to add to the
 // scene (we'll need at least one light-source of course!
 class light {
@@ -74,17 +125,11 @@ private:
   std::shared_ptr<fw::shader> _shader;
   std::shared_ptr<fw::shader_parameters> _shader_params;
 
-  // Renders the node if the shader file is null (basically just uses the basic shader).
-  void render_noshader(fw::camera *camera, fw::matrix const &transform);
-
 protected:
   node *_parent;
   std::vector<std::shared_ptr<node> > _children;
   fw::matrix _world;
 
-  // this is called when we're rendering a given shader
-  virtual void render_shader(std::shared_ptr<fw::shader> shader, fw::camera *camera, fw::matrix const &transform);
-
   // called by clone() to populate the clone
   virtual void populate_clone(std::shared_ptr<node> clone);
 public:
@@ -147,8 +192,9 @@ public:
     return _primitive_type;
   }
 
-  // this is called by the scenegraph itself when it's time to render
-  virtual void render(scenegraph *sg, fw::matrix const &model_matrix = fw::identity());
+  // this is called by the scenegraph itself when it's time to render, to add draw items for this node (and its
+  // children) to the render queue.
+  virtual void enqueue(scenegraph &sg, fw::matrix const &model_matrix = fw::identity());
 
   // Creates a clone of this node (it's a "shallow" clone in that the vertex_buffer, index_buffer and shader will be
   // shared but matrix and shader_parameters will be new)
@@ -157,6 +203,8 @@ public:
 
 // this class manages the scene graph.
 class scenegraph {
+  friend class node;
+
 public:
   typedef std::vector<std::shared_ptr<light> > light_coll;
   typedef std::vector<std::shared_ptr<node> > node_coll;
@@ -167,10 +215,76 @@ private:
   fw::colour _clear_colour;
   std::stack<fw::camera *> _camera_stack;
 
+  // the render queue: a linked list of draw items in the order they were added, and the sorted array that we build
+  // from it in get_render_queue(). All of it lives in the frame arena.
+  fw::frame_arena &_arena;
+  draw_item *_first_item;
+  draw_item *_last_item;
+  int _num_items;
+  size_t _num_enqueued_nodes;
+  int _num_nodes;
+  draw_item **_sorted_items;
+  int _num_sorted_items;
+  int _num_draw_calls;
+
+  // the view frustum that is_visible() tests against, calculated from the camera the first time it's called, and
+  // the number of objects that it has said are visible (or not)
+  bool _has_view_frustum;
+  fw::frustum _view_frustum;
+  fw::vector _view_position;
+  int _num_visible_objects;
+  int _num_culled_objects;
+
 public:
   scenegraph();
+  scenegraph(fw::frame_arena &arena);
   ~scenegraph();
 
+  // adds a new draw item to the render queue and returns it so you can fill it in. Everything except the layer and
+  // sequence is zeroed (cast_shadows is true and the transform is the identity).
+  draw_item *add_draw_item(render_layer layer = render_layer_opaque);
+
+  // adds the draw items for any nodes that haven't been added yet, sorts the render queue and returns it
+  draw_item * const *get_render_queue(int *num_items);
+
+  // gets the number of draw items and the number of nodes in the render queue
+  int get_num_draw_items() const {
+    return _num_items;
+  }
+  int get_num_nodes() const {
+    return _num_nodes;
+  }
+
+  // the number of draw calls fw::render actually issued (including the shadow pass), after instancing
+  void set_num_draw_calls(int num_draw_calls) {
+    _num_draw_calls = num_draw_calls;
+  }
+  int get_num_draw_calls() const {
+    return _num_draw_calls;
+  }
+
+  fw::frame_arena &get_arena() {
+    return _arena;
+  }
+
+  // returns true if an object with the given bounding sphere can be seen from the current camera, meaning it's inside
+  // the view frustum and (if lod_size is not 0) its radius is at least lod_size times its distance from the camera, so
+  // that it'll actually cover a few pixels. Objects with a radius of 0 are always visible.
+  bool is_visible(fw::vector const &centre, float radius, float lod_size = 0.0f);
+
+  // returns true if an object with the given bounding sphere could cast a shadow onto what we can see. Add objects
+  // that aren't visible but could cast a shadow as shadow_only draw items. We test against the light cameras from the
+  // last frame that was rendered, which are fitted to what was visible then.
+  bool might_cast_shadow(fw::vector const &centre, float radius) const;
+
+  // gets the number of objects that is_visible said could, and could not, be seen
+  int get_num_visible_objects() const {
+    return _num_visible_objects;
+  }
+  int get_num_culled_objects() const {
+    return _num_culled_objects;
+  }
+
   // add a light to the scene. the pointer must be valid for the
   void add_light(std::shared_ptr<light> &l) {
     _lights.push_back(l);
@@ -3,6 +3,7 @@
 #include <string>
 #include <map>
 #include <memory>
+#include <vector>
 #include <boost/noncopyable.hpp>
 
 #include <framework/framework.h>
@@ -19,30 +20,66 @@ class vertex_buffer;
 class index_buffer;
 class shader_program;
 
+/**
+ * A pre-resolved shader parameter name. The first time we see a name, it's assigned a small integer id, and each
+ * shader_program maps those ids to its uniforms when it's linked. Setting or applying a parameter by handle never has
+ * to compare strings, so for parameters that are set every draw, create the handle once (e.g. as a static) and reuse
+ * it. A handle can be implicitly created from a name, so you can still just pass the name if it's not important.
+ */
+class shader_parameter_handle {
+private:
+  int _id;
+
+public:
+  shader_parameter_handle(std::string const &name);
+  shader_parameter_handle(char const *name);
+
+  int get_id() const {
+    return _id;
+  }
+};
+
 // you can pass this to a shader to set a bunch of parameters all at once
 class shader_parameters: private boost::noncopyable {
 private:
   friend class shader;
 
+  enum value_type {
+    value_matrix,
+    value_vector,
+    value_colour,
+    value_scalar
+  };
+
+  // the parameters are stored in flat arrays and looked up by id. There's usually only a handful of them, so a linear
+  // search is faster than anything fancier.
+  struct value {
+    int id;
+    value_type type;
+    float data[16];
+  };
+  struct texture_value {
+    int id;
+    std::shared_ptr<texture> tex;
+  };
+
   std::string _program_name;
-  std::map<std::string, std::shared_ptr<texture> > _textures;
-  std::map<std::string, matrix> _matrices;
-  std::map<std::string, vector> _vectors;
-  std::map<std::string, colour> _colours;
-  std::map<std::string, float> _scalars;
+  std::vector<texture_value> _textures;
+  std::vector<value> _values;
 
   shader_parameters();
+  float *set_value(shader_parameter_handle const &handle, value_type type);
   void apply(shader_program *prog) const;
 
 public:
   ~shader_parameters();
 
   void set_program_name(std::string const &name);
-  void set_texture(std::string const &name, std::shared_ptr<texture> const &t);
-  void set_matrix(std::string const &name, matrix const &m);
-  void set_vector(std::string const &name, vector const &v);
-  void set_colour(std::string const &name, colour const &c);
-  void set_scalar(std::string const &name, float f);
+  void set_texture(shader_parameter_handle const &handle, std::shared_ptr<texture> const &t);
+  void set_matrix(shader_parameter_handle const &handle, matrix const &m);
+  void set_vector(shader_parameter_handle const &handle, vector const &v);
+  void set_colour(shader_parameter_handle const &handle, colour const &c);
+  void set_scalar(shader_parameter_handle const &handle, float f);
 
   std::shared_ptr<shader_parameters> clone();
 };
@@ -78,7 +115,14 @@ public:
   // creates an shader_parameters that you'll pass to begin() in order to set up the parameters for this rendering.
   std::shared_ptr<shader_parameters> create_parameters();
 
+  // returns true if this shader has a program with the given name (e.g. "instanced")
+  bool has_program(std::string const &name) const;
+
   void begin(std::shared_ptr<shader_parameters> parameters);
+  void begin(shader_parameters *parameters);
+
+  // begins the given program, regardless of the program name in the parameters
+  void begin(shader_parameters *parameters, std::string const &program_name);
   void end();
 };
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 #include <framework/camera.h>
 
 namespace fw {
@@ -17,6 +19,15 @@ class light_camera: public camera {
 public:
   light_camera();
   virtual ~light_camera();
+
+  /** Sets the position and direction of the camera, and updates the view matrix straight away. */
+  void set_view(vector const &position, vector const &direction);
+
+  /** Sets up an orthographic projection of the given size, for a directional light. */
+  void set_orthographic(float width, float height, float near_plane, float far_plane);
+
+  /** Sets up the default perspective projection, used when we don't know enough about the scene to fit it. */
+  void set_default_projection();
 };
 
 /**
@@ -28,10 +39,21 @@ private:
   light_camera _camera;
   std::shared_ptr<framebuffer> _shadowbuffer;
 
+  // the depth of just the static shadow casters (i.e. the terrain), which we only re-render when the signature
+  // (which covers the light camera and the casters themselves) changes. Each frame, it's copied into _shadowbuffer
+  // and only the dynamic casters are drawn on top.
+  std::shared_ptr<framebuffer> _static_shadowbuffer;
+  uint64_t _static_signature;
+
 public:
   shadow_source();
   ~shadow_source();
 
+  // if something changes the static casters in a way that the signature can't see (e.g. the editor changing the
+  // terrain's height), call this to force the static shadow maps to be re-rendered.
+  static void invalidate_static_casters();
+  static uint64_t get_static_generation();
+
   void initialize(bool debug = false);
   void destroy();
 
@@ -43,6 +65,19 @@ public:
   // reset the render target
   void end_scene();
 
+  // like begin_scene, but sets up the static shadow map as the render target
+  void begin_static_scene();
+
+  // copies the static shadow map into the "real" one, call this after graphics::begin_scene
+  void restore_static_casters();
+
+  uint64_t get_static_signature() const {
+    return _static_signature;
+  }
+  void set_static_signature(uint64_t signature) {
+    _static_signature = signature;
+  }
+
   // gets the camera which you can use to "direct" the light source
   light_camera &get_camera() {
     return _camera;
@@ -64,6 +64,10 @@ public:
   void clear();
   void unbind();
 
+  // copies our depth buffer into the given framebuffer's depth buffer (they must be the same size). The destination
+  // framebuffer is left bound.
+  void copy_depth_to(framebuffer &dest);
+
   int get_width() const;
   int get_height() const;
 };
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+namespace fw {
+
+/**
+ * A fixed-size pool of threads that we can hand a "parallel for" to. The range is split into chunks, and the chunks
+ * are handed out to the workers (and the calling thread, which also pitches in) until they're all done. Each index
+ * is visited exactly once, so as long as the work for each index only touches its own state, the result doesn't
+ * depend on how the chunks happened to be scheduled.
+ */
+class thread_pool : private boost::noncopyable {
+private:
+  std::vector<std::thread> _threads;
+  std::mutex _mutex;
+  std::condition_variable _work_condition;
+  std::condition_variable _done_condition;
+  bool _stopping;
+
+  // the state of the current parallel_for, protected by _mutex. _generation is incremented each time we start a new
+  // one, so that a worker that's slow to wake up doesn't pick up a chunk from the wrong one.
+  std::function<void(int, int)> const *_fn;
+  int _count;
+  int _chunk_size;
+  int _num_chunks;
+  int _next_chunk;
+  int _chunks_done;
+  unsigned int _generation;
+
+  void thread_proc();
+  void run_chunks(unsigned int generation);
+
+public:
+  /** Creates a new thread_pool with the given number of worker threads (which can be 0). */
+  thread_pool(int num_threads);
+  ~thread_pool();
+
+  int get_num_threads() const {
+    return static_cast<int>(_threads.size());
+  }
+
+  /**
+   * Calls fn(begin, end) over sub-ranges that together cover [0, count), spread out over our threads. We don't
+   * return until all of them are done. Anything less than min_chunk_size is just run on the calling thread.
+   */
+  void parallel_for(int count, std::function<void(int, int)> const &fn, int min_chunk_size = 16);
+};
+
+}
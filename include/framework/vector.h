@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <vector>
 #include <cml/cml.h>
 
@@ -52,4 +53,10 @@ inline matrix scale(vector const &v) {
   return m;
 }
 
+/** Gets the largest scale that the given matrix applies along any axis, e.g. to transform a bounding sphere. */
+inline float max_scale(matrix const &m) {
+  return std::max(cml::matrix_get_x_basis_vector(m).length(),
+      std::max(cml::matrix_get_y_basis_vector(m).length(), cml::matrix_get_z_basis_vector(m).length()));
+}
+
 }
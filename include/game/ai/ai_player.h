@@ -1,6 +1,7 @@
 #pragma once
 
 #include <map>
+#include <memory>
 #include <luabind/object.hpp>
 
 #include <game/simulation/player.h>
@@ -12,6 +13,11 @@ namespace fw {
 class lua_context;
 }
 
+namespace ent {
+class entity;
+struct entity_query;
+}
+
 namespace game {
 
 /**
@@ -22,6 +28,8 @@ class ai_player : public player {
 private:
   typedef std::map<std::string, std::vector<luabind::object>> lua_event_map;
   typedef std::map<std::string, luabind::object> unit_creator_map;
+  typedef std::map<std::weak_ptr<ent::entity>, luabind::object, std::owner_less<std::weak_ptr<ent::entity>>>
+      unit_wrapper_map;
 
   script_desc _script_desc;
   std::shared_ptr<fw::lua_context> _script;
@@ -30,6 +38,11 @@ private:
   unit_creator_map _unit_creator_map;
   bool _is_valid;
 
+  // the unit_wrappers we've created so far. They're per-player (rather than stored on the entity) because each AI
+  // player has it's own lua_State. Wrappers for destroyed entities are pruned periodically in update().
+  unit_wrapper_map _unit_wrappers;
+  int _updates_since_prune;
+
   void fire_event(std::string const &event_name,
      std::map<std::string, std::string> const &parameters = std::map<std::string, std::string>());
 
@@ -41,6 +54,12 @@ private:
 
   void issue_order(unit_wrapper *unit, luabind::object orders);
 
+  /** Parses the given find_units parameters into an entity_query. */
+  void parse_query(luabind::object const &params, ent::entity_query &query);
+
+  /** Runs the given query and returns a table of the unit_wrappers for all of the matching entities. */
+  luabind::object find_units(ent::entity_query const &query, lua_State *L);
+
   void l_set_ready();
   void l_say(std::string const &msg);
   void l_local_say(std::string const &msg);
@@ -48,6 +67,7 @@ private:
   void l_register_unit(std::string name, luabind::object creator);
   void l_event(std::string const &event_name, luabind::object obj);
   luabind::object l_find_units(luabind::object params, lua_State* L);
+  luabind::object l_find_units_batch(luabind::object queries, lua_State* L);
   void l_issue_order(luabind::object units, luabind::object orders);
 
 public:
@@ -64,7 +84,7 @@ public:
 
   // This is called each simulation frame when we get all the commands from
   // other players
-  virtual void post_commands(std::vector<std::shared_ptr<command> > &commands);
+  virtual void post_commands(std::vector<std::shared_ptr<command> > &commands, uint32_t turn);
 
   // gets value that indicates whether we're in a valid state or not
   bool is_valid_state() { return _is_valid; }
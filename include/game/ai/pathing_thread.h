@@ -1,12 +1,18 @@
 #pragma once
 
+#include <condition_variable>
+#include <deque>
 #include <functional>
+#include <list>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <thread>
+#include <unordered_map>
 #include <boost/noncopyable.hpp>
 
+#include <framework/timer.h>
 #include <framework/vector.h>
-#include <framework/work_queue.h>
 
 namespace fw {
 class path_find;
@@ -16,27 +22,91 @@ namespace game {
 class terrain;
 
 /**
- * Encapsulates a thread that all players will queue requests for path-finding to. We then execute one request
- * at a time and call the player back when the path is found.
+ * Encapsulates a pool of threads that all players will queue requests for path-finding to. Each worker has its own
+ * path_find (since the path_find keeps scratch state for each search) and we call the player back when the path is
+ * found.
+ *
+ * Requests are split into two "lanes": the high priority lane is for orders the local player gave, and they always
+ * go ahead of the normal lane (AI players and so on). Within each lane, we round-robin between players so that one
+ * player who orders a whole army around at once can't starve everybody else.
+ *
+ * Units that are all heading to the same place can be sent as a "group" request, which is served with a single
+ * flow-field search (see fw::path_find::find_group) rather than one search per unit. Between begin_batch() and
+ * end_batch(), requests from the same player to the same goal are grouped up automatically.
+ *
+ * We also keep a least-recently-used cache of the paths we've found, keyed on the start and goal cells, since units
+ * tend to go back and forth between the same places over and over. Nothing changes the collision data once the
+ * world is loaded, so entries are never invalidated. If something ever does (e.g. buildings blocking cells), it'll
+ * have to pass the change on to every worker's path_find and clear the cache.
  */
 class pathing_thread: private boost::noncopyable {
 public:
   typedef std::function<void(std::vector<fw::vector> const &)> callback_fn;
 
+  enum priority {
+    priority_normal,
+    priority_high,
+    num_priorities
+  };
+
+  /** Some statistics about the requests we've served, for debugging. */
+  struct stats {
+    int queue_depth;
+    int num_requests;
+    float last_wait_time; // seconds between the last request being queued and a worker picking it up
+    float last_search_time; // seconds the last request spent actually searching
+    float average_latency; // a moving average of wait + search time, in seconds
+    int cache_hits;
+    int cache_misses;
+    float cache_time_saved; // an estimate of the search time the cache has saved us, in seconds
+  };
+
 private:
   struct path_request_data {
-    int flags;
-    fw::vector start;
+    int player_no;
+    priority prio;
+    std::vector<fw::vector> starts;
+    std::vector<callback_fn> callbacks;
     fw::vector goal;
-    callback_fn callback;
+    fw::chrono_clock::time_point enqueue_time;
+  };
+
+  struct lane {
+    std::map<int, std::deque<path_request_data>> player_queues;
+    int last_player_no;
+  };
+
+  struct cache_entry {
+    uint64_t key;
+    std::vector<fw::vector> path;
   };
 
-  std::shared_ptr<fw::path_find> _pather;
   terrain *_terrain;
-  std::thread _thread;
-  fw::work_queue<path_request_data> _work_queue;
+  std::vector<std::thread> _threads;
+  std::mutex _mutex;
+  std::condition_variable _condition;
+  lane _lanes[num_priorities];
+  bool _stopping;
+  stats _stats;
+
+  // requests that have been made since begin_batch() was called, waiting for end_batch()
+  bool _batching;
+  std::vector<path_request_data> _batch;
+
+  // the path cache, with the most recently used entry at the front of the list
+  std::mutex _cache_mutex;
+  std::list<cache_entry> _cache;
+  std::unordered_map<uint64_t, std::list<cache_entry>::iterator> _cache_index;
+  int _cache_capacity;
+  float _average_path_search_time;
+
+  static uint64_t get_cache_key(fw::vector const &start, fw::vector const &goal);
+  bool cache_lookup(uint64_t key, std::vector<fw::vector> &path);
+  void cache_store(uint64_t key, std::vector<fw::vector> const &path);
 
-  void thread_proc();
+  void enqueue(path_request_data &request);
+  bool dequeue(path_request_data &request);
+  void thread_proc(int worker_no);
 
 public:
   pathing_thread();
@@ -44,7 +114,27 @@ public:
   void start();
   void stop();
 
+  /** Requests a path on behalf of the given player. on_path_found is called (on a worker thread) with the path. */
+  void request_path(int player_no, priority prio, fw::vector const &start, fw::vector const &goal,
+      callback_fn on_path_found);
   void request_path(fw::vector const &start, fw::vector const &goal, callback_fn on_path_found);
+
+  /**
+   * Requests paths from each of the given starts to the same goal, using one search for the whole group.
+   * on_paths_found[i] is called with the path for starts[i].
+   */
+  void request_group_path(int player_no, priority prio, std::vector<fw::vector> const &starts,
+      fw::vector const &goal, std::vector<callback_fn> const &on_paths_found);
+
+  /**
+   * Until end_batch() is called, hold on to requests rather than queuing them, so that requests to the same goal can
+   * be merged into a group request. The simulation thread uses this while it executes each turn's commands, so that
+   * a move order given to a whole selection of units turns into a single search.
+   */
+  void begin_batch();
+  void end_batch();
+
+  stats get_stats();
 };
 
 }
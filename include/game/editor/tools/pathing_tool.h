@@ -9,6 +9,7 @@ class collision_patch;
 namespace fw {
 class model;
 class timed_path_find;
+class hierarchical_path_find;
 }
 
 namespace ed {
@@ -29,8 +30,10 @@ private:
   fw::vector _end_pos;
   bool _end_set;
   bool _simplify;
+  bool _hierarchical;
   std::vector<std::shared_ptr<collision_patch>> _patches;
   std::shared_ptr<fw::timed_path_find> _path_find;
+  std::shared_ptr<fw::hierarchical_path_find> _hierarchical_path_find;
 
   void on_key(std::string keyname, bool is_down);
   std::shared_ptr<collision_patch> bake_patch(int patch_x, int patch_z);
@@ -45,9 +48,14 @@ public:
   virtual void render(fw::sg::scenegraph &scenegraph);
 
   void set_simplify(bool enabled);
+  void set_hierarchical(bool enabled);
+  void set_jps(bool enabled);
   void set_test_start();
   void set_test_end();
   void stop_testing();
+
+  // runs the current test path with each of fw::path_find's open sets and search modes and reports the timings
+  void compare_searches();
 };
 
 }
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <game/entities/position_component.h>
+
+namespace ent {
+class entity_manager;
+
+/**
+ * The broadphase runs once per update, before any of the components are updated. It walks the patch_manager's
+ * spatial index once to find every entity's nearest neighbour (which the moveable_component uses to steer around
+ * obstacles), and sweeps each projectile along the path it travelled since the last update to find what it hit. The
+ * sweep means fast projectiles can't pass straight through something between one frame and the next.
+ */
+class broadphase {
+public:
+  // we only look for neighbours that are this close. The moveable_component only steers around obstacles within
+  // three times their selection radius, so this needs to cover three times the biggest selection radius.
+  static const int NEIGHBOUR_DISTANCE = 2 * patch_manager::CELL_SIZE;
+
+private:
+  int _num_pairs;
+  int _num_projectiles;
+
+  void find_neighbours(patch_manager *patch_mgr);
+  void sweep_projectiles(entity_manager *entity_mgr, patch_manager *patch_mgr);
+
+public:
+  broadphase();
+
+  void update(entity_manager *entity_mgr, patch_manager *patch_mgr);
+
+  // gets the number of pairs of entities we tested, and the number of projectiles we swept, in the last update
+  int get_num_pairs() const {
+    return _num_pairs;
+  }
+  int get_num_projectiles() const {
+    return _num_projectiles;
+  }
+};
+
+}
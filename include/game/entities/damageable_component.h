@@ -13,6 +13,8 @@ class damageable_component: public entity_component,
     public boost::signals2::trackable {
 private:
   std::string _expl_name;
+  uint64_t _state_hash; // our part of the entity's state hash, which is based on our health
+  void update_state_hash(float health);
   void check_explode(boost::any health_value);
 
 public:
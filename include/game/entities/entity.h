@@ -1,8 +1,10 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include <framework/lua.h>
+#include <framework/memory_pool.h>
 #include <luabind/object.hpp>
 
 #include <game/entities/entity_attribute.h>
@@ -28,6 +30,43 @@ class entity_manager;
  */
 typedef uint32_t entity_id;
 
+/**
+ * Gets the memory_pool that entities, their components and their internal bookkeeping are allocated from. Entities
+ * like missiles and explosions are created and destroyed all the time, so we don't want to keep going to the heap.
+ */
+fw::memory_pool *get_entity_pool();
+
+/**
+ * Mixes the given value into the given hash. This is used to build up the "state hash" of the entities (see
+ * entity::update_state_hash) so it must give the same result on every platform.
+ */
+inline uint64_t hash_state(uint64_t hash, uint64_t value) {
+  uint64_t x = hash ^ (value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2));
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/**
+ * Component identifiers are all multiples of COMPONENT_IDENTIFIER_STEP (position is 100, mesh is 200 and so on), so
+ * identifier / COMPONENT_IDENTIFIER_STEP gives each kind of component a small "slot" number. Entities keep their
+ * components in a table indexed by slot, so looking one up is just an array index.
+ */
+static const int COMPONENT_IDENTIFIER_STEP = 50;
+static const int MAX_COMPONENT_SLOTS = 20;
+
+inline int get_component_slot(int identifier) {
+  return identifier / COMPONENT_IDENTIFIER_STEP;
+}
+
+// the same as get_component_slot, but at compile time (and we can make sure the identifier is valid)
+template<class T>
+struct component_slot {
+  static const int value = T::identifier / COMPONENT_IDENTIFIER_STEP;
+  static_assert(T::identifier % COMPONENT_IDENTIFIER_STEP == 0 && value < MAX_COMPONENT_SLOTS,
+      "component identifiers must be a multiple of COMPONENT_IDENTIFIER_STEP, and less than the maximum");
+};
+
 /**
  * This is the base class for components of entities. It's just got a couple of methods
  * and stuff that let us figure out how the component fits in and so on.
@@ -41,6 +80,10 @@ public:
   entity_component();
   virtual ~entity_component();
 
+  // components are allocated from the entity pool (see get_entity_pool)
+  static void *operator new(std::size_t size);
+  static void operator delete(void *ptr, std::size_t size);
+
   /**
    * This is called once the entity we're attached to has all of it's components defined and so
    * on (we can query for other components, etc)
@@ -52,6 +95,20 @@ public:
   virtual void update(float) {
   }
 
+  /**
+   * Return true from here if update() can be called on this kind of component in many entities at once. That means
+   * update() must only modify this entity, and only read things about other entities that no other component of
+   * this kind modifies in its update(). Anything else (moving, spawning other entities, etc) must be deferred until
+   * commit_update().
+   */
+  virtual bool allow_parallel_update() {
+    return false;
+  }
+
+  /** If allow_parallel_update() returns true, this is called (one entity at a time) after the parallel update. */
+  virtual void commit_update() {
+  }
+
   /** This is called when it's time to render. generate a scenegraph node and add it to the scenegraph. */
   virtual void render(fw::sg::scenegraph &, fw::matrix const &) {
   }
@@ -68,6 +125,11 @@ public:
     _entity = ent;
   }
 
+  /** Gets the entity we're attached to. */
+  std::weak_ptr<entity> const &get_entity() const {
+    return _entity;
+  }
+
   /**
    * Gets the unique identifier for this component (e.g. render_component::identifier for the render component)
    */
@@ -91,10 +153,21 @@ private:
   friend class entity_manager;
   entity(entity_manager *mgr, entity_id id);
 
-  std::map<int, entity_component *> _components;
-  std::map<std::string, entity_attribute> _attributes;
+  typedef std::vector<entity_component *, fw::pool_allocator<entity_component *>> component_list;
+  typedef std::map<std::string, entity_attribute, std::less<std::string>,
+      fw::pool_allocator<std::pair<std::string const, entity_attribute>>> attribute_map;
+
+  // our components indexed by their slot (see get_component_slot), and the same components in order of identifier
+  // (which is the order we initialize, update and render them in)
+  entity_component *_component_table[MAX_COMPONENT_SLOTS];
+  component_list _components;
+  attribute_map _attributes;
   std::weak_ptr<entity> _creator;
   entity_id _id;
+  size_t _index; // our index in the entity_manager's list of all entities
+  uint64_t _state_hash; // the sum of all the parts of the state hash for this entity
+  uint64_t _base_state_hash; // the part of the state hash for our identity (see entity_manager::create_entity)
+  bool _in_state_hash; // false once we've been removed from the entity_manager
   float _create_time;
   std::string _name;
 
@@ -104,6 +177,10 @@ private:
 public:
   ~entity();
 
+  // entities are allocated from the entity pool (see get_entity_pool)
+  static void *operator new(std::size_t size);
+  static void operator delete(void *ptr, std::size_t size);
+
   // adds a new component to this entity, and gets the component with the given identifier
   void add_component(entity_component *comp);
   entity_component *get_component(int identifier);
@@ -130,14 +207,15 @@ public:
   void initialize();
 
   // this is a templated version of get_component that uses the fact that the components all
-  // have a static member called "identifier" which contains the identifier
+  // have a static member called "identifier" which contains the identifier. Only one component can have a given
+  // identifier, so the component in that slot is always a T (or something derived from it).
   template<class T>
   inline T *get_component() {
-    return dynamic_cast<T *>(get_component(T::identifier));
+    return static_cast<T *>(_component_table[component_slot<T>::value]);
   }
   template<class T>
   inline T const *get_component() const {
-    return dynamic_cast<T const *>(get_component(T::identifier));
+    return static_cast<T const *>(_component_table[component_slot<T>::value]);
   }
 
   template<class T>
@@ -170,6 +248,13 @@ public:
   entity_id get_id() const {
     return _id;
   }
+
+  /**
+   * Components call this when the part of the entity's state that they're responsible for changes (e.g. the position
+   * changes). part is the component's current contribution to the state hash, which we replace with value. The
+   * entity_manager keeps the sum of every entity's state hash, which we use to detect when peers go out of sync.
+   */
+  void update_state_hash(uint64_t &part, uint64_t value);
 };
 
 }
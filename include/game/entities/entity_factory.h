@@ -13,19 +13,26 @@ namespace fw {
 class xml_element;
 }
 
-/** This is a helper macro for registering component types with the entity_factory. */
+/**
+ * This is a helper macro for registering component types with the entity_factory. Components are created by copying
+ * a "prototype" that has already had apply_template called on it, so they must be copy-constructible.
+ */
 #define ENT_COMPONENT_REGISTER(name, type) \
-  ent::component_register reg_ ## type(name, []() { return new type(); })
+  ent::component_register reg_ ## type(name, []() { return new type(); }, \
+      [](entity_component const *prototype) { return new type(*static_cast<type const *>(prototype)); })
 
 namespace ent {
 class entity;
 class entity_component;
+struct entity_prototype;
 
 // this class is used to build entities from their XML definition file.
 class entity_factory {
 private:
   void load_entities();
 
+  // compiles the given template into an entity_prototype, so we don't have to walk the Lua tables on each spawn
+  entity_prototype *compile_template(luabind::object const &tmpl);
   entity_component *create_component(std::string component_type_name);
 public:
   entity_factory();
@@ -49,7 +56,8 @@ public:
 // to register a component with the entity_factory.
 class component_register {
 public:
-  component_register(char const *name, std::function<entity_component *()> fn);
+  component_register(char const *name, std::function<entity_component *()> create_fn,
+      std::function<entity_component *(entity_component const *)> clone_fn);
 };
 
 }
@@ -1,36 +1,109 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 #include <framework/scenegraph.h>
 #include <framework/vector.h>
 #include <game/entities/entity.h>
+#include <game/entities/broadphase.h>
 
 namespace fw {
 class graphics;
+class thread_pool;
 }
 
 namespace ent {
 class entity;
+class entity_component;
 class entity_debug;
 class patch_manager;
 
+/**
+ * The parameters for entity_manager::find_entities. An entity matches if it's owned by one of the given players (if
+ * any are given), was created from the given template (if not empty) and is in the given order state (if not empty,
+ * "idle" means it's orderable but not currently executing an order).
+ */
+struct entity_query {
+  std::vector<int> player_nos;
+  std::string template_name;
+  std::string state;
+};
+
 /**
  * Manages all the entities in the game, and contains various "indexes" of entities so that we
  * can access them efficiently.
  */
 class entity_manager {
 private:
-  std::list<std::shared_ptr<entity>> _all_entities;
-  std::list<std::shared_ptr<entity>> _destroyed_entities;
+  // all of the entities are stored contiguously, so that update() just walks an array. When an entity is destroyed,
+  // the last entity is moved into its slot (so order is not preserved!)
+  //
+  // Entities are created (and destroyed) from the simulation thread as well as the main thread, but only the main
+  // thread changes _all_entities: new and destroyed entities are queued up in _created_entities and
+  // _destroyed_entities, and update() applies them before it walks the array. The queues, and any change to
+  // _all_entities or _entity_indices, are protected by _index_mutex.
+  std::vector<std::shared_ptr<entity>> _all_entities;
+  std::vector<std::shared_ptr<entity>> _created_entities;
+  std::vector<std::shared_ptr<entity>> _destroyed_entities;
   std::list<std::weak_ptr<entity>> _selected_entities;
 
-  std::map<int, std::list<std::weak_ptr<entity>>> _entities_by_component;
+  // maps the entity's identifier to its index in _all_entities. The identifier is our "stable handle" to an entity,
+  // since identifiers are never re-used. Entities with an identifier of 0 (missiles, explosions, etc that are created
+  // locally) are not indexed, since they can't be referred to by identifier anyway. Entities that are still in
+  // _created_entities aren't in here yet, either.
+  std::unordered_map<entity_id, size_t> _entity_indices;
+
+  std::map<int, std::vector<std::weak_ptr<entity>>> _entities_by_component;
+
+  // the time (in seconds) that the last call to update() spent updating entities
+  float _update_time;
+
+  // we update the entities one kind of component at a time (in order of the component's identifier, so this is
+  // indexed by component slot). Components that allow it are updated in parallel on the _update_pool.
+  std::vector<std::vector<entity_component *>> _update_passes;
+  fw::thread_pool *_update_pool;
+
+  // runs at the start of each update to find neighbours and projectile hits
+  broadphase _broadphase;
+
+  // the sum of the state hashes of all our entities (see entity::update_state_hash). This is read by the
+  // simulation_thread, which is why it's atomic.
+  std::atomic<uint64_t> _state_hash;
+
+  // indexes of entities by owner (player_no), template name and order state which are used by find_entities. These
+  // are updated from both the simulation thread (e.g. when an order begins) and the main thread, so they're all
+  // protected by _index_mutex as well.
+  typedef std::unordered_map<entity *, std::weak_ptr<entity>> entity_set;
+  std::mutex _index_mutex;
+  std::unordered_map<int, entity_set> _entities_by_owner;
+  std::unordered_map<std::string, entity_set> _entities_by_template;
+  std::unordered_map<std::string, entity_set> _entities_by_state;
+
+  void update_index(std::unordered_map<int, entity_set> &index, std::shared_ptr<entity> const &ent,
+      int old_key, int new_key);
+  void update_index(std::unordered_map<std::string, entity_set> &index, std::shared_ptr<entity> const &ent,
+      std::string const &old_key, std::string const &new_key);
+
+  // if this is non-empty, we'll dump the state of all entities to this file on the next update()
+  std::mutex _state_dump_mutex;
+  std::string _state_dump_path;
 
   entity_debug *_debug;
   patch_manager *_patch_mgr;
   fw::vector _view_centre;
 
+  // the number of patches in each direction from the view centre that we draw entities from, and how small (relative
+  // to its distance from the camera) an entity can get before we stop drawing it (see scenegraph::is_visible)
+  int _view_distance;
+  float _lod_cull_size;
+
+  // adds the entities that have been created since the last update to the various lists
+  void add_created();
+
   // removes the destroyed entities from the various lists
   void cleanup_destroyed();
 
@@ -56,7 +129,7 @@ public:
   std::weak_ptr<entity> get_entity(fw::vector const &start, fw::vector const &direction);
 
   // gets a reference to a list of all the entities with the component with the given identifier.
-  std::list<std::weak_ptr<entity>> &get_entities_by_component(int identifier);
+  std::vector<std::weak_ptr<entity>> &get_entities_by_component(int identifier);
 
   // gets an entity where the given predicate returns the smallest value. Currently, this
   // method searches ALL entities, but we'll have to provide some way to limit the
@@ -67,10 +140,21 @@ public:
   std::list<std::weak_ptr<entity>> get_entities(std::function<bool(std::shared_ptr<entity> &)> pred);
 
   template<typename TComponent>
-  inline std::list<std::weak_ptr<entity>> &get_entities_by_component() {
+  inline std::vector<std::weak_ptr<entity>> &get_entities_by_component() {
     return get_entities_by_component(TComponent::identifier);
   }
 
+  // finds all the entities that match the given query, in order of their identifier. This uses the owner, template and
+  // state indexes, so it only needs to look at the entities in the smallest matching index. This can be called from
+  // any thread.
+  void find_entities(entity_query const &query, std::vector<std::weak_ptr<entity>> &results);
+
+  // called by the ownable_component and orderable_component to keep the owner and state indexes up-to-date (a
+  // player_no of -1 or a state of "" means the entity's not in the index)
+  void on_owner_changed(std::shared_ptr<entity> const &ent, int old_player_no, int new_player_no);
+  void on_state_changed(std::shared_ptr<entity> const &ent, std::string const &old_state,
+      std::string const &new_state);
+
   // gets the entity that's currently under the cursor (if any)
   std::weak_ptr<entity> get_entity_at_cursor();
 
@@ -86,6 +170,38 @@ public:
     return _selected_entities;
   }
 
+  // gets the number of entities that currently exist, and the time the last update() took to update them all.
+  int get_entity_count() const {
+    return static_cast<int>(_all_entities.size());
+  }
+  float get_update_time() const {
+    return _update_time;
+  }
+  int get_num_update_threads() const;
+  float get_lod_cull_size() const {
+    return _lod_cull_size;
+  }
+
+  broadphase const &get_broadphase() const {
+    return _broadphase;
+  }
+
+  // gets the current state hash, which is a hash of the state of every entity (that we care to keep in sync)
+  uint64_t get_state_hash() const {
+    return _state_hash;
+  }
+  void add_to_state_hash(uint64_t delta) {
+    _state_hash += delta;
+  }
+
+  // writes a snapshot of the state of all the entities to the given stream, in order of their identifiers (so it can
+  // be compared with a snapshot from another peer).
+  void dump_state(std::ostream &out);
+
+  // asks us to dump the state of all the entities to the given file on the next update(). This can be called from
+  // any thread.
+  void request_state_dump(std::string const &path);
+
   // gets a pointer to the entity_debug object which contains debugging state for
   // the entities and so on.
   entity_debug *get_debug() {
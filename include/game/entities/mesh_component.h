@@ -18,6 +18,8 @@ private:
   std::string _model_name;
   std::shared_ptr<fw::model> _model;
 
+  void render_model(fw::sg::scenegraph &scenegraph, fw::matrix const &transform, bool shadow_only);
+
 public:
   static const int identifier = 200;
 
@@ -37,6 +39,16 @@ public:
     return _model_name;
   }
 
+  /**
+   * Gets a bounding sphere around our model when it's rendered with the given transform. Returns false if we don't
+   * know how big it is (e.g. because the model hasn't been loaded yet).
+   */
+  bool get_bounds(fw::matrix const &transform, fw::vector &centre, float &radius);
+
+  /**
+   * Draws our model if it's on screen and not too small to see (see the "lod-cull-size" setting). If it's not, we
+   * only draw it into the shadow map, and only if its shadow might be on screen.
+   */
   virtual void render(fw::sg::scenegraph &scenegraph, fw::matrix const &transform);
 
   virtual int get_identifier() {
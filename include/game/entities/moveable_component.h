@@ -19,6 +19,12 @@ private:
   bool _avoid_collisions;
   bool _is_moving;
 
+  // the update() is done in parallel, so the new position/direction is saved here and applied in commit_update().
+  // That way, all entities see everybody else's position as it was at the start of the update.
+  fw::vector _next_pos;
+  fw::vector _next_dir;
+  bool _has_next;
+
   fw::vector steer(fw::vector pos, fw::vector curr_direction,
       fw::vector goal_direction, float turn_amount, bool show_steering);
 
@@ -36,6 +42,11 @@ public:
   virtual void initialize();
   virtual void update(float dt);
 
+  virtual bool allow_parallel_update() {
+    return true;
+  }
+  virtual void commit_update();
+
   void set_speed(float speed) {
     _speed = speed;
   }
@@ -23,6 +23,8 @@ private:
   bool _order_pending;
   std::queue<std::shared_ptr<game::order>> _orders;
 
+  void update_state_index(std::string const &old_state);
+
 public:
   static const int identifier = 550;
   virtual int get_identifier() {
@@ -46,6 +48,9 @@ public:
   // gets the total number of currently executing + waiting orders.
   int get_order_count() const;
   std::shared_ptr<game::order> get_current_order() const;
+
+  // gets the state name of the current order, or "idle" if we don't have one
+  std::string get_state_name() const;
 };
 
 }
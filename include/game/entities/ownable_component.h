@@ -19,6 +19,7 @@ public:
   }
 
   ownable_component();
+  ownable_component(ownable_component const &copy);
   ~ownable_component();
 
   game::player *get_owner() const {
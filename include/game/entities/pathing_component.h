@@ -1,10 +1,14 @@
 #pragma once
 
+#include <memory>
+#include <vector>
+
 #include <game/entities/entity.h>
 #include <framework/vector.h>
 
 namespace ent {
 class moveable_component;
+class ownable_component;
 class position_component;
 
 // The pathing component is attached to each entity that will follow a path
@@ -15,8 +19,14 @@ private:
   float _last_request_time;
   size_t _curr_goal_node;
   std::vector<fw::vector> _path;
+
+  // The pathing_thread hands us paths on one of its own threads, so we don't touch _path there. Instead, the path is
+  // put in this slot (with std::atomic_store) and we pick it up in update().
+  std::shared_ptr<std::vector<fw::vector>> _found_path;
+
   position_component *_position;
   moveable_component *_moveable;
+  ownable_component *_ownable;
 
   void on_path_found(std::vector<fw::vector> const &path);
 
@@ -32,6 +42,10 @@ public:
   virtual void initialize();
   virtual void update(float dt);
 
+  virtual bool allow_parallel_update() {
+    return true;
+  }
+
   // sets the path that we're to follow until we reach the goal
   void set_path(std::vector<fw::vector> const &path);
 
@@ -1,12 +1,17 @@
 #pragma once
 
+#include <algorithm>
+#include <functional>
 #include <list>
 #include <memory>
+#include <vector>
+#include <boost/foreach.hpp>
 
 #include <framework/vector.h>
 #include <game/entities/entity.h>
 
 namespace ent {
+class position_component;
 
 // this is a "patch" for entities (with positions) exist on. The patches wrap at
 // the edges of the world, just like the terrain does. By having entity patches
@@ -27,8 +32,8 @@ public:
   // removes the given entity from this patch
   void remove_entity(std::weak_ptr<entity> entity);
 
-  // gets a COPY of the entity list (this could be expensive...)
-  std::list<std::weak_ptr<entity>> get_entities() {
+  // gets the list of entities in this patch
+  std::list<std::weak_ptr<entity>> const &get_entities() const {
     return _entities;
   }
 
@@ -38,24 +43,48 @@ public:
 };
 
 // this class belongs to the entity_manager and manages the "patches" which belong
-// to the game itself.
+// to the game itself. It also keeps a finer-grained "spatial index" of all the entities with a
+// position_component, which we use for radius, nearest and ray queries.
 class patch_manager {
 public:
   static const int PATCH_SIZE = 64; // 1/2 of the terrain patch size
+  static const int CELL_SIZE = 4; // size of a cell in the spatial index
 private:
+  friend class position_component;
+  friend class broadphase;
+
   typedef std::vector<patch *> patch_list;
   patch_list _patches;
 
   int _patch_width;
   int _patch_length;
 
+  // the spatial index is a uniform grid of cells, each of which holds the position_components that are inside it.
+  // Like the patches, it wraps at the edges of the world.
+  std::vector<std::vector<position_component *>> _cells;
+  int _cells_wide;
+  int _cells_long;
+
   int get_patch_index(int patch_x, int patch_z, int *new_patch_x = 0,
       int *new_patch_z = 0);
+  int get_cell_index(int cell_x, int cell_z) const;
+
+  // called by the position_component when it moves
+  void update_cell(position_component *pos);
+
+  // visits each position_component in the given cell, calling fn(pos, direction) where direction is the
+  // (wrap-aware) direction from the given point to the position_component.
+  template<typename fn_t>
+  void visit_cell(int cell_index, fw::vector const &from, fn_t &fn) const;
 
 public:
   patch_manager(float size_x, float size_z);
   ~patch_manager();
 
+  // takes the given position_component out of the spatial index, if it's in it. The entity_manager calls this on the
+  // main thread when the entity is destroyed: the component itself might be freed on another thread later.
+  void remove_from_cell(position_component *pos);
+
   // gets the patch at the given (x, z) world-space coordinates
   patch *get_patch(float x, float z);
 
@@ -76,13 +105,33 @@ public:
   float get_world_length() const {
     return static_cast<float>(_patch_length * PATCH_SIZE);
   }
+
+  // gets the direction from one point to another, taking into account the fact that it might be quicker to wrap
+  // around the edges of the map
+  fw::vector get_direction(fw::vector const &from, fw::vector const &to) const;
+
+  // calls fn(position_component *pos, float distance) for each position_component within the given radius of centre
+  template<typename fn_t>
+  void for_each_within_radius(fw::vector const &centre, float radius, fn_t fn) const;
+
+  // gets the position_component closest to centre (but no further than max_distance) for which pred returns true,
+  // or nullptr if there's none.
+  position_component *get_nearest(fw::vector const &centre, float max_distance,
+      std::function<bool(position_component *)> const &pred) const;
+
+  // calls fn(position_component *pos, fw::vector const &pos) for each position_component that's near the given ray
+  // (within one CELL_SIZE of it, in the x/z plane). The position we pass is "unwrapped" so that it's relative to the
+  // ray (which itself may be outside of the world's bounds).
+  template<typename fn_t>
+  void for_each_near_ray(fw::vector const &start, fw::vector const &direction, float length, fn_t fn) const;
 };
 
 // the position component is a member of all entities that have position data (which, actually,
 // is probably most of them!)
 class position_component: public entity_component {
 private:
-  friend class entity_patch;
+  friend class patch_manager;
+  friend class broadphase;
 
   fw::vector _pos;
   fw::vector _dir;
@@ -92,6 +141,18 @@ private:
   bool _orient_to_terrain;
   patch *_patch;
 
+  // our location in the patch_manager's spatial index. _cell_mgr is nullptr if we're not in the index.
+  patch_manager *_cell_mgr;
+  int _cell_index;
+  int _cell_slot;
+
+  // our part of the entity's state hash (see entity::update_state_hash)
+  uint64_t _state_hash;
+
+  // the closest other entity to us, as of the last broadphase update (see broadphase::find_neighbours)
+  position_component *_nearest_neighbour;
+  float _nearest_neighbour_dist_sq;
+
   // if _pos_updated is true, this will calculation "real" position of the
   // entity, taking _sit_on_terrain and _orient_to_terrain into account
   void set_final_position();
@@ -143,13 +204,18 @@ public:
   fw::vector get_direction_to(fw::vector const &point) const;
   fw::vector get_direction_to(std::shared_ptr<entity> entity) const;
 
-  // searches for the nearest entity to us which matches the given predicate
+  // searches for the nearest entity to us (no further than max_distance away) which matches the given predicate
   std::weak_ptr<entity> get_nearest_entity(
-      std::function<bool(std::shared_ptr<entity> const &)> pred) const;
+      std::function<bool(std::shared_ptr<entity> const &)> pred,
+      float max_distance = static_cast<float>(patch_manager::PATCH_SIZE)) const;
 
   // searches for the nearest entity to us
   std::weak_ptr<entity> get_nearest_entity() const;
 
+  // gets the nearest entity to us as of the start of this update, if it's within broadphase::NEIGHBOUR_DISTANCE. This
+  // is much cheaper than get_nearest_entity, since the broadphase finds every entity's neighbour at once.
+  std::weak_ptr<entity> get_nearest_neighbour() const;
+
   // searches for the nearest entity, with the given component type
   std::weak_ptr<entity> get_nearest_entity_with_component(int component_type) const;
 
@@ -162,27 +228,16 @@ public:
   // searches for all the entities within the given radius
   template<typename inserter_t>
   inline void get_entities_within_radius(float radius, inserter_t ins) const {
-    std::shared_ptr<entity> us(_entity);
-
-    std::list<std::weak_ptr<entity>> patch_entities = _patch->get_entities();
-    for (auto it = patch_entities.begin(); it != patch_entities.end(); ++it) {
-      std::shared_ptr<entity> ent = (*it).lock();
-      if (!ent)
-        continue;
+    if (_cell_mgr == nullptr)
+      return;
 
+    position_component const *us = this;
+    _cell_mgr->for_each_within_radius(_pos, radius, [us, &ins](position_component *their_pos, float) {
       // ignore ourselves
-      if (ent == us)
-        continue;
-
-      position_component *their_pos = ent->get_component<position_component>();
-      if (their_pos == 0)
-        continue;
-
-      float dist = get_direction_to(their_pos->get_position()).length();
-      if (dist < radius) {
-        (*ins) = std::weak_ptr<entity>(ent);
+      if (their_pos != us) {
+        (*ins) = their_pos->_entity;
       }
-    }
+    });
   }
 
   virtual int get_identifier() {
@@ -190,4 +245,61 @@ public:
   }
 };
 
+//-------------------------------------------------------------------------
+
+template<typename fn_t>
+inline void patch_manager::visit_cell(int cell_index, fw::vector const &from, fn_t &fn) const {
+  BOOST_FOREACH(position_component *pos, _cells[cell_index]) {
+    fn(pos, get_direction(from, pos->_pos));
+  }
+}
+
+template<typename fn_t>
+inline void patch_manager::for_each_within_radius(fw::vector const &centre, float radius, fn_t fn) const {
+  int min_x = static_cast<int>(floor((centre[0] - radius) / CELL_SIZE));
+  int min_z = static_cast<int>(floor((centre[2] - radius) / CELL_SIZE));
+  int num_x = std::min(static_cast<int>(floor((centre[0] + radius) / CELL_SIZE)) - min_x + 1, _cells_wide);
+  int num_z = std::min(static_cast<int>(floor((centre[2] + radius) / CELL_SIZE)) - min_z + 1, _cells_long);
+
+  float radius_sq = radius * radius;
+  auto visitor = [radius_sq, &fn](position_component *pos, fw::vector const &dir) {
+    float dist_sq = dir[0] * dir[0] + dir[2] * dir[2];
+    if (dist_sq < radius_sq) {
+      fn(pos, sqrt(dist_sq));
+    }
+  };
+  for (int z = 0; z < num_z; z++) {
+    for (int x = 0; x < num_x; x++) {
+      visit_cell(get_cell_index(min_x + x, min_z + z), centre, visitor);
+    }
+  }
+}
+
+template<typename fn_t>
+inline void patch_manager::for_each_near_ray(fw::vector const &start, fw::vector const &direction, float length,
+    fn_t fn) const {
+  // we step along the ray half a cell at a time, and visit the cells around each step that we haven't yet visited
+  std::vector<int> visited;
+  float step = CELL_SIZE * 0.5f;
+  for (float t = 0.0f; t <= length; t += step) {
+    fw::vector pt = start + direction * t;
+    int cell_x = static_cast<int>(floor(pt[0] / CELL_SIZE));
+    int cell_z = static_cast<int>(floor(pt[2] / CELL_SIZE));
+    for (int z = cell_z - 1; z <= cell_z + 1; z++) {
+      for (int x = cell_x - 1; x <= cell_x + 1; x++) {
+        int cell_index = get_cell_index(x, z);
+        if (std::find(visited.begin(), visited.end(), cell_index) != visited.end()) {
+          continue;
+        }
+        visited.push_back(cell_index);
+
+        auto unwrap = [&pt, &fn](position_component *pos, fw::vector const &dir) {
+          fn(pos, fw::vector(pt[0] + dir[0], pos->_pos[1], pt[2] + dir[2]));
+        };
+        visit_cell(cell_index, pt, unwrap);
+      }
+    }
+  }
+}
+
 }
@@ -11,6 +11,14 @@ class moveable_component;
 // This is the base class for "projectile" components which allow an
 // entity to act like a projectile (e.g. ballistic, missile, bullet, etc)
 class projectile_component: public entity_component {
+private:
+  friend class broadphase;
+
+  // the broadphase sweeps us from _last_position to where we are now, and sets _hit to what we hit along the way
+  fw::vector _last_position;
+  bool _has_last_position;
+  std::weak_ptr<entity> _hit;
+
 protected:
   std::weak_ptr<entity> _target;
   position_component *_target_position;
@@ -39,6 +47,11 @@ public:
   virtual int get_identifier() {
     return identifier;
   }
+
+  // the broadphase needs to find all of the projectiles
+  virtual bool allow_get_by_component() {
+    return true;
+  }
 };
 
 // This is a "seeking" projectile component, which "seeks" it target (for example, missiles)
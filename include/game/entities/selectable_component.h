@@ -29,6 +29,7 @@ public:
   static const int identifier = 300;
 
   selectable_component();
+  selectable_component(selectable_component const &copy);
   virtual ~selectable_component();
 
   // this is called after the entity loads all of it's components
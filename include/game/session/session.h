@@ -1,5 +1,6 @@
 #pragma once
 
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <queue>
@@ -33,6 +34,10 @@ private:
   std::string _user_name;
   std::string _error_msg;
 
+  // in loopback mode (see login_loopback) there's no server, all our peers are on this computer.
+  bool _loopback;
+  int _loopback_base_port;
+
   std::mutex _mutex;
 
   // this is called by the login static function. you use that to actually log in
@@ -58,6 +63,11 @@ public:
   // logs you in to the server with the given username and password
   std::shared_ptr<session_request> login(std::string const &username, std::string const &password);
 
+  // logs you in without a server, for running several peers on one computer (e.g. the soak-test). We're logged in
+  // straight away as the given user and confirm_player confirms any other user at once: their player# is their
+  // user_id and they're listening on 127.0.0.1, port base_port + user_id.
+  void login_loopback(uint32_t user_id, int base_port);
+
   // logs you out and "disconnects".
   std::shared_ptr<session_request> logout();
 
@@ -72,8 +82,10 @@ public:
   // take some time) we'll call the given callback with the list
   std::shared_ptr<session_request> get_games_list(std::function<void(std::vector<remote_game> const &)> callback);
 
-  // confirm that the given player has joined this game
-  std::shared_ptr<session_request> confirm_player(uint64_t game_id, uint32_t user_id);
+  // confirm that the given player has joined this game, we call the given handler once they're confirmed. The
+  // handler's set before the request begins, because in loopback mode it can finish on the very next update().
+  std::shared_ptr<session_request> confirm_player(uint64_t game_id, uint32_t user_id,
+      std::function<void(session_request &)> handler);
 
   // gets the current state (if a post is in progress, we'll check if it's finished
   // and parse the response at the same time)
@@ -35,11 +35,10 @@ public:
   };
 
 private:
-  complete_handler_fn _on_complete_handler;
-
   bool parse_response();
 
 protected:
+  complete_handler_fn _on_complete_handler;
   std::shared_ptr<fw::http> _post;
   std::string _error_msg;
   uint64_t _session_id;
@@ -188,7 +187,7 @@ public:
 // the server actually has them registered as a player. it returns the player#
 // and few other details of that player as well...
 class confirm_player_session_request: public session_request {
-private:
+protected:
   uint64_t _game_id;
   uint32_t _other_user_id;
   std::string _other_address;
@@ -224,4 +223,18 @@ public:
   }
 };
 
+// this is what confirm_player gives you when the session is in loopback mode (see session::login_loopback). There's
+// no server to ask, so we confirm the player as soon as the session updates.
+class loopback_confirm_player_session_request: public confirm_player_session_request {
+private:
+  int _base_port;
+
+public:
+  loopback_confirm_player_session_request(uint64_t game_id, uint32_t user_id, int base_port);
+  ~loopback_confirm_player_session_request();
+
+  virtual void begin(std::string base_url);
+  virtual update_result update();
+};
+
 }
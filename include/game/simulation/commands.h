@@ -1,5 +1,6 @@
 #pragma once
 
+#include <functional>
 #include <memory>
 #include <framework/vector.h>
 #include <game/simulation/simulation_thread.h>
@@ -15,6 +16,14 @@ namespace game {
 class player;
 class order;
 
+// this is a helper macro for registering command types with the command_factory. Commands can be registered from
+// outside the game, too (e.g. the soak-test has its own), as long as their identifier doesn't clash.
+#define COMMAND_REGISTER(type) \
+  std::shared_ptr<game::command> create_ ## type (uint8_t player_no) { \
+    return std::shared_ptr<game::command>(new type(player_no)); \
+  } \
+  game::command_registrar reg_ ## type(type::identifier, &create_ ## type)
+
 /**
  * The command is the base class for what the simulation_thread processes. Each turn, we process the commands that
  * have been queued up for that turn. Each "action" in the game is represented by a command.
@@ -119,6 +128,39 @@ public:
   }
 };
 
+/**
+ * This command changes the length of each turn, and how many turns ahead we schedule the commands we post. It's only
+ * posted by the player with the lowest player_no (see simulation_thread::thread_proc), so that everybody ends up with
+ * the same settings. The new settings take effect at the start of switch_turn, on every peer.
+ */
+class turn_settings_command: public command {
+public:
+  uint16_t turn_length;
+  uint8_t command_delay;
+  uint32_t switch_turn;
+
+  turn_settings_command(uint8_t player_no);
+  virtual ~turn_settings_command();
+
+  virtual void serialize(fw::net::packet_buffer &buffer);
+  virtual void deserialize(fw::net::packet_buffer &buffer);
+
+  virtual void execute();
+
+  static const int identifier = 6;
+  virtual uint8_t get_identifier() const {
+    return identifier;
+  }
+};
+
+typedef std::function<std::shared_ptr<command>(uint8_t)> create_command_fn;
+
+// this is a helper class that you use indirectly via the COMMAND_REGISTER macro to register a command.
+class command_registrar {
+public:
+  command_registrar(uint8_t id, create_command_fn fn);
+};
+
 // creates the packet object from the given command identifier
 std::shared_ptr<command> create_command(uint8_t id);
 std::shared_ptr<command> create_command(uint8_t id, uint8_t player_no);
@@ -133,4 +175,9 @@ std::shared_ptr<T> create_command(uint8_t player_no) {
   return std::dynamic_pointer_cast<T>(create_command(T::identifier, player_no));
 }
 
+// reads/writes an entity_id to the given packet_buffer. In the compact encoding, we rotate the player number to the
+// bottom of the identifier so that the varint only needs as many bytes as the player's counter does.
+void write_entity_id(fw::net::packet_buffer &buffer, ent::entity_id id);
+ent::entity_id read_entity_id(fw::net::packet_buffer &buffer);
+
 }
@@ -23,6 +23,7 @@ class join_request_packet: public fw::net::packet {
 private:
   uint32_t _user_id;
   fw::colour _colour;
+  bool _supports_compact;
 
 protected:
   virtual void serialize(fw::net::packet_buffer &buffer);
@@ -48,6 +49,14 @@ public:
     return _colour;
   }
 
+  // gets or sets a flag that indicates whether the connecting player supports the compact encoding
+  void set_supports_compact(bool value) {
+    _supports_compact = value;
+  }
+  bool get_supports_compact() const {
+    return _supports_compact;
+  }
+
   static const int identifier = 1;
   virtual uint16_t get_identifier() const {
     return identifier;
@@ -61,6 +70,7 @@ private:
   std::vector<uint32_t> _other_users;
   fw::colour _my_colour;
   fw::colour _your_colour;
+  bool _use_compact;
 
 protected:
   virtual void serialize(fw::net::packet_buffer &buffer);
@@ -98,6 +108,15 @@ public:
     _your_colour = col;
   }
 
+  // gets or sets a flag that indicates whether we'll use the compact encoding from now on (we only do if both sides
+  // support it)
+  void set_use_compact(bool value) {
+    _use_compact = value;
+  }
+  bool get_use_compact() const {
+    return _use_compact;
+  }
+
   static const int identifier = 2;
   virtual uint16_t get_identifier() const {
     return identifier;
@@ -146,10 +165,11 @@ public:
   }
 };
 
-// this packet is sent at the end of each turn and notifies our peer
-// of our commands that are queued for the next turn
+// this packet is sent at the start of each turn (even if there's no commands) and notifies our peer of the commands
+// we've queued for the given turn. Our peer won't execute that turn until it's got this packet from us.
 class command_packet: public fw::net::packet {
 private:
+  uint32_t _turn;
   std::vector<std::shared_ptr<command> > _commands;
 
 protected:
@@ -167,10 +187,52 @@ public:
     return _commands;
   }
 
+  void set_turn(uint32_t turn) {
+    _turn = turn;
+  }
+  uint32_t get_turn() const {
+    return _turn;
+  }
+
   static const int identifier = 5;
   virtual uint16_t get_identifier() const {
     return identifier;
   }
 };
 
+// this packet is sent every few turns with a hash of the state of our entities, so that our peer can check whether
+// they've gotten out of sync with us
+class state_hash_packet: public fw::net::packet {
+private:
+  uint32_t _turn;
+  uint64_t _state_hash;
+
+protected:
+  virtual void serialize(fw::net::packet_buffer &buffer);
+  virtual void deserialize(fw::net::packet_buffer &buffer);
+
+public:
+  state_hash_packet();
+  virtual ~state_hash_packet();
+
+  void set_turn(uint32_t value) {
+    _turn = value;
+  }
+  uint32_t get_turn() const {
+    return _turn;
+  }
+
+  void set_state_hash(uint64_t value) {
+    _state_hash = value;
+  }
+  uint64_t get_state_hash() const {
+    return _state_hash;
+  }
+
+  static const int identifier = 6;
+  virtual uint16_t get_identifier() const {
+    return identifier;
+  }
+};
+
 }
@@ -47,8 +47,11 @@ public:
   /** This is called just after the world has loaded, we can create our initial entities and stuff. */
   virtual void world_loaded();
 
-  /** Posts the given commands to this player for the next turn. */
-  virtual void post_commands(std::vector<std::shared_ptr<command>> &commands);
+  /** Posts the given commands, which are to be executed on the given turn, to this player. */
+  virtual void post_commands(std::vector<std::shared_ptr<command>> &commands, uint32_t turn);
+
+  /** Sends our state hash for the given turn to this player, so they can check that we're still in sync. */
+  virtual void post_state_hash(uint32_t turn, uint64_t state_hash);
 
   std::string get_user_name() const;
   uint32_t get_user_id() const {
@@ -20,6 +20,14 @@ private:
   fw::net::peer *_peer;
   bool _connected;
 
+  // set when the peer tells us (in their join request) that they support the compact encoding
+  bool _supports_compact;
+
+  // the latest turn we've received this player's commands for. They send us a command_packet every turn (and always
+  // for a later turn than the last one) so we've got all of their commands for every turn up to this one.
+  bool _has_command_turn;
+  uint32_t _command_turn;
+
   /** This is called whenever we receive a packet from our peer. */
   void packet_handler(std::shared_ptr<fw::net::packet> const &pkt);
 
@@ -30,6 +38,7 @@ private:
   void pkt_chat(std::shared_ptr<fw::net::packet> pkt);
   void pkt_start_game(std::shared_ptr<fw::net::packet> pkt);
   void pkt_command(std::shared_ptr<fw::net::packet> pkt);
+  void pkt_state_hash(std::shared_ptr<fw::net::packet> pkt);
 
   // when we get a pkt_join, we ask the server to confirm the user. when the server
   // gets back to us, it'll call this method and we can respond to the original
@@ -56,11 +65,30 @@ public:
   // our peer that we're ready.
   virtual void local_player_is_ready();
 
-  // posts the given commands to this player for the next turn
-  virtual void post_commands(std::vector<std::shared_ptr<command> > &commands);
+  // posts the given commands, which are to be executed on the given turn, to this player
+  virtual void post_commands(std::vector<std::shared_ptr<command> > &commands, uint32_t turn);
+
+  // returns true if we've got all of this player's commands for the given turn, so that it's safe to execute it.
+  // Until their first command_packet arrives (which commits them to the first few turns of the game, see
+  // simulation_thread::start_game) we don't have any of their commands.
+  bool has_commands_for_turn(uint32_t turn) const {
+    return _has_command_turn && _command_turn >= turn;
+  }
+
+  // returns true if we've received this player's commands for a later turn than the given one
+  bool has_commands_after_turn(uint32_t turn) const {
+    return _has_command_turn && _command_turn > turn;
+  }
+
+  // sends our state hash for the given turn to this player
+  virtual void post_state_hash(uint32_t turn, uint64_t state_hash);
 
   virtual void update();
   virtual void send_chat_msg(std::string const &msg);
+
+  // gets the measured round-trip time (and its variance) to this player, in milliseconds
+  int get_round_trip_time() const;
+  int get_round_trip_time_variance() const;
 };
 
 }
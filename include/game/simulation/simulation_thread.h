@@ -1,13 +1,18 @@
 #pragma once
 
+#include <atomic>
 #include <condition_variable>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <thread>
 
 #define BOOST_BIND_NO_PLACEHOLDERS // so it doesn't auto-include _1, _2 etc.
 #include <boost/signals2/signal.hpp>
 
+#include <game/simulation/turn_scheduler.h>
+#include <game/simulation/turn_stats.h>
+
 namespace fw {
 namespace net {
 class host;
@@ -36,6 +41,9 @@ private:
 
   std::thread _thread;
   bool _stopped;
+
+  // turns don't start until the game does (see start_game), before that we just keep our connections up to date
+  std::atomic<bool> _game_started;
   std::condition_variable _stopped_cond;
 
   fw::net::host *_host;
@@ -48,11 +56,42 @@ private:
   typedef std::map<turn_id, std::vector<std::shared_ptr<command>>> command_queue;
   command_queue _commands;
 
+  // the turn we scheduled our last batch of posted commands for, we never schedule a batch for an earlier turn than
+  // this (even if the command delay goes down), so that our peers always get our commands in turn order.
+  turn_id _last_command_turn;
+
+  // decides how long each turn is, and how far ahead the commands we post are scheduled
+  turn_scheduler _turn_scheduler;
+
+  // collects timing and network statistics, which we write to the log every so often
+  turn_stats _turn_stats;
+
+  /**
+   * Every _desync_check_interval turns, we take a hash of the state of the world and send it to the other players.
+   * _state_hashes is our own hash for each of those turns, and _remote_state_hashes are the hashes other players have
+   * sent us that we can't check yet (because we haven't got to that turn ourselves).
+   *
+   * This is off by default: the entities are updated on the main thread each frame, not at turn boundaries, so the
+   * hash we take at a given turn depends on how many frames we've run and two peers won't agree even when they're in
+   * sync. It's still useful for spotting gross desyncs (e.g. a command that only ran on one peer).
+   */
+  struct remote_state_hash {
+    player *plyr;
+    turn_id turn;
+    uint64_t state_hash;
+  };
+  int _desync_check_interval;
+  std::map<turn_id, uint64_t> _state_hashes;
+  std::vector<remote_state_hash> _remote_state_hashes;
+  bool _desync_detected;
+
   /**
    * This is the list of commands that the player posted to us in this turn. At the end of the current turn, we'll
-   * enqueue it to the command queue and also notify other players of it.
+   * enqueue it to the command queue and also notify other players of it. Commands are posted from the main thread
+   * (input, the soak-test) as well as this one, so it's guarded by _posted_commands_mutex.
    */
   std::vector<std::shared_ptr<command>> _posted_commands;
+  std::mutex _posted_commands_mutex;
 
   /**
    * At the end of each turn, this is called to enqueue all the commands that were posted and notify other players
@@ -60,6 +99,39 @@ private:
    */
   void enqueue_posted_commands();
 
+  /** Gets the turn that the commands we post this turn will be executed on. */
+  turn_id get_command_turn() const;
+
+  /**
+   * Called on the first turn of the game. Tells our peers we've got no commands for the turns before our first
+   * command turn, so that they don't wait for us for those turns.
+   */
+  void commit_first_turns();
+
+  /** Adds a remote_player for any new connections the host has detected. */
+  void accept_new_connections();
+
+  /** Returns true if we've got every remote player's commands for the given turn, so we can go ahead and run it. */
+  bool has_all_commands(turn_id turn) const;
+
+  /**
+   * Returns true if a remote player has already posted commands for a later turn than we have, which means they're
+   * further ahead than we are and we should run our turns without waiting.
+   */
+  bool is_behind() const;
+
+  /** Checks whether the turn settings need to change, and if so posts a turn_settings_command. */
+  void update_turn_settings();
+
+  /** If this is a turn where we check for desyncs, records our state hash and sends it to the other players. */
+  void update_state_hash();
+
+  /** Compares the given player's state hash with our own, and reports a desync if they're different. */
+  void compare_state_hash(player *plyr, turn_id turn, uint64_t local_hash, uint64_t remote_hash);
+
+  /** Called when we know we're out of sync with the other players at the given turn. */
+  void on_desync(turn_id turn);
+
   void thread_proc();
 public:
   simulation_thread();
@@ -83,6 +155,12 @@ public:
    */
   void new_game(uint64_t game_id);
 
+  /**
+   * Starts running turns. Call this once the world is loaded: from now on, we don't run a turn until we've got every
+   * remote player's commands for it, and our own commands go out every turn.
+   */
+  void start_game();
+
   void set_map_name(std::string const &value);
   std::string const &get_map_name() const {
     return _map_name;
@@ -114,8 +192,27 @@ public:
     post_command(real_cmd);
   }
 
-  /** Enqueues a command for the next turn. this is called when we receive a command from other players. */
-  void enqueue_command(std::shared_ptr<command> &cmd);
+  /**
+   * Enqueues a command for the given turn. this is called when we receive a command from other players. A command
+   * for a turn we've already run is an error: we report the desync and drop it.
+   */
+  void enqueue_command(std::shared_ptr<command> &cmd, turn_id turn);
+
+  /** Called by the turn_settings_command to change the turn length and command delay, starting at switch_turn. */
+  void set_turn_settings(int turn_length, int command_delay, turn_id switch_turn) {
+    _turn_scheduler.set_settings(turn_length, command_delay, switch_turn);
+  }
+
+  /**
+   * Called when another player sends us their state hash for the given turn. If we've already got to that turn
+   * we'll compare it with our own hash straight away, otherwise we'll hang on to it until we get there.
+   */
+  void check_state_hash(player *plyr, turn_id turn, uint64_t state_hash);
+
+  /** Gets the turn_scheduler, which has the current turn settings and measured latency. */
+  turn_scheduler const &get_turn_scheduler() const {
+    return _turn_scheduler;
+  }
 
   /** Adds a new AI player to the list of players. */
   void add_ai_player(ai_player *plyr);
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace game {
+class player;
+
+/**
+ * The turn_scheduler decides how long each turn is, and how many turns in the future the commands we post are
+ * scheduled for (the "command delay"). On a LAN we can have short turns and execute commands almost immediately,
+ * but over a slow or jittery link we need to give commands more time to reach our peers before they're executed.
+ *
+ * Every so often, we look at the round-trip time to each of our peers (ENet measures this from the acknowledgements
+ * of the reliable packets we send, which includes all our commands) and work out what the turn settings should be.
+ * The settings themselves only change when a turn_settings_command is executed, so that all peers agree on them, and
+ * then only at the start of the turn the command says to switch on.
+ */
+class turn_scheduler {
+public:
+  static const int MIN_TURN_LENGTH = 50; // ms
+  static const int MAX_TURN_LENGTH = 200; // ms
+  static const int MAX_COMMAND_DELAY = 8; // turns
+  static const int CHECK_INTERVAL = 10; // turns
+
+private:
+  int _turn_length;
+  int _command_delay;
+  int _measured_latency;
+  int _measured_jitter;
+  int _turns_until_check;
+
+  // the settings from the last turn_settings_command, which we switch to at the start of _pending_switch_turn. We check
+  // the latency less often than the longest command delay, so there's only ever one of these waiting.
+  bool _has_pending;
+  int _pending_turn_length;
+  int _pending_command_delay;
+  uint32_t _pending_switch_turn;
+
+public:
+  turn_scheduler();
+
+  /**
+   * Called at the start of each turn with the current players. Every CHECK_INTERVAL turns, we measure the latency to
+   * each remote player and if the settings we'd choose are different to the current ones, we return true and
+   * populate new_turn_length and new_command_delay (the caller should post a turn_settings_command with them).
+   */
+  bool update(std::vector<player *> const &players, int &new_turn_length, int &new_command_delay);
+
+  /** Called when a turn_settings_command is executed, to change the settings at the start of the given turn. */
+  void set_settings(int turn_length, int command_delay, uint32_t switch_turn);
+
+  /** Called at the start of each turn, switches to the new settings if this is the turn they're due. */
+  void start_turn(uint32_t turn);
+
+  int get_turn_length() const {
+    return _turn_length;
+  }
+  int get_command_delay() const {
+    return _command_delay;
+  }
+
+  /** Gets the highest round-trip time (and its variance) to any of our peers, as of the last check. */
+  int get_measured_latency() const {
+    return _measured_latency;
+  }
+  int get_measured_jitter() const {
+    return _measured_jitter;
+  }
+};
+
+}
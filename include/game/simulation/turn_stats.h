@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace fw {
+namespace net {
+class host;
+}
+}
+
+namespace game {
+
+/**
+ * Collects statistics about how long each turn of the simulation takes, how much data we send and receive and how
+ * long we spend executing commands. Every so often (see the "turn-stats-interval" setting) we write a summary to the
+ * log, so that changes to the networking and simulation code can be compared against a baseline.
+ */
+class turn_stats {
+private:
+  int _report_interval;
+
+  // the time spent processing each turn, and the time between the start of each turn and the next (which should
+  // be close to the turn length, unless we're falling behind)
+  std::vector<float> _turn_times;
+  std::vector<float> _turn_periods;
+
+  float _execute_time;
+  int _num_commands;
+  int _num_stalls;
+  uint64_t _bytes_sent;
+  uint64_t _bytes_received;
+
+  float get_percentile(std::vector<float> &samples, float percentile);
+  void report(uint32_t turn, fw::net::host *host);
+
+public:
+  turn_stats();
+
+  void set_report_interval(int turns) {
+    _report_interval = turns;
+  }
+
+  /** Records the time we spent executing the given number of commands this turn. */
+  void add_execute_time(float ms, int num_commands);
+
+  /** Called each time we have to wait (for about a millisecond) because a peer's commands haven't arrived yet. */
+  void add_stall() {
+    _num_stalls++;
+  }
+
+  /**
+   * Called at the end of each turn with the time spent processing it, and the time since the start of the previous
+   * turn. When we've got _report_interval turns worth of stats, we write them to the log and start again.
+   */
+  void end_turn(uint32_t turn, float turn_time, float turn_period, fw::net::host *host);
+};
+
+}
@@ -29,6 +29,14 @@ struct terrain_patch {
   std::shared_ptr<fw::vertex_buffer> vb;
   std::shared_ptr<fw::texture> texture;
   std::shared_ptr<fw::shader_parameters> shader_params;
+
+  // the range of heights in this patch, so we know how big its bounding sphere is
+  float min_height;
+  float max_height;
+
+  terrain_patch() :
+      min_height(0.0f), max_height(0.0f) {
+  }
 };
 
 class terrain {
@@ -40,6 +48,9 @@ private:
   std::shared_ptr<fw::index_buffer> _ib;
   std::shared_ptr<fw::shader> _shader;
 
+  // the number of patches in each direction from the centre of the view that we'll draw (if they're on screen)
+  int _view_distance;
+
 protected:
   friend class ed::world_writer;
   friend class world_reader;
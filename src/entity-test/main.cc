@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <map>
+#include <random>
+#include <vector>
+
+#include <boost/exception/all.hpp>
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+
+#include <framework/camera.h>
+#include <framework/framework.h>
+#include <framework/logging.h>
+#include <framework/settings.h>
+#include <framework/timer.h>
+
+#include <game/ai/pathing_thread.h>
+#include <game/editor/editor_world.h>
+#include <game/entities/entity.h>
+#include <game/entities/entity_manager.h>
+#include <game/entities/moveable_component.h>
+#include <game/entities/ownable_component.h>
+#include <game/entities/pathing_component.h>
+#include <game/entities/position_component.h>
+#include <game/entities/selectable_component.h>
+#include <game/simulation/commands.h>
+#include <game/simulation/orders.h>
+#include <game/world/world.h>
+
+namespace po = boost::program_options;
+
+namespace game {
+void settings_initialize(int argc, char** argv, po::options_description const &extra_options,
+    std::string const &config_file);
+}
+
+void settings_initialize(int argc, char** argv);
+
+typedef std::chrono::duration<double, std::milli> milliseconds;
+
+/**
+ * Creates a world full of entities and then, each frame, executes a batch of move orders (the same way the
+ * simulation_thread executes each turn's commands) and updates the world. After the given number of frames, we log
+ * how long the commands and the entity updates took and exit.
+ */
+class application: public fw::base_app {
+private:
+  game::world *_world;
+  std::mt19937 _rng;
+  int _world_size;
+  int _num_entities;
+  int _num_frames;
+  int _commands_per_frame;
+  int _frame_no;
+
+  double _total_command_ms;
+  double _max_command_ms;
+  double _total_update_ms;
+  double _max_update_ms;
+
+  fw::vector get_random_location();
+  void execute_commands();
+  void run_lookup_benchmark(std::vector<std::shared_ptr<ent::entity>> const &entities, int repeats);
+
+public:
+  application();
+  bool initialize(fw::framework *frmwrk);
+  void destroy();
+  void update(float dt);
+};
+
+application::application() :
+    _world(nullptr), _world_size(0), _num_entities(0), _num_frames(0), _commands_per_frame(0), _frame_no(0),
+    _total_command_ms(0.0), _max_command_ms(0.0), _total_update_ms(0.0), _max_update_ms(0.0) {
+}
+
+bool application::initialize(fw::framework *frmwrk) {
+  fw::top_down_camera *cam = new fw::top_down_camera();
+  cam->set_mouse_move(false);
+  frmwrk->set_camera(cam);
+
+  fw::settings stg;
+  _rng.seed(stg.get_value<int>("seed"));
+  _world_size = stg.get_value<int>("world-size");
+  _num_entities = stg.get_value<int>("entity-count");
+  _num_frames = stg.get_value<int>("frames");
+  _commands_per_frame = stg.get_value<int>("commands-per-frame");
+
+  // a flat, empty world, just like the editor's "new map"
+  std::shared_ptr<ed::world_create> creator(new ed::world_create(_world_size, _world_size));
+  _world = new game::world(creator);
+  _world->initialize();
+
+  std::string template_name = stg.get_value<std::string>("template");
+  ent::entity_manager *ent_mgr = _world->get_entity_manager();
+  std::vector<std::shared_ptr<ent::entity>> entities;
+  fw::chrono_clock::time_point start = fw::chrono_clock::now();
+  for (int i = 0; i < _num_entities; i++) {
+    std::shared_ptr<ent::entity> ent = ent_mgr->create_entity(template_name, static_cast<ent::entity_id>(i + 1));
+    ent::position_component *position = ent->get_component<ent::position_component>();
+    if (position != nullptr) {
+      position->set_position(get_random_location());
+    }
+    entities.push_back(ent);
+  }
+  double create_ms = std::chrono::duration_cast<milliseconds>(fw::chrono_clock::now() - start).count();
+  fw::debug << boost::format("created %1% \"%2%\" entities in %3$.1fms") % _num_entities % template_name % create_ms
+      << std::endl;
+
+  int lookup_repeats = stg.get_value<int>("lookup-repeats");
+  if (lookup_repeats > 0) {
+    run_lookup_benchmark(entities, lookup_repeats);
+  }
+  return true;
+}
+
+// the entities used to keep their components in a map keyed by identifier, and get_component<T>() did a find and a
+// dynamic_cast. This is that lookup, so we can compare it with the slot table.
+class component_map {
+private:
+  std::map<int, ent::entity_component *> _components;
+
+public:
+  component_map(std::shared_ptr<ent::entity> const &ent) {
+    for (int slot = 0; slot < ent::MAX_COMPONENT_SLOTS; slot++) {
+      int identifier = slot * ent::COMPONENT_IDENTIFIER_STEP;
+      ent::entity_component *comp = ent->get_component(identifier);
+      if (comp != nullptr) {
+        _components[identifier] = comp;
+      }
+    }
+  }
+
+  template<class T>
+  T *get_component() {
+    auto it = _components.find(T::identifier);
+    if (it == _components.end()) {
+      return nullptr;
+    }
+    return dynamic_cast<T *>(it->second);
+  }
+};
+
+// the components that an entity's update usually looks up (each of these is looked up once per entity)
+template<class T>
+int count_components(T &ent) {
+  int count = 0;
+  count += (ent.template get_component<ent::position_component>() != nullptr) ? 1 : 0;
+  count += (ent.template get_component<ent::moveable_component>() != nullptr) ? 1 : 0;
+  count += (ent.template get_component<ent::pathing_component>() != nullptr) ? 1 : 0;
+  count += (ent.template get_component<ent::selectable_component>() != nullptr) ? 1 : 0;
+  count += (ent.template get_component<ent::ownable_component>() != nullptr) ? 1 : 0;
+  return count;
+}
+static const int LOOKUPS_PER_ENTITY = 5;
+
+// times looking up components through the entity's slot table against looking them up in a map
+void application::run_lookup_benchmark(std::vector<std::shared_ptr<ent::entity>> const &entities, int repeats) {
+  std::vector<component_map> maps;
+  for (std::shared_ptr<ent::entity> const &ent : entities) {
+    maps.push_back(component_map(ent));
+  }
+
+  int table_found = 0;
+  fw::chrono_clock::time_point start = fw::chrono_clock::now();
+  for (int i = 0; i < repeats; i++) {
+    for (std::shared_ptr<ent::entity> const &ent : entities) {
+      table_found += count_components(*ent);
+    }
+  }
+  double table_ms = std::chrono::duration_cast<milliseconds>(fw::chrono_clock::now() - start).count();
+
+  int map_found = 0;
+  start = fw::chrono_clock::now();
+  for (int i = 0; i < repeats; i++) {
+    for (component_map &map : maps) {
+      map_found += count_components(map);
+    }
+  }
+  double map_ms = std::chrono::duration_cast<milliseconds>(fw::chrono_clock::now() - start).count();
+
+  double num_lookups = static_cast<double>(entities.size()) * repeats * LOOKUPS_PER_ENTITY;
+  fw::debug << boost::format("component lookups: %1% entities, %2% times") % entities.size() % repeats << std::endl;
+  fw::debug << boost::format("  slot table: %1$.2fns/lookup (%2% found)")
+      % ((table_ms * 1000000.0) / num_lookups) % table_found << std::endl;
+  fw::debug << boost::format("  map: %1$.2fns/lookup (%2% found)")
+      % ((map_ms * 1000000.0) / num_lookups) % map_found << std::endl;
+}
+
+void application::destroy() {
+  if (_world != nullptr) {
+    _world->destroy();
+    delete _world;
+    _world = nullptr;
+  }
+}
+
+fw::vector application::get_random_location() {
+  return fw::vector(static_cast<float>(_rng() % _world_size), 0.0f, static_cast<float>(_rng() % _world_size));
+}
+
+// gives a batch of randomly-chosen entities a move order to a random location
+void application::execute_commands() {
+  game::pathing_thread *pathing = _world->get_pathing();
+  pathing->begin_batch();
+  for (int i = 0; i < _commands_per_frame; i++) {
+    std::shared_ptr<game::move_order> order(new game::move_order());
+    order->goal = get_random_location();
+
+    std::shared_ptr<game::order_command> cmd(game::create_command<game::order_command>(0));
+    cmd->entity = static_cast<ent::entity_id>(1 + (_rng() % _num_entities));
+    cmd->order = order;
+    cmd->execute();
+  }
+  pathing->end_batch();
+}
+
+void application::update(float dt) {
+  // the first frame includes loading everything, so we don't count it
+  if (_frame_no > 0) {
+    fw::chrono_clock::time_point start = fw::chrono_clock::now();
+    execute_commands();
+    double command_ms = std::chrono::duration_cast<milliseconds>(fw::chrono_clock::now() - start).count();
+    _total_command_ms += command_ms;
+    _max_command_ms = std::max(_max_command_ms, command_ms);
+  }
+
+  _world->update();
+  if (_frame_no > 0) {
+    double update_ms = _world->get_entity_manager()->get_update_time() * 1000.0;
+    _total_update_ms += update_ms;
+    _max_update_ms = std::max(_max_update_ms, update_ms);
+  }
+
+  _frame_no++;
+  if (_frame_no > _num_frames) {
+    fw::debug << boost::format("%1% entities, %2% frames (%3% update threads)")
+        % _world->get_entity_manager()->get_entity_count() % _num_frames
+        % _world->get_entity_manager()->get_num_update_threads() << std::endl;
+    fw::debug << boost::format("  commands: %1% per frame, %2$.3fms/frame, %3$.3fms max, %4$.2fus/command")
+        % _commands_per_frame % (_total_command_ms / _num_frames) % _max_command_ms
+        % (_commands_per_frame > 0 ? (_total_command_ms * 1000.0) / (_num_frames * _commands_per_frame) : 0.0)
+        << std::endl;
+    fw::debug << boost::format("  update: %1$.3fms/frame, %2$.3fms max, %3$.3fus/entity")
+        % (_total_update_ms / _num_frames) % _max_update_ms
+        % (_num_entities > 0 ? (_total_update_ms * 1000.0) / (_num_frames * _num_entities) : 0.0) << std::endl;
+    fw::framework::get_instance()->exit();
+  }
+}
+
+int main(int argc, char** argv) {
+  try {
+    settings_initialize(argc, argv);
+
+    fw::settings stg;
+    if (stg.is_set("help")) {
+      stg.print_help();
+      return 0;
+    }
+
+    application app;
+    new fw::framework(&app);
+    fw::framework::get_instance()->initialize("Entity Test");
+    fw::framework::get_instance()->run();
+  } catch(std::exception &e) {
+    std::string msg = boost::diagnostic_information(e);
+    fw::debug << "--------------------------------------------------------------------------------" << std::endl;
+    fw::debug << "UNHANDLED EXCEPTION!" << std::endl;
+    fw::debug << msg << std::endl;
+    return 1;
+  } catch (...) {
+    fw::debug << "--------------------------------------------------------------------------------" << std::endl;
+    fw::debug << "UNHANDLED EXCEPTION! (unknown exception)" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+void settings_initialize(int argc, char** argv) {
+  po::options_description options("Entity test options");
+  options.add_options()
+      ("world-size", po::value<int>()->default_value(256), "The width and length of the (flat) world we create.")
+      ("entity-count", po::value<int>()->default_value(10000), "The number of entities to create.")
+      ("template", po::value<std::string>()->default_value("factory"), "The template to create the entities from. Use a unit that can move, so the move orders have something to do.")
+      ("frames", po::value<int>()->default_value(200), "The number of frames to time before we exit.")
+      ("commands-per-frame", po::value<int>()->default_value(100), "The number of move orders we execute each frame.")
+      ("lookup-repeats", po::value<int>()->default_value(100), "The number of times to look up each entity's components in the component lookup benchmark (0 to skip it).")
+      ("seed", po::value<int>()->default_value(1), "The seed for the random number generator, so runs are reproducible.")
+    ;
+
+  game::settings_initialize(argc, argv, options, "entity-test.conf");
+}
@@ -2,6 +2,7 @@
 #include <boost/format.hpp>
 
 #include <framework/debug_view.h>
+#include <framework/frame_arena.h>
 #include <framework/framework.h>
 #include <framework/gui/builder.h>
 #include <framework/gui/gui.h>
@@ -18,6 +19,10 @@ using namespace gui;
 enum ids {
   FPS_ID = 308724,
   PARTICLES_ID,
+  DRAWS_ID,
+  NODES_ID,
+  FRAME_ARENA_ID,
+  CULLING_ID,
 };
 
 debug_view::debug_view() : _wnd(nullptr), _time_to_update(9999.9f) {
@@ -31,9 +36,13 @@ void debug_view::initialize() {
   if (stg.is_set("debug-view")) {
     _time_to_update = 1.0f;
 
-    _wnd = builder<window>(sum(pct(100), px(-200)), sum(pct(100), px(-50)), px(190), px(40))
+    _wnd = builder<window>(sum(pct(100), px(-200)), sum(pct(100), px(-130)), px(190), px(120))
       << (builder<label>(px(0), px(0), px(190), px(20)) << label::text_align(label::alignment::right) << widget::id(FPS_ID))
-      << (builder<label>(px(0), px(20), px(190), px(20)) << label::text_align(label::alignment::right) << widget::id(PARTICLES_ID));
+      << (builder<label>(px(0), px(20), px(190), px(20)) << label::text_align(label::alignment::right) << widget::id(PARTICLES_ID))
+      << (builder<label>(px(0), px(40), px(190), px(20)) << label::text_align(label::alignment::right) << widget::id(DRAWS_ID))
+      << (builder<label>(px(0), px(60), px(190), px(20)) << label::text_align(label::alignment::right) << widget::id(NODES_ID))
+      << (builder<label>(px(0), px(80), px(190), px(20)) << label::text_align(label::alignment::right) << widget::id(FRAME_ARENA_ID))
+      << (builder<label>(px(0), px(100), px(190), px(20)) << label::text_align(label::alignment::right) << widget::id(CULLING_ID));
     framework::get_instance()->get_gui()->attach_widget(_wnd);
   }
 }
@@ -59,6 +68,24 @@ void debug_view::update(float dt) {
     label *particles = _wnd->find<label>(PARTICLES_ID);
     particles->set_text((boost::format("%1% particles") % frmwrk->get_particle_mgr()->get_num_active_particles()).str());
 
+    label *draws = _wnd->find<label>(DRAWS_ID);
+    draws->set_text((boost::format("%1% draw calls, %2% items")
+        % frmwrk->get_last_frame_draw_calls() % frmwrk->get_last_frame_draw_items()).str());
+
+    // "nodes" are the scenegraph nodes that still have to be flattened into draw items each frame
+    label *nodes = _wnd->find<label>(NODES_ID);
+    nodes->set_text((boost::format("%1% nodes") % frmwrk->get_last_frame_nodes()).str());
+
+    frame_arena &arena = frmwrk->get_frame_arena();
+    label *frame_arena = _wnd->find<label>(FRAME_ARENA_ID);
+    frame_arena->set_text((boost::format("%1% KB/frame in %2% allocs")
+        % (arena.get_last_frame_bytes() / 1024) % arena.get_last_frame_allocations()).str());
+
+    // objects are things like terrain patches and entities that were checked against the view frustum
+    label *culling = _wnd->find<label>(CULLING_ID);
+    culling->set_text((boost::format("%1% objects, %2% culled")
+        % frmwrk->get_last_frame_visible_objects() % frmwrk->get_last_frame_culled_objects()).str());
+
     _time_to_update = 1.0f;
   }
 }
@@ -0,0 +1,65 @@
+#include <algorithm>
+
+#include <framework/frame_arena.h>
+
+namespace fw {
+
+const std::size_t frame_arena::CHUNK_SIZE;
+
+frame_arena::frame_arena() :
+    _curr_chunk(0), _offset(0), _num_allocations(0), _bytes_allocated(0), _last_frame_allocations(0),
+    _last_frame_bytes(0) {
+}
+
+frame_arena::~frame_arena() {
+  for (auto it = _chunks.begin(); it != _chunks.end(); ++it) {
+    delete[] it->data;
+  }
+}
+
+void *frame_arena::allocate(std::size_t size, std::size_t alignment) {
+  _num_allocations++;
+  _bytes_allocated += size;
+
+  while (true) {
+    if (_curr_chunk == _chunks.size()) {
+      // we've run out of chunks, so allocate a new one. If this allocation is bigger than a whole chunk, we make the
+      // new chunk big enough to hold it.
+      chunk new_chunk;
+      new_chunk.size = std::max(CHUNK_SIZE, size + alignment);
+      new_chunk.data = new char[new_chunk.size];
+      _chunks.push_back(new_chunk);
+    }
+
+    chunk &curr = _chunks[_curr_chunk];
+    uintptr_t base = reinterpret_cast<uintptr_t>(curr.data);
+    std::size_t offset = ((base + _offset + alignment - 1) & ~(alignment - 1)) - base;
+    if (offset + size <= curr.size) {
+      _offset = offset + size;
+      return curr.data + offset;
+    }
+
+    // doesn't fit in this chunk, move on to the next one
+    _curr_chunk++;
+    _offset = 0;
+  }
+}
+
+void frame_arena::reset() {
+  _last_frame_allocations = _num_allocations;
+  _last_frame_bytes = _bytes_allocated;
+  _num_allocations = 0;
+  _bytes_allocated = 0;
+  _curr_chunk = 0;
+  _offset = 0;
+}
+
+std::size_t frame_arena::get_capacity() const {
+  std::size_t capacity = 0;
+  for (auto it = _chunks.begin(); it != _chunks.end(); ++it) {
+    capacity += it->size;
+  }
+  return capacity;
+}
+
+}
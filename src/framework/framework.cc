@@ -19,6 +19,7 @@
 #include <framework/cursor.h>
 #include <framework/debug_view.h>
 #include <framework/font.h>
+#include <framework/frame_arena.h>
 #include <framework/particle_manager.h>
 #include <framework/model_manager.h>
 #include <framework/scenegraph.h>
@@ -48,7 +49,8 @@ framework::framework(base_app* app) :
     _app(app), _active(true), _camera(nullptr), _paused(false), _particle_mgr(nullptr),
     _graphics(nullptr), _timer(nullptr), _audio_manager(nullptr), _input(nullptr), _lang(nullptr),
     _gui(nullptr), _font_manager(nullptr), _model_manager(nullptr), _cursor(nullptr),
-    _debug_view(nullptr), _running(true) {
+    _debug_view(nullptr), _frame_arena(new frame_arena()), _running(true), _last_frame_draw_items(0),
+    _last_frame_draw_calls(0), _last_frame_nodes(0), _last_frame_visible_objects(0), _last_frame_culled_objects(0) {
   only_instance = this;
 }
 
@@ -75,6 +77,7 @@ framework::~framework() {
     delete _debug_view;
   if (_audio_manager != nullptr)
     delete _audio_manager;
+  delete _frame_arena;
 }
 
 framework *framework::get_instance() {
@@ -305,12 +308,20 @@ void framework::render() {
 
   _timer->render();
 
+  // everything that was allocated for the last frame's scenegraph is gone now
+  _frame_arena->reset();
+
   // populate the scene graph by calling into the application itself
-  sg::scenegraph scenegraph;
+  sg::scenegraph scenegraph(*_frame_arena);
   _app->render(scenegraph);
   _particle_mgr->render(scenegraph);
 
   fw::render(scenegraph);
+  _last_frame_draw_items = scenegraph.get_num_draw_items();
+  _last_frame_draw_calls = scenegraph.get_num_draw_calls();
+  _last_frame_nodes = scenegraph.get_num_nodes();
+  _last_frame_visible_objects = scenegraph.get_num_visible_objects();
+  _last_frame_culled_objects = scenegraph.get_num_culled_objects();
 
   // if we've been asked for some screenshots, take them after we've done the normal render.
   if (_screenshots.size() > 0)
@@ -0,0 +1,49 @@
+#include <framework/frustum.h>
+
+namespace fw {
+
+frustum::frustum() {
+  for (int i = 0; i < 6; i++) {
+    _planes[i] = cml::vector4f(0.0f, 0.0f, 0.0f, 0.0f);
+  }
+}
+
+frustum::frustum(matrix const &viewproj) {
+  set_matrix(viewproj);
+}
+
+void frustum::set_matrix(matrix const &viewproj) {
+  // our matrices transform row vectors, so clip-space x, y, z and w are the dot product of the point with each column
+  // of the matrix. A point is inside when -w <= x,y,z <= w, which gives us a plane for each side.
+  cml::vector4f columns[4];
+  for (int col = 0; col < 4; col++) {
+    columns[col] = cml::vector4f(viewproj(0, col), viewproj(1, col), viewproj(2, col), viewproj(3, col));
+  }
+
+  _planes[0] = columns[3] + columns[0];
+  _planes[1] = columns[3] - columns[0];
+  _planes[2] = columns[3] + columns[1];
+  _planes[3] = columns[3] - columns[1];
+  _planes[4] = columns[3] + columns[2];
+  _planes[5] = columns[3] - columns[2];
+
+  for (int i = 0; i < 6; i++) {
+    float length = vector(_planes[i][0], _planes[i][1], _planes[i][2]).length();
+    if (length > 0.0f) {
+      _planes[i] /= length;
+    }
+  }
+}
+
+bool frustum::intersects_sphere(vector const &centre, float radius) const {
+  for (int i = 0; i < 6; i++) {
+    cml::vector4f const &plane = _planes[i];
+    float distance = plane[0] * centre[0] + plane[1] * centre[1] + plane[2] * centre[2] + plane[3];
+    if (distance < -radius) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}
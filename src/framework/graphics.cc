@@ -48,7 +48,7 @@ void graphics::initialize(char const *title) {
       << std::endl;
 
   SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-  SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
   SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
   SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
 
@@ -369,5 +369,28 @@ std::function<void()> xyz_n::get_setup_function() {
   return &xyz_n_setup;
 }
 
+void instance_setup() {
+  for (int i = 0; i < 4; i++) {
+    FW_CHECKED(glEnableVertexAttribArray(3 + i));
+    FW_CHECKED(glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(fw::vertex::instance),
+        reinterpret_cast<void const *>(offsetof(instance, world) + (i * 4 * sizeof(float)))));
+    FW_CHECKED(glVertexAttribDivisor(3 + i, 1));
+  }
+  FW_CHECKED(glEnableVertexAttribArray(7));
+  FW_CHECKED(glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(fw::vertex::instance), OFFSET_OF(instance, r)));
+  FW_CHECKED(glVertexAttribDivisor(7, 1));
+}
+
+std::function<void()> instance::get_setup_function() {
+  return &instance_setup;
+}
+
+void instance::cleanup() {
+  for (int i = 3; i <= 7; i++) {
+    FW_CHECKED(glVertexAttribDivisor(i, 0));
+    FW_CHECKED(glDisableVertexAttribArray(i));
+  }
+}
+
 }
 }
@@ -0,0 +1,439 @@
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <boost/foreach.hpp>
+#include <boost/format.hpp>
+
+#include <framework/hierarchical_path_find.h>
+#include <framework/logging.h>
+#include <framework/misc.h>
+#include <framework/timer.h>
+
+namespace fw {
+
+// runs of passable cells along a border that are shorter than this get a single entrance in the middle, longer runs
+// get one entrance at each end.
+static const int MAX_SINGLE_ENTRANCE_LENGTH = 6;
+
+hierarchical_path_find::hierarchical_path_find(int width, int length, std::vector<bool> const &passability) :
+    path_find(width, length, passability), _any_dirty(true) {
+  _sectors_wide = (width + SECTOR_SIZE - 1) / SECTOR_SIZE;
+  _sectors_long = (length + SECTOR_SIZE - 1) / SECTOR_SIZE;
+  _sectors.resize(_sectors_wide * _sectors_long);
+  BOOST_FOREACH(sector &sec, _sectors) {
+    sec.dirty = true;
+  }
+
+  fw::timer tmr;
+  tmr.start();
+  rebuild_dirty_sectors();
+  tmr.stop();
+
+  int num_entrances = 0;
+  BOOST_FOREACH(sector &sec, _sectors) {
+    num_entrances += sec.nodes.size();
+  }
+  fw::debug << boost::format("hierarchical_path_find: built %1% sectors with %2% entrances in %3%ms")
+      % _sectors.size() % num_entrances % (tmr.get_total_time() * 1000.0f) << std::endl;
+}
+
+hierarchical_path_find::~hierarchical_path_find() {
+}
+
+fw::vector hierarchical_path_find::get_cell_loc(int cell) const {
+  return fw::vector(static_cast<float>(cell % get_width()), 0.0f, static_cast<float>(cell / get_width()));
+}
+
+int hierarchical_path_find::get_sector_index(int cell) const {
+  int x = cell % get_width();
+  int z = cell / get_width();
+  return (z / SECTOR_SIZE) * _sectors_wide + (x / SECTOR_SIZE);
+}
+
+path_find::region hierarchical_path_find::get_sector_region(int sector_index) const {
+  int sector_x = sector_index % _sectors_wide;
+  int sector_z = sector_index / _sectors_wide;
+
+  region rgn;
+  rgn.x = sector_x * SECTOR_SIZE;
+  rgn.z = sector_z * SECTOR_SIZE;
+  rgn.width = fw::min(SECTOR_SIZE, get_width() - rgn.x);
+  rgn.length = fw::min(SECTOR_SIZE, get_length() - rgn.z);
+  return rgn;
+}
+
+hierarchical_path_find::abstract_node *hierarchical_path_find::find_abstract_node(int sector_index, int cell) {
+  BOOST_FOREACH(abstract_node &node, _sectors[sector_index].nodes) {
+    if (node.cell == cell) {
+      return &node;
+    }
+  }
+  return nullptr;
+}
+
+void hierarchical_path_find::add_entrance(sector &sec, int cell, int other_cell) {
+  abstract_edge edge;
+  edge.cell = other_cell;
+  edge.cost = 1.0f;
+
+  // a cell in the corner of a sector can be an entrance on two borders, so we only want one node for it
+  BOOST_FOREACH(abstract_node &node, sec.nodes) {
+    if (node.cell == cell) {
+      node.edges.push_back(edge);
+      return;
+    }
+  }
+
+  abstract_node node;
+  node.cell = cell;
+  node.edges.push_back(edge);
+  sec.nodes.push_back(node);
+}
+
+/**
+ * Finds the entrances along the border between sector_a and sector_b. If 'vertical' is true, sector_b is to the right
+ * of sector_a, otherwise it's below it. Each entrance is a pair of (cell in sector_a, cell in sector_b). Both sectors
+ * call this with the same arguments, so they always agree on where the entrances are.
+ */
+void hierarchical_path_find::find_border_entrances(int sector_a, int sector_b, bool vertical,
+    std::vector<std::pair<int, int>> &entrances) {
+  region rgn = get_sector_region(sector_a);
+  int border_length = vertical ? rgn.length : rgn.width;
+
+  // the row/column of cells on sector_a's side of the border, and the one on sector_b's side. We take sector_b's
+  // side from its own region, so that the cells we pair up really are in the neighbouring sector (even when the
+  // border is the edge of the map and we wrap around).
+  region rgn_b = get_sector_region(sector_b);
+  int ax = rgn.x + rgn.width - 1;
+  int az = rgn.z + rgn.length - 1;
+  int bx = rgn_b.x;
+  int bz = rgn_b.z;
+
+  int run_start = -1;
+  for (int i = 0; i <= border_length; i++) {
+    bool passable = false;
+    if (i < border_length) {
+      if (vertical) {
+        passable = is_cell_passable(ax, rgn.z + i) && is_cell_passable(bx, rgn.z + i);
+      } else {
+        passable = is_cell_passable(rgn.x + i, az) && is_cell_passable(rgn.x + i, bz);
+      }
+    }
+
+    if (passable && run_start < 0) {
+      run_start = i;
+    } else if (!passable && run_start >= 0) {
+      int run_length = i - run_start;
+      int offsets[2];
+      int num_offsets;
+      if (run_length < MAX_SINGLE_ENTRANCE_LENGTH) {
+        offsets[0] = run_start + (run_length / 2);
+        num_offsets = 1;
+      } else {
+        offsets[0] = run_start;
+        offsets[1] = i - 1;
+        num_offsets = 2;
+      }
+
+      for (int j = 0; j < num_offsets; j++) {
+        int cell_a, cell_b;
+        if (vertical) {
+          cell_a = (rgn.z + offsets[j]) * get_width() + ax;
+          cell_b = (rgn.z + offsets[j]) * get_width() + bx;
+        } else {
+          cell_a = az * get_width() + rgn.x + offsets[j];
+          cell_b = bz * get_width() + rgn.x + offsets[j];
+        }
+        entrances.push_back(std::make_pair(cell_a, cell_b));
+      }
+
+      run_start = -1;
+    }
+  }
+}
+
+void hierarchical_path_find::build_sector(int sector_index) {
+  sector &sec = _sectors[sector_index];
+  sec.nodes.clear();
+
+  int sector_x = sector_index % _sectors_wide;
+  int sector_z = sector_index / _sectors_wide;
+  int right = sector_z * _sectors_wide + fw::constrain(sector_x + 1, _sectors_wide);
+  int left = sector_z * _sectors_wide + fw::constrain(sector_x - 1, _sectors_wide);
+  int down = fw::constrain(sector_z + 1, _sectors_long) * _sectors_wide + sector_x;
+  int up = fw::constrain(sector_z - 1, _sectors_long) * _sectors_wide + sector_x;
+
+  // first, the entrances on each of our four borders
+  std::vector<std::pair<int, int>> entrances;
+  typedef std::pair<int, int> entrance;
+  find_border_entrances(sector_index, right, true, entrances);
+  find_border_entrances(sector_index, down, false, entrances);
+  BOOST_FOREACH(entrance const &e, entrances) {
+    add_entrance(sec, e.first, e.second);
+  }
+  entrances.clear();
+  find_border_entrances(left, sector_index, true, entrances);
+  find_border_entrances(up, sector_index, false, entrances);
+  BOOST_FOREACH(entrance const &e, entrances) {
+    add_entrance(sec, e.second, e.first);
+  }
+
+  // now the cost of getting between each pair of entrances, without leaving the sector. We flood out from each
+  // entrance once and pick up the cost to all of the entrances after it.
+  region rgn = get_sector_region(sector_index);
+  std::vector<fw::vector> targets;
+  std::vector<float> costs;
+  for (int i = 0; i < static_cast<int>(sec.nodes.size()); i++) {
+    targets.clear();
+    for (int j = i + 1; j < static_cast<int>(sec.nodes.size()); j++) {
+      targets.push_back(get_cell_loc(sec.nodes[j].cell));
+    }
+    if (targets.empty()) {
+      break;
+    }
+
+    find_costs_in_region(get_cell_loc(sec.nodes[i].cell), targets, rgn, costs);
+    for (int j = i + 1; j < static_cast<int>(sec.nodes.size()); j++) {
+      float cost = costs[j - i - 1];
+      if (cost >= 0.0f) {
+        abstract_edge edge;
+        edge.cost = cost;
+        edge.cell = sec.nodes[j].cell;
+        sec.nodes[i].edges.push_back(edge);
+        edge.cell = sec.nodes[i].cell;
+        sec.nodes[j].edges.push_back(edge);
+      }
+    }
+  }
+
+  sec.dirty = false;
+}
+
+void hierarchical_path_find::rebuild_dirty_sectors() {
+  if (!_any_dirty) {
+    return;
+  }
+
+  for (int i = 0; i < static_cast<int>(_sectors.size()); i++) {
+    if (_sectors[i].dirty) {
+      build_sector(i);
+    }
+  }
+  _any_dirty = false;
+}
+
+void hierarchical_path_find::mark_dirty(int sector_x, int sector_z) {
+  sector_x = fw::constrain(sector_x, _sectors_wide);
+  sector_z = fw::constrain(sector_z, _sectors_long);
+  _sectors[sector_z * _sectors_wide + sector_x].dirty = true;
+  _any_dirty = true;
+}
+
+void hierarchical_path_find::set_passable(int x, int z, bool passable) {
+  x = fw::constrain(x, get_width());
+  z = fw::constrain(z, get_length());
+  if (is_cell_passable(x, z) == passable) {
+    return;
+  }
+  path_find::set_passable(x, z, passable);
+
+  // the sector the cell is in always needs to be rebuilt. If the cell is on the edge of the sector then the entrances
+  // along that border will change as well, so the neighbouring sector needs to be rebuilt too.
+  int sector_x = x / SECTOR_SIZE;
+  int sector_z = z / SECTOR_SIZE;
+  mark_dirty(sector_x, sector_z);
+
+  region rgn = get_sector_region(sector_z * _sectors_wide + sector_x);
+  if (x == rgn.x) {
+    mark_dirty(sector_x - 1, sector_z);
+  }
+  if (x == rgn.x + rgn.width - 1) {
+    mark_dirty(sector_x + 1, sector_z);
+  }
+  if (z == rgn.z) {
+    mark_dirty(sector_x, sector_z - 1);
+  }
+  if (z == rgn.z + rgn.length - 1) {
+    mark_dirty(sector_x, sector_z + 1);
+  }
+}
+
+// the "octile" distance between two cells, taking into account that the map wraps
+float hierarchical_path_find::estimate_abstract_cost(int from_cell, int to_cell) const {
+  int dx = std::abs((from_cell % get_width()) - (to_cell % get_width()));
+  int dz = std::abs((from_cell / get_width()) - (to_cell / get_width()));
+  dx = fw::min(dx, get_width() - dx);
+  dz = fw::min(dz, get_length() - dz);
+  return static_cast<float>(fw::max(dx, dz)) + 0.41421356f * static_cast<float>(fw::min(dx, dz));
+}
+
+void hierarchical_path_find::connect_to_entrances(int cell, int sector_index, std::vector<abstract_edge> &edges) {
+  sector const &sec = _sectors[sector_index];
+  std::vector<fw::vector> targets;
+  BOOST_FOREACH(abstract_node const &node, sec.nodes) {
+    targets.push_back(get_cell_loc(node.cell));
+  }
+
+  std::vector<float> costs;
+  find_costs_in_region(get_cell_loc(cell), targets, get_sector_region(sector_index), costs);
+  for (int i = 0; i < static_cast<int>(sec.nodes.size()); i++) {
+    if (costs[i] >= 0.0f) {
+      abstract_edge edge;
+      edge.cell = sec.nodes[i].cell;
+      edge.cost = costs[i];
+      edges.push_back(edge);
+    }
+  }
+}
+
+bool hierarchical_path_find::find_abstract_path(std::vector<int> &abstract_path, int start_cell, int goal_cell) {
+  int start_sector = get_sector_index(start_cell);
+  int goal_sector = get_sector_index(goal_cell);
+
+  // temporarily connect the start and goal to the entrances of the sectors they're in. Like build_sector, that's a
+  // single flood out from the start (and one from the goal) which picks up the cost to every entrance at once.
+  std::vector<abstract_edge> start_edges;
+  std::vector<abstract_edge> goal_edges;
+  connect_to_entrances(start_cell, start_sector, start_edges);
+  connect_to_entrances(goal_cell, goal_sector, goal_edges);
+
+  if (start_edges.empty() || goal_edges.empty()) {
+    return false;
+  }
+
+  struct search_state {
+    float cost_from_start;
+    int previous;
+    bool closed;
+  };
+  typedef std::pair<float, int> open_entry;
+  std::unordered_map<int, search_state> states;
+  std::priority_queue<open_entry, std::vector<open_entry>, std::greater<open_entry>> open_set;
+
+  search_state start_state = {0.0f, -1, false};
+  states[start_cell] = start_state;
+  open_set.push(open_entry(estimate_abstract_cost(start_cell, goal_cell), start_cell));
+
+  while (!open_set.empty()) {
+    int curr = open_set.top().second;
+    open_set.pop();
+
+    search_state &curr_state = states[curr];
+    if (curr_state.closed) {
+      // this is a stale entry, we've already found a cheaper way here
+      continue;
+    }
+    curr_state.closed = true;
+
+    if (curr == goal_cell) {
+      for (int cell = goal_cell; cell >= 0; cell = states[cell].previous) {
+        abstract_path.insert(abstract_path.begin(), cell);
+      }
+      return true;
+    }
+
+    float curr_cost = curr_state.cost_from_start;
+    auto relax = [&](int to, float cost) {
+      float new_cost = curr_cost + cost;
+      auto it = states.find(to);
+      if (it == states.end()) {
+        search_state state = {new_cost, curr, false};
+        states[to] = state;
+      } else if (!it->second.closed && new_cost < it->second.cost_from_start) {
+        it->second.cost_from_start = new_cost;
+        it->second.previous = curr;
+      } else {
+        return;
+      }
+      open_set.push(open_entry(new_cost + estimate_abstract_cost(to, goal_cell), to));
+    };
+
+    if (curr == start_cell) {
+      BOOST_FOREACH(abstract_edge const &edge, start_edges) {
+        relax(edge.cell, edge.cost);
+      }
+    }
+
+    int curr_sector = get_sector_index(curr);
+    abstract_node *node = find_abstract_node(curr_sector, curr);
+    if (node != nullptr) {
+      BOOST_FOREACH(abstract_edge const &edge, node->edges) {
+        relax(edge.cell, edge.cost);
+      }
+    }
+
+    if (curr_sector == goal_sector) {
+      BOOST_FOREACH(abstract_edge const &edge, goal_edges) {
+        if (edge.cell == curr) {
+          relax(goal_cell, edge.cost);
+        }
+      }
+    }
+  }
+
+  return false;
+}
+
+bool hierarchical_path_find::find(std::vector<fw::vector> &path, fw::vector const &start, fw::vector const &end) {
+  rebuild_dirty_sectors();
+
+  int start_x = fw::constrain(static_cast<int>(start[0]), get_width());
+  int start_z = fw::constrain(static_cast<int>(start[2]), get_length());
+  int goal_x = fw::constrain(static_cast<int>(end[0]), get_width());
+  int goal_z = fw::constrain(static_cast<int>(end[2]), get_length());
+
+  // the abstract graph only knows about passable cells, so let the full search deal with anything else
+  if (!is_cell_passable(start_x, start_z) || !is_cell_passable(goal_x, goal_z)) {
+    return path_find::find(path, start, end);
+  }
+
+  int start_cell = start_z * get_width() + start_x;
+  int goal_cell = goal_z * get_width() + goal_x;
+
+  // if the start and goal are in the same sector, try a search confined to that sector first
+  int start_sector = get_sector_index(start_cell);
+  if (start_sector == get_sector_index(goal_cell)) {
+    if (find_in_region(path, get_cell_loc(start_cell), get_cell_loc(goal_cell), get_sector_region(start_sector),
+        nullptr)) {
+      return true;
+    }
+  }
+
+  // the abstract graph doesn't know about diagonal moves across the corners of sectors, so it's possible (though
+  // unlikely) that there's a path it can't see. In that case, we fall back to a full search.
+  std::vector<int> abstract_path;
+  if (!find_abstract_path(abstract_path, start_cell, goal_cell)) {
+    return path_find::find(path, start, end);
+  }
+
+  // now refine each segment of the abstract path into a full-resolution path
+  std::vector<fw::vector> segment;
+  path.push_back(get_cell_loc(start_cell));
+  for (int i = 1; i < static_cast<int>(abstract_path.size()); i++) {
+    int from_cell = abstract_path[i - 1];
+    int to_cell = abstract_path[i];
+    if (from_cell == to_cell) {
+      continue;
+    }
+
+    int from_sector = get_sector_index(from_cell);
+    if (from_sector != get_sector_index(to_cell)) {
+      // moving across a border, the two cells are right next to each other
+      path.push_back(get_cell_loc(to_cell));
+      continue;
+    }
+
+    segment.clear();
+    if (!find_in_region(segment, get_cell_loc(from_cell), get_cell_loc(to_cell), get_sector_region(from_sector),
+        nullptr)) {
+      path.clear();
+      return path_find::find(path, start, end);
+    }
+    path.insert(path.end(), segment.begin() + 1, segment.end());
+  }
+
+  return true;
+}
+
+}
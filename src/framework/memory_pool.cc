@@ -0,0 +1,70 @@
+#include <new>
+#include <boost/foreach.hpp>
+
+#include <framework/memory_pool.h>
+
+namespace fw {
+
+memory_pool::memory_pool() :
+    _num_allocations(0), _num_heap_allocations(0), _num_live(0) {
+}
+
+memory_pool::~memory_pool() {
+  BOOST_FOREACH(char *chunk, _chunks) {
+    ::operator delete(chunk);
+  }
+}
+
+void *memory_pool::allocate(std::size_t size) {
+  std::size_t size_class = (size == 0) ? 0 : (size - 1) / GRANULARITY;
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  _num_allocations++;
+  _num_live++;
+  if (size_class >= NUM_SIZE_CLASSES) {
+    _num_heap_allocations++;
+    return ::operator new(size);
+  }
+
+  std::vector<void *> &free_list = _free_lists[size_class];
+  if (free_list.empty()) {
+    refill(size_class);
+  }
+
+  void *ptr = free_list.back();
+  free_list.pop_back();
+  return ptr;
+}
+
+void memory_pool::deallocate(void *ptr, std::size_t size) {
+  if (ptr == nullptr) {
+    return;
+  }
+  std::size_t size_class = (size == 0) ? 0 : (size - 1) / GRANULARITY;
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  _num_live--;
+  if (size_class >= NUM_SIZE_CLASSES) {
+    ::operator delete(ptr);
+    return;
+  }
+
+  _free_lists[size_class].push_back(ptr);
+}
+
+// allocates a new chunk of blocks from the heap and adds them all to the given size class's free list. _mutex must
+// be held.
+void memory_pool::refill(std::size_t size_class) {
+  std::size_t block_size = (size_class + 1) * GRANULARITY;
+  char *chunk = static_cast<char *>(::operator new(block_size * BLOCKS_PER_CHUNK));
+  _chunks.push_back(chunk);
+  _num_heap_allocations++;
+
+  std::vector<void *> &free_list = _free_lists[size_class];
+  free_list.reserve(free_list.size() + BLOCKS_PER_CHUNK);
+  for (std::size_t i = 0; i < BLOCKS_PER_CHUNK; i++) {
+    free_list.push_back(chunk + (BLOCKS_PER_CHUNK - i - 1) * block_size);
+  }
+}
+
+}
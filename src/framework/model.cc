@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <boost/foreach.hpp>
+
 #include <framework/model.h>
 #include <framework/model_node.h>
 #include <framework/scenegraph.h>
@@ -7,7 +10,8 @@
 
 namespace fw {
 
-model_mesh::model_mesh(int /*num_vertices*/, int /*num_indices*/) {
+model_mesh::model_mesh(int /*num_vertices*/, int /*num_indices*/) :
+    _bounds_centre(0, 0, 0), _bounds_radius(0.0f) {
 }
 
 model_mesh::~model_mesh() {
@@ -32,21 +36,61 @@ void model_mesh_noanim::setup_buffers() {
   _ib = std::shared_ptr<index_buffer>(new index_buffer());
   _ib->set_data(indices.size(), &indices[0]);
 
+  if (!vertices.empty()) {
+    fw::vector mins(vertices[0].x, vertices[0].y, vertices[0].z);
+    fw::vector maxs(mins);
+    BOOST_FOREACH(fw::vertex::xyz_n_uv const &vert, vertices) {
+      mins = fw::vector(std::min(mins[0], vert.x), std::min(mins[1], vert.y), std::min(mins[2], vert.z));
+      maxs = fw::vector(std::max(maxs[0], vert.x), std::max(maxs[1], vert.y), std::max(maxs[2], vert.z));
+    }
+    _bounds_centre = (mins + maxs) * 0.5f;
+    _bounds_radius = (maxs - _bounds_centre).length();
+  }
+
   _shader = shader::create("entity.shader");
 }
 
 //-------------------------------------------------------------------------
 
-model::model() : _wireframe(false), _colour(fw::colour(1, 1, 1)) {
+model::model() :
+    _wireframe(false), _colour(fw::colour(1, 1, 1)), _bounds_calculated(false), _bounds_centre(0, 0, 0),
+    _bounds_radius(0.0f) {
 }
 
 model::~model() {
 }
 
-void model::render(sg::scenegraph &sg, fw::matrix const &transform /*= fw::matrix::identity() */) {
-  root_node->set_world_matrix(transform);
-  root_node->set_colour(_colour);
-  sg.add_node(root_node->clone());
+void model::render(sg::scenegraph &sg, fw::matrix const &transform /*= fw::matrix::identity() */,
+    bool shadow_only /*= false*/) {
+  root_node->enqueue(sg, fw::identity(), transform, _colour, shadow_only);
+}
+
+void model::calculate_bounds() {
+  bool found = false;
+  fw::vector mins(0, 0, 0), maxs(0, 0, 0);
+  if (root_node) {
+    root_node->expand_bounds(fw::identity(), fw::identity(), found, mins, maxs);
+  }
+
+  if (found) {
+    _bounds_centre = (mins + maxs) * 0.5f;
+    _bounds_radius = (maxs - _bounds_centre).length();
+  }
+  _bounds_calculated = true;
+}
+
+fw::vector model::get_bounds_centre() {
+  if (!_bounds_calculated) {
+    calculate_bounds();
+  }
+  return _bounds_centre;
+}
+
+float model::get_bounds_radius() {
+  if (!_bounds_calculated) {
+    calculate_bounds();
+  }
+  return _bounds_radius;
 }
 
 }
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <memory>
 #include <boost/foreach.hpp>
 
@@ -10,7 +11,10 @@
 
 namespace fw {
 
-model_node::model_node() : transform(fw::identity()), mesh_index(-1) {
+static shader_parameter_handle const mesh_colour_param("mesh_colour");
+
+model_node::model_node() :
+    _model(nullptr), _bounds_centre(0, 0, 0), _bounds_radius(0.0f), transform(fw::identity()), mesh_index(-1) {
 }
 
 model_node::~model_node() {
@@ -25,6 +29,8 @@ void model_node::initialize(model *mdl) {
     set_index_buffer(mesh->get_index_buffer());
     set_shader(mesh->get_shader());
     set_primitive_type(sg::primitive_trianglelist);
+    _bounds_centre = mesh->get_bounds_centre();
+    _bounds_radius = mesh->get_bounds_radius();
 
     std::shared_ptr<shader_parameters> params = get_shader()->create_parameters();
     if (mdl->texture) {
@@ -39,20 +45,60 @@ void model_node::initialize(model *mdl) {
   }
 }
 
-void model_node::render(sg::scenegraph *sg, fw::matrix const &model_matrix /*= fw::identity()*/) {
-  if (_model->get_wireframe()) {
-//    device = fw::framework::get_instance()->get_graphics()->get_device();
-//    device->SetRenderState(D3DRS_FILLMODE, D3DFILL_WIREFRAME);
-  }
+void model_node::enqueue(sg::scenegraph &sg, fw::matrix const &model_matrix /*= fw::identity()*/) {
+  enqueue(sg, model_matrix, _world, _colour);
+}
 
+void model_node::enqueue(sg::scenegraph &sg, fw::matrix const &model_matrix, fw::matrix const &world,
+    fw::colour const &colour, bool shadow_only /*= false*/) {
+  fw::matrix node_transform = (transform * model_matrix) * world;
   if (mesh_index >= 0) {
-    get_shader_parameters()->set_colour("mesh_colour", _colour);
+    // the shader parameters are shared by every instance of the model, only the colour (and the matrices, which are
+    // set when it's drawn) differ between them
+    sg::draw_item *item = sg.add_draw_item();
+    item->primitive = get_primitive_type();
+    item->cast_shadows = get_cast_shadows();
+    item->shadow_only = shadow_only;
+    item->vb = get_vertex_buffer().get();
+    item->ib = get_index_buffer().get();
+    item->shader = get_shader().get();
+    item->shader_params = get_shader_parameters().get();
+    item->colour_param = &mesh_colour_param;
+    item->colour = colour;
+    item->transform = node_transform;
+
+    item->bounds_centre = cml::transform_point(node_transform, _bounds_centre);
+    item->bounds_radius = _bounds_radius * fw::max_scale(node_transform);
+  }
+
+  BOOST_FOREACH(std::shared_ptr<node> &child_node, _children) {
+    model_node *child = static_cast<model_node *>(child_node.get());
+    child->enqueue(sg, node_transform, child->get_world_matrix(), colour, shadow_only);
   }
+}
 
-  node::render(sg, transform * model_matrix);
+void model_node::expand_bounds(fw::matrix const &model_matrix, fw::matrix const &world, bool &found,
+    fw::vector &mins, fw::vector &maxs) {
+  fw::matrix node_transform = (transform * model_matrix) * world;
+  if (mesh_index >= 0 && _bounds_radius > 0.0f) {
+    fw::vector centre = cml::transform_point(node_transform, _bounds_centre);
+    float radius = _bounds_radius * fw::max_scale(node_transform);
+    fw::vector extent(radius, radius, radius);
+    if (!found) {
+      mins = centre - extent;
+      maxs = centre + extent;
+      found = true;
+    } else {
+      for (int i = 0; i < 3; i++) {
+        mins[i] = std::min(mins[i], centre[i] - radius);
+        maxs[i] = std::max(maxs[i], centre[i] + radius);
+      }
+    }
+  }
 
-  if (_model->get_wireframe()) {
-//    device->SetRenderState(D3DRS_FILLMODE, D3DFILL_SOLID);
+  BOOST_FOREACH(std::shared_ptr<node> &child_node, _children) {
+    model_node *child = static_cast<model_node *>(child_node.get());
+    child->expand_bounds(node_transform, child->get_world_matrix(), found, mins, maxs);
   }
 }
 
@@ -65,6 +111,8 @@ void model_node::populate_clone(std::shared_ptr<sg::node> clone) {
   mnclone->node_name = node_name;
   mnclone->transform = transform;
   mnclone->_colour = _colour;
+  mnclone->_bounds_centre = _bounds_centre;
+  mnclone->_bounds_radius = _bounds_radius;
 }
 
 void model_node::set_colour(fw::colour colour) {
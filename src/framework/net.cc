@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include <boost/algorithm/string.hpp>
 
 #include <framework/net.h>
@@ -20,9 +21,14 @@ void destroy() {
   enet_deinitialize();
 }
 
+// ENet calls this when it's done with a packet we created with ENET_PACKET_FLAG_NO_ALLOCATE (see peer::send)
+static void free_packet_data(ENetPacket *packet) {
+  free(packet->data);
+}
+
 //-------------------------------------------------------------------------
 peer::peer(host *hst, ENetPeer *peer, bool connected) :
-    _host(hst), _peer(peer), _connected(connected) {
+    _host(hst), _peer(peer), _connected(connected), _compact(false) {
 }
 
 peer::~peer() {
@@ -31,17 +37,48 @@ peer::~peer() {
   }
 }
 
+void peer::set_compact_encoding(bool compact) {
+  if (compact != _compact) {
+    _compact = compact;
+    _compact_state = compact_encoding();
+  }
+}
+
 void peer::send(packet &pkt, int channel /*= 0*/) {
   packet_buffer buff(pkt.get_identifier());
-  pkt.serialize(buff);
+  if (_compact) {
+    buff.set_compact(&_compact_state);
+  }
+  write_packet(pkt, buff);
 
-  enet_uint32 flags = 0;
+  // we hand the buffer's memory straight to ENet rather than have it make a copy, it'll call free_packet_data when
+  // it's finished with it.
+  enet_uint32 flags = ENET_PACKET_FLAG_NO_ALLOCATE;
   if (pkt.is_essential()) {
     flags |= ENET_PACKET_FLAG_RELIABLE;
   }
 
-  ENetPacket *packet = enet_packet_create(buff.get_buffer(), buff.get_size(), flags);
-  enet_peer_send(_peer, static_cast<enet_uint8>(channel), packet);
+  std::size_t size = buff.get_size();
+  char *data = buff.release();
+  ENetPacket *packet = enet_packet_create(data, size, flags);
+  if (packet == nullptr) {
+    free(data);
+    BOOST_THROW_EXCEPTION(fw::exception() << fw::message_error_info("error creating packet"));
+  }
+  packet->freeCallback = &free_packet_data;
+  if (enet_peer_send(_peer, static_cast<enet_uint8>(channel), packet) < 0) {
+    // ENet only takes ownership of the packet when the send succeeds. Destroying it calls free_packet_data for us.
+    fw::debug << boost::format("error sending packet to %1%:%2%") % _peer->address.host % _peer->address.port
+        << std::endl;
+    enet_packet_destroy(packet);
+    return;
+  }
+
+  // our peer only learns the strings this packet introduced if it actually gets sent
+  if (_compact) {
+    buff.commit_strings();
+  }
+  _host->add_bytes_sent(size);
 }
 
 void peer::on_connect() {
@@ -52,11 +89,18 @@ void peer::on_connect() {
 void peer::on_receive(ENetPacket *packet, enet_uint8 /*channel*/) {
   fw::debug << boost::format("packet received from %1%:%2%")
       % _peer->address.host % _peer->address.port << std::endl;
+  _host->add_bytes_received(packet->dataLength);
 
   if (_handler) {
+    // the buffer reads directly out of the ENetPacket, which stays alive until we return
     packet_buffer buff(reinterpret_cast<char *>(packet->data), packet->dataLength);
-    std::shared_ptr<net::packet> pkt(create_packet(buff));
-    pkt->deserialize(buff);
+    if (_compact) {
+      buff.set_compact(&_compact_state);
+    }
+    std::shared_ptr<net::packet> pkt(read_packet(buff));
+    if (!pkt) {
+      return;
+    }
     _handler(pkt);
   }
 }
@@ -68,7 +112,7 @@ void peer::on_disconnect() {
 //-------------------------------------------------------------------------
 
 host::host() :
-    _host(0), _listen_port(0) {
+    _host(0), _listen_port(0), _bytes_sent(0), _bytes_received(0) {
 }
 
 host::~host() {
@@ -29,6 +29,25 @@ std::shared_ptr<packet> create_packet(packet_buffer &buff) {
   return fn();
 }
 
+void write_packet(packet &pkt, packet_buffer &buff) {
+  pkt.serialize(buff);
+}
+
+std::shared_ptr<packet> read_packet(packet_buffer &buff) {
+  std::shared_ptr<packet> pkt(create_packet(buff));
+  if (!pkt) {
+    return pkt;
+  }
+
+  pkt->deserialize(buff);
+  if (buff.is_overrun()) {
+    fw::debug << boost::format("  warning: packet with identifier %1% was truncated, dropping.")
+        % buff.get_packet_type() << std::endl;
+    return std::shared_ptr<packet>();
+  }
+  return pkt;
+}
+
 //-------------------------------------------------------------------------
 packet_registrar::packet_registrar(uint16_t id, std::function<std::shared_ptr<packet>()> fn) {
   if (packet_registry == nullptr)
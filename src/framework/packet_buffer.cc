@@ -1,47 +1,193 @@
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <boost/foreach.hpp>
+
 #include <framework/packet_buffer.h>
 
 namespace fw {
 namespace net {
 
 packet_buffer::packet_buffer(uint16_t packet_type) :
-    _flushed(false) {
+    _data(nullptr), _read_data(nullptr), _size(0), _capacity(0), _read_pos(0), _overrun(false),
+    _packet_type(packet_type), _compact(nullptr) {
+  grow(INITIAL_CAPACITY);
   (*this) << packet_type;
 }
 
 packet_buffer::packet_buffer(char const *bytes, std::size_t n) :
-    _buffer(std::string(bytes, n)), _flushed(false) {
+    _data(nullptr), _read_data(bytes), _size(n), _capacity(0), _read_pos(0), _overrun(false), _packet_type(0),
+    _compact(nullptr) {
   (*this) >> _packet_type;
 }
 
 packet_buffer::~packet_buffer() {
+  free(_data);
+}
+
+void packet_buffer::grow(std::size_t min_capacity) {
+  std::size_t new_capacity = _capacity == 0 ? INITIAL_CAPACITY : _capacity;
+  while (new_capacity < min_capacity) {
+    new_capacity *= 2;
+  }
+
+  char *new_data = reinterpret_cast<char *>(realloc(_data, new_capacity));
+  if (new_data == nullptr) {
+    throw std::bad_alloc();
+  }
+  _data = new_data;
+  _capacity = new_capacity;
+}
+
+void packet_buffer::write_uint(uint32_t value) {
+  if (_compact == nullptr) {
+    (*this) << value;
+    return;
+  }
+
+  do {
+    uint8_t b = static_cast<uint8_t>(value & 0x7f);
+    value >>= 7;
+    if (value != 0) {
+      b |= 0x80;
+    }
+    (*this) << b;
+  } while (value != 0);
+}
+
+uint32_t packet_buffer::read_uint() {
+  uint32_t value = 0;
+  if (_compact == nullptr) {
+    (*this) >> value;
+    return value;
+  }
+
+  for (int shift = 0; shift < 35; shift += 7) {
+    uint8_t b;
+    (*this) >> b;
+    value |= static_cast<uint32_t>(b & 0x7f) << shift;
+    if ((b & 0x80) == 0) {
+      break;
+    }
+  }
+  return value;
+}
+
+void packet_buffer::write_int(int32_t value) {
+  if (_compact == nullptr) {
+    (*this) << value;
+    return;
+  }
+
+  write_uint((static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31));
+}
+
+int32_t packet_buffer::read_int() {
+  if (_compact == nullptr) {
+    int32_t value;
+    (*this) >> value;
+    return value;
+  }
+
+  uint32_t value = read_uint();
+  return static_cast<int32_t>((value >> 1) ^ (~(value & 1) + 1));
+}
+
+void packet_buffer::write_position(fw::vector const &pos) {
+  if (_compact == nullptr) {
+    (*this) << pos;
+    return;
+  }
+
+  for (int i = 0; i < 3; i++) {
+    write_int(static_cast<int32_t>(floor(pos[i] * POSITION_RESOLUTION + 0.5f)));
+  }
 }
 
-void packet_buffer::add_bytes(char const *bytes, std::size_t offset, std::size_t n) {
-  _flushed = false;
-  _buffer.write(bytes + offset, n);
+fw::vector packet_buffer::read_position() {
+  fw::vector pos;
+  if (_compact == nullptr) {
+    (*this) >> pos;
+    return pos;
+  }
+
+  for (int i = 0; i < 3; i++) {
+    pos[i] = static_cast<float>(read_int()) / POSITION_RESOLUTION;
+  }
+  return pos;
 }
 
-void packet_buffer::get_bytes(char *bytes, std::size_t offset, std::size_t n) {
-  _buffer.read(bytes + offset, n);
+fw::vector packet_buffer::quantize_position(fw::vector const &pos) {
+  fw::vector quantized;
+  for (int i = 0; i < 3; i++) {
+    quantized[i] = static_cast<float>(static_cast<int32_t>(floor(pos[i] * POSITION_RESOLUTION + 0.5f)))
+        / POSITION_RESOLUTION;
+  }
+  return quantized;
 }
 
-void packet_buffer::flush() {
-  if (_flushed)
+void packet_buffer::write_string_ref(std::string const &str) {
+  if (_compact == nullptr) {
+    (*this) << str;
+    return;
+  }
+
+  // 0 means "a new string follows", otherwise it's the index of the string plus one
+  auto it = _compact->sent_strings.find(str);
+  if (it != _compact->sent_strings.end()) {
+    write_uint(it->second + 1);
     return;
+  }
 
-  _buffer.flush();
-  _value = _buffer.str();
-  _flushed = true;
+  // if we've already sent it in full in this packet, it'll have the next index after the ones already in the table
+  auto new_it = std::find(_new_strings.begin(), _new_strings.end(), str);
+  if (new_it != _new_strings.end()) {
+    uint32_t index = static_cast<uint32_t>(_compact->sent_strings.size() + (new_it - _new_strings.begin()));
+    write_uint(index + 1);
+  } else {
+    write_uint(0);
+    (*this) << str;
+    _new_strings.push_back(str);
+  }
 }
 
-char const *packet_buffer::get_buffer() {
-  flush();
-  return _value.c_str();
+void packet_buffer::commit_strings() {
+  BOOST_FOREACH(std::string const &str, _new_strings) {
+    uint32_t index = static_cast<uint32_t>(_compact->sent_strings.size());
+    _compact->sent_strings[str] = index;
+  }
+  _new_strings.clear();
+}
+
+std::string packet_buffer::read_string_ref() {
+  std::string str;
+  if (_compact == nullptr) {
+    (*this) >> str;
+    return str;
+  }
+
+  uint32_t index = read_uint();
+  if (index == 0) {
+    (*this) >> str;
+    if (!_overrun) {
+      _compact->received_strings.push_back(str);
+    }
+  } else if (index <= _compact->received_strings.size()) {
+    str = _compact->received_strings[index - 1];
+  } else {
+    _overrun = true; // we don't know that string, so the packet must be corrupt
+  }
+  return str;
 }
 
-std::size_t packet_buffer::get_size() {
-  flush();
-  return _value.length();
+char *packet_buffer::release() {
+  char *data = _data;
+  _data = nullptr;
+  _size = 0;
+  _capacity = 0;
+  _read_pos = 0;
+  return data;
 }
 
 }
@@ -1,4 +1,6 @@
+#include <cstdlib>
 #include <set>
+#include <boost/foreach.hpp>
 
 #include <framework/path_find.h>
 #include <framework/timer.h>
@@ -24,20 +26,157 @@ struct path_node {
     }
   };
 
-  std::multiset<path_node *, cost_comparer>::iterator open_it;
+  std::multiset<path_node *, cost_comparer>::iterator open_it; // only valid for open_set_multiset
+  int heap_index; // our index in path_find::_open_heap, only valid for open_set_heap
   int open_run_no;  // the run_no we were last inserted into the open set
   int closed_run_no;  // the run_no we were last inserted into the closed set
+  int target_run_no;  // the run_no of the last flood() that had us as one of its targets
+  int jump_dx, jump_dz; // for jump point search, the direction we jumped in to get here from previous
 };
 
+//-------------------------------------------------------------------------
+
+/**
+ * An open set that wraps the std::multiset we originally used. Every insert and erase allocates (or frees) a tree
+ * node, which is why this is no longer the default.
+ */
+class multiset_open_set {
+private:
+  std::multiset<path_node *, path_node::cost_comparer> _set;
+
+public:
+  inline bool empty() const {
+    return _set.empty();
+  }
+
+  inline path_node *top() const {
+    return *_set.begin();
+  }
+
+  inline void pop() {
+    _set.erase(_set.begin());
+  }
+
+  inline void push(path_node *node) {
+    node->open_it = _set.insert(node);
+  }
+
+  inline void decrease(path_node *node) {
+    _set.erase(node->open_it);
+    node->open_it = _set.insert(node);
+  }
+};
+
+/**
+ * An indexed binary min-heap, keyed on the total (f) cost of each node. The backing array is owned by the path_find
+ * and sized to hold every node in the grid, and each node remembers its position in the heap so that we can do a
+ * decrease-key without searching. That means nothing in here ever allocates.
+ */
+class heap_open_set {
+private:
+  path_node **_heap;
+  int &_size;
+
+  static inline float total_cost(path_node const *node) {
+    return node->cost_from_start + node->cost_to_goal;
+  }
+
+  // returns true if lhs should be closer to the top of the heap than rhs. For ties, we prefer the node that's closer
+  // to the goal, which tends to cut down on the number of nodes we expand.
+  static inline bool less(path_node const *lhs, path_node const *rhs) {
+    float lhs_cost = total_cost(lhs);
+    float rhs_cost = total_cost(rhs);
+    if (lhs_cost == rhs_cost) {
+      return lhs->cost_to_goal < rhs->cost_to_goal;
+    }
+    return lhs_cost < rhs_cost;
+  }
+
+  inline void place(path_node *node, int index) {
+    _heap[index] = node;
+    node->heap_index = index;
+  }
+
+  void sift_up(int index) {
+    path_node *node = _heap[index];
+    while (index > 0) {
+      int parent = (index - 1) / 2;
+      if (!less(node, _heap[parent])) {
+        break;
+      }
+      place(_heap[parent], index);
+      index = parent;
+    }
+    place(node, index);
+  }
+
+  void sift_down(int index) {
+    path_node *node = _heap[index];
+    for (;;) {
+      int child = (index * 2) + 1;
+      if (child >= _size) {
+        break;
+      }
+      if (child + 1 < _size && less(_heap[child + 1], _heap[child])) {
+        child++;
+      }
+      if (!less(_heap[child], node)) {
+        break;
+      }
+      place(_heap[child], index);
+      index = child;
+    }
+    place(node, index);
+  }
+
+public:
+  heap_open_set(path_find *pf) :
+      _heap(pf->_open_heap), _size(pf->_open_heap_size) {
+    _size = 0;
+  }
+
+  inline bool empty() const {
+    return _size == 0;
+  }
+
+  inline path_node *top() const {
+    return _heap[0];
+  }
+
+  inline void pop() {
+    _size--;
+    if (_size > 0) {
+      _heap[0] = _heap[_size];
+      sift_down(0);
+    }
+  }
+
+  inline void push(path_node *node) {
+    _heap[_size] = node;
+    sift_up(_size++);
+  }
+
+  // called when the cost of a node that's already in the heap goes down
+  inline void decrease(path_node *node) {
+    sift_up(node->heap_index);
+  }
+};
+
+//-------------------------------------------------------------------------
+
 path_find::path_find(int width, int length, std::vector<bool> const &passability) :
-    _width(width), _length(length), _run_no(0) {
+    _width(width), _length(length), _run_no(0), _open_set_kind(open_set_heap), _search_mode(search_astar),
+    _open_heap_size(0) {
   _nodes = new path_node[_width * _length];
+  _open_heap = new path_node *[_width * _length];
   for (int z = 0; z < _length; z++) {
     for (int x = 0; x < _width; x++) {
       path_node &node = _nodes[(z * _width) + x];
       node.loc = fw::vector(x, 0, z);
+      node.heap_index = -1;
       node.open_run_no = 0;
       node.closed_run_no = 0;
+      node.target_run_no = 0;
       node.passable = passability[(z * _width) + x];
     }
   }
@@ -45,6 +184,7 @@ path_find::path_find(int width, int length, std::vector<bool> const &passability
 
 path_find::~path_find() {
   delete[] _nodes;
+  delete[] _open_heap;
 }
 
 float estimate_cost(fw::vector const &from, fw::vector const &to) {
@@ -52,6 +192,16 @@ float estimate_cost(fw::vector const &from, fw::vector const &to) {
   return abs(from[0] - to[0]) + abs(from[2] - to[2]);
 }
 
+// the "octile" distance, taking into account that the map wraps. This never overestimates the cost of a path, so jump
+// point search (which uses it) always finds the shortest path.
+float estimate_octile_cost(fw::vector const &from, fw::vector const &to, int width, int length) {
+  int dx = std::abs(static_cast<int>(from[0]) - static_cast<int>(to[0]));
+  int dz = std::abs(static_cast<int>(from[2]) - static_cast<int>(to[2]));
+  dx = fw::min(dx, width - dx);
+  dz = fw::min(dz, length - dz);
+  return static_cast<float>(fw::max(dx, dz)) + 0.41421356f * static_cast<float>(fw::min(dx, dz));
+}
+
 void construct_path(std::vector<fw::vector> &path, path_node const *goal_node) {
   path_node const *node = goal_node;
   while (node != 0) {
@@ -61,33 +211,270 @@ void construct_path(std::vector<fw::vector> &path, path_node const *goal_node) {
 }
 
 path_node *path_find::get_node(fw::vector const &loc) const {
-  int x = fw::constrain(static_cast<int>(loc[0]), _width);
-  int z = fw::constrain(static_cast<int>(loc[2]), _length);
+  return get_node(static_cast<int>(loc[0]), static_cast<int>(loc[2]));
+}
+
+path_node *path_find::get_node(int x, int z) const {
+  x = fw::constrain(x, _width);
+  z = fw::constrain(z, _length);
   return &_nodes[(z * _width) + x];
 }
 
 bool path_find::find(std::vector<fw::vector> &path, fw::vector const &start, fw::vector const &end) {
-  std::multiset<path_node *, path_node::cost_comparer> open_set;
+  if (_search_mode == search_jps) {
+    // JPS needs to land exactly on the goal, so if the goal itself isn't passable we let A* find the closest we can
+    // get to it instead.
+    if (get_node(end)->passable) {
+      return find_jps(path, start, end);
+    }
+  }
+
+  if (_open_set_kind == open_set_multiset) {
+    multiset_open_set open_set;
+    return find_impl(open_set, path, start, end, nullptr, nullptr);
+  } else {
+    heap_open_set open_set(this);
+    return find_impl(open_set, path, start, end, nullptr, nullptr);
+  }
+}
+
+//-------------------------------------------------------------------------
+// Jump point search. See Harabor & Grastien, "Online Graph Pruning for Pathfinding on Grid Maps". Our grid lets you
+// move diagonally between two blocked cells, so we use the original rules which allow "corner cutting".
+
+inline bool path_find::is_cell_open(int x, int z) const {
+  return get_node(x, z)->passable;
+}
+
+// returns true if a node at (x, z) that we reached by moving in direction (dx, dz) has any forced neighbours
+bool path_find::has_forced_neighbours(int x, int z, int dx, int dz) const {
+  if (dx != 0 && dz != 0) {
+    return (!is_cell_open(x - dx, z) && is_cell_open(x - dx, z + dz))
+        || (!is_cell_open(x, z - dz) && is_cell_open(x + dx, z - dz));
+  } else if (dx != 0) {
+    return (!is_cell_open(x, z + 1) && is_cell_open(x + dx, z + 1))
+        || (!is_cell_open(x, z - 1) && is_cell_open(x + dx, z - 1));
+  } else {
+    return (!is_cell_open(x + 1, z) && is_cell_open(x + 1, z + dz))
+        || (!is_cell_open(x - 1, z) && is_cell_open(x - 1, z + dz));
+  }
+}
+
+// Moves from 'from' in the direction (dx, dz) until we hit something interesting (the goal, or a node with forced
+// neighbours) and returns that node, or null if we hit a wall first. 'cost' is set to the cost of the jump.
+path_node *path_find::jump(path_node const *from, int dx, int dz, path_node const *goal, float &cost) const {
+  int x = static_cast<int>(from->loc[0]);
+  int z = static_cast<int>(from->loc[2]);
+  bool diagonal = (dx != 0 && dz != 0);
+  float step_cost = diagonal ? 1.41421356f : 1.0f;
+  cost = 0.0f;
+
+  // the map wraps, so we could keep going around forever if there's nothing in the way. A straight scan has seen
+  // every cell in its row (or column) once it's been all the way across the map, so there's no point going further.
+  // A diagonal scan does the two straight scans at every step, so we stop it after it's crossed the map as well, and
+  // let the search carry on from there as if it were a jump point.
+  //
+  // That means a straight jump looks at up to width (or length) cells, but a diagonal jump can look at up to
+  // max(width, length) * (width + length) cells -- i.e. O(w*l) -- on a wide open map. We don't cap the straight scans
+  // any tighter than that: a scan that gave up early would have to stop the diagonal there (we can't know it didn't
+  // miss something), and on open ground that's every step, which is just A* with extra work.
+  int max_steps = (dx == 0) ? _length : _width;
+  if (diagonal) {
+    max_steps = fw::max(_width, _length);
+  }
+  for (int i = 0; i < max_steps; i++) {
+    x += dx;
+    z += dz;
+    cost += step_cost;
+
+    path_node *n = get_node(x, z);
+    if (!n->passable) {
+      return nullptr;
+    }
+    if (n == goal || has_forced_neighbours(x, z, dx, dz)) {
+      return n;
+    }
+
+    // when moving diagonally, we stop if there's anything interesting in either of the straight directions
+    if (diagonal) {
+      float straight_cost;
+      if (jump(n, dx, 0, goal, straight_cost) != nullptr || jump(n, 0, dz, goal, straight_cost) != nullptr) {
+        return n;
+      }
+    }
+  }
+
+  if (diagonal && get_node(x, z) != from) {
+    return get_node(x, z);
+  }
+  return nullptr;
+}
+
+// builds the full path (i.e. every cell, not just the jump points) so that it looks just like what A* gives us
+void path_find::construct_jps_path(std::vector<fw::vector> &path, path_node const *goal_node) const {
+  std::vector<fw::vector> reversed;
+  path_node const *node = goal_node;
+  for (; node->previous != 0; node = node->previous) {
+    // walk back from this jump point to the previous one, one cell at a time
+    int x = static_cast<int>(node->loc[0]);
+    int z = static_cast<int>(node->loc[2]);
+    for (path_node const *n = node; n != node->previous; n = get_node(x, z)) {
+      reversed.push_back(n->loc);
+      x -= node->jump_dx;
+      z -= node->jump_dz;
+    }
+  }
+
+  // node is now the start node
+  reversed.push_back(node->loc);
+  path.insert(path.end(), reversed.rbegin(), reversed.rend());
+}
+
+bool path_find::find_jps(std::vector<fw::vector> &path, fw::vector const &start, fw::vector const &end) {
+  _run_no++;
+  heap_open_set open_set(this);
 
+  path_node *goal_node = get_node(end);
+  path_node *start_node = get_node(start);
+  start_node->previous = 0;
+  start_node->jump_dx = start_node->jump_dz = 0;
+  start_node->open_run_no = _run_no;
+  start_node->cost_to_goal = estimate_octile_cost(start_node->loc, goal_node->loc, _width, _length);
+  start_node->cost_from_start = 0.0f;
+  open_set.push(start_node);
+
+  while (!open_set.empty()) {
+    path_node *curr = open_set.top();
+    if (curr == goal_node) {
+      construct_jps_path(path, curr);
+      return true;
+    }
+
+    curr->closed_run_no = _run_no;
+    curr->open_run_no = 0;
+    open_set.pop();
+
+    int x = static_cast<int>(curr->loc[0]);
+    int z = static_cast<int>(curr->loc[2]);
+    int pdx = curr->jump_dx;
+    int pdz = curr->jump_dz;
+
+    // work out which directions we need to look in. For the start node, that's all of them. Otherwise it's the
+    // "natural" neighbours in the direction we're travelling, plus any forced neighbours.
+    int dirs[8][2];
+    int num_dirs = 0;
+    if (pdx == 0 && pdz == 0) {
+      for (int dz = -1; dz <= 1; dz++) {
+        for (int dx = -1; dx <= 1; dx++) {
+          if (dx != 0 || dz != 0) {
+            dirs[num_dirs][0] = dx;
+            dirs[num_dirs][1] = dz;
+            num_dirs++;
+          }
+        }
+      }
+    } else if (pdx != 0 && pdz != 0) {
+      int natural[3][2] = {{pdx, 0}, {0, pdz}, {pdx, pdz}};
+      for (int i = 0; i < 3; i++) {
+        dirs[num_dirs][0] = natural[i][0];
+        dirs[num_dirs][1] = natural[i][1];
+        num_dirs++;
+      }
+      if (!is_cell_open(x - pdx, z) && is_cell_open(x - pdx, z + pdz)) {
+        dirs[num_dirs][0] = -pdx;
+        dirs[num_dirs][1] = pdz;
+        num_dirs++;
+      }
+      if (!is_cell_open(x, z - pdz) && is_cell_open(x + pdx, z - pdz)) {
+        dirs[num_dirs][0] = pdx;
+        dirs[num_dirs][1] = -pdz;
+        num_dirs++;
+      }
+    } else {
+      dirs[num_dirs][0] = pdx;
+      dirs[num_dirs][1] = pdz;
+      num_dirs++;
+      // the two cells either side of us (perpendicular to the direction of travel)
+      int sx = pdz, sz = pdx;
+      for (int side = -1; side <= 1; side += 2) {
+        if (!is_cell_open(x + sx * side, z + sz * side)
+            && is_cell_open(x + pdx + sx * side, z + pdz + sz * side)) {
+          dirs[num_dirs][0] = pdx + sx * side;
+          dirs[num_dirs][1] = pdz + sz * side;
+          num_dirs++;
+        }
+      }
+    }
+
+    for (int i = 0; i < num_dirs; i++) {
+      float jump_cost;
+      path_node *n = jump(curr, dirs[i][0], dirs[i][1], goal_node, jump_cost);
+      if (n == nullptr || n->closed_run_no == _run_no) {
+        continue;
+      }
+
+      float new_cost_from_start = curr->cost_from_start + jump_cost;
+      if (n->open_run_no != _run_no || new_cost_from_start < n->cost_from_start) {
+        n->previous = curr;
+        n->jump_dx = dirs[i][0];
+        n->jump_dz = dirs[i][1];
+        n->cost_to_goal = estimate_octile_cost(n->loc, goal_node->loc, _width, _length);
+        n->cost_from_start = new_cost_from_start;
+        if (n->open_run_no == _run_no) {
+          open_set.decrease(n);
+        } else {
+          n->open_run_no = _run_no;
+          open_set.push(n);
+        }
+      }
+    }
+  }
+
+  return false;
+}
+
+//-------------------------------------------------------------------------
+
+bool path_find::find_in_region(std::vector<fw::vector> &path, fw::vector const &start, fw::vector const &end,
+    region const &rgn, float *cost) {
+  heap_open_set open_set(this);
+  return find_impl(open_set, path, start, end, &rgn, cost);
+}
+
+// returns true if the given node is inside the given (possibly wrapping) region
+static inline bool in_region(path_node const *node, int width, int length, path_find::region const &rgn) {
+  int x = static_cast<int>(node->loc[0]);
+  int z = static_cast<int>(node->loc[2]);
+  return fw::constrain(x - rgn.x, width) < rgn.width && fw::constrain(z - rgn.z, length) < rgn.length;
+}
+
+template<typename open_set_type>
+bool path_find::find_impl(open_set_type &open_set, std::vector<fw::vector> &path, fw::vector const &start,
+    fw::vector const &end, region const *rgn, float *cost) {
   // increment the run_no (basically invalidating all the current path_nodes)
   _run_no++;
 
+  // when we're searching a region, we need to end up exactly on the goal node
+  path_node *goal_node = (rgn != nullptr) ? get_node(end) : nullptr;
+
   // add the initial node to the open set
   path_node *start_node = get_node(start);
   start_node->previous = 0;
   start_node->open_run_no = _run_no;
   start_node->cost_to_goal = estimate_cost(start_node->loc, end);
   start_node->cost_from_start = 0.0f;
-  start_node->open_it = open_set.insert(start_node);
+  open_set.push(start_node);
 
-  auto open_it = open_set.begin();
-  while (open_it != open_set.end()) {
+  while (!open_set.empty()) {
     // grab the first node from the open set
-    path_node *curr = *open_it;
+    path_node *curr = open_set.top();
 
     // work out if we're at the goal
     float cost_to_goal = curr->cost_to_goal;
-    if (cost_to_goal <= 1.0f) {
+    if (goal_node != nullptr ? curr == goal_node : cost_to_goal <= 1.0f) {
+      if (cost != nullptr) {
+        *cost = curr->cost_from_start;
+      }
       construct_path(path, curr);
       return true;
     }
@@ -95,7 +482,7 @@ bool path_find::find(std::vector<fw::vector> &path, fw::vector const &start, fw:
     // we've now processed this node, add it to the closed set
     curr->closed_run_no = _run_no;
     curr->open_run_no = 0;
-    open_set.erase(curr->open_it);
+    open_set.pop();
 
     // find all the neighbours and add them to the open set
     for (int dz = -1; dz <= 1; dz++) {
@@ -112,6 +499,10 @@ bool path_find::find(std::vector<fw::vector> &path, fw::vector const &start, fw:
         if (n->closed_run_no == _run_no || !n->passable)
           continue;
 
+        // if we're restricted to a region, don't go outside of it
+        if (rgn != nullptr && !in_region(n, _width, _length, *rgn))
+          continue;
+
         // estimate the cost to the goal from this node
         float new_cost_to_goal = estimate_cost(n->loc, end);
 
@@ -130,24 +521,166 @@ bool path_find::find(std::vector<fw::vector> &path, fw::vector const &start, fw:
           n->cost_from_start = new_cost_from_start;
 
           if (n->open_run_no == _run_no) {
-            // if it's already on the open list, remove it and re-add it
-            // since, by definition, it will now be lower cost
-            open_set.erase(n->open_it);
+            // if it's already on the open list, it needs to move up since, by
+            // definition, it will now be lower cost
+            open_set.decrease(n);
           } else {
             n->open_run_no = _run_no;
+            open_set.push(n);
           }
-          n->open_it = open_set.insert(n);
         }
       }
     }
-
-    open_it = open_set.begin();
   }
 
   // if we get here, it means we couldn't find a path at all...
   return false;
 }
 
+// Floods outwards from 'from' until all of the given targets have been reached (or we run out of nodes). If 'guided'
+// is false, this is Dijkstra's algorithm and each node ends up with its exact cost. If it's true, we guide the search
+// towards the bounding box of the targets, which means we visit far fewer nodes when the targets are far away.
+void path_find::flood(fw::vector const &from, std::vector<path_node *> const &targets, region const *rgn,
+    bool guided) {
+  _run_no++;
+  heap_open_set open_set(this);
+
+  // mark each of the targets, so we can tell when we reach one without searching the whole list
+  int num_remaining = 0;
+  BOOST_FOREACH(path_node *target, targets) {
+    if (target->target_run_no != _run_no) {
+      target->target_run_no = _run_no;
+      num_remaining++;
+    }
+  }
+
+  // the estimate is the octile distance (like find_jps uses) to the targets' bounding box, so it never overestimates
+  // and a node is never closed before we've found its cheapest path.
+  float min_x = 0.0f, min_z = 0.0f, max_x = 0.0f, max_z = 0.0f;
+  if (guided && !targets.empty()) {
+    min_x = max_x = targets[0]->loc[0];
+    min_z = max_z = targets[0]->loc[2];
+    BOOST_FOREACH(path_node *target, targets) {
+      min_x = fw::min(min_x, target->loc[0]);
+      max_x = fw::max(max_x, target->loc[0]);
+      min_z = fw::min(min_z, target->loc[2]);
+      max_z = fw::max(max_z, target->loc[2]);
+    }
+  }
+  auto estimate = [&](path_node const *n) {
+    if (!guided) {
+      return 0.0f;
+    }
+    float dx = fw::max(0.0f, fw::max(min_x - n->loc[0], n->loc[0] - max_x));
+    float dz = fw::max(0.0f, fw::max(min_z - n->loc[2], n->loc[2] - max_z));
+
+    // the map wraps, so the box might be closer going around the other way
+    dx = fw::min(dx, fw::max(0.0f, static_cast<float>(_width) - (max_x - min_x) - dx));
+    dz = fw::min(dz, fw::max(0.0f, static_cast<float>(_length) - (max_z - min_z) - dz));
+    return fw::max(dx, dz) + 0.41421356f * fw::min(dx, dz);
+  };
+
+  path_node *start_node = get_node(from);
+  start_node->previous = 0;
+  start_node->open_run_no = _run_no;
+  start_node->cost_to_goal = estimate(start_node);
+  start_node->cost_from_start = 0.0f;
+  open_set.push(start_node);
+
+  while (!open_set.empty() && num_remaining > 0) {
+    path_node *curr = open_set.top();
+    open_set.pop();
+    curr->closed_run_no = _run_no;
+    curr->open_run_no = 0;
+
+    if (curr->target_run_no == _run_no) {
+      num_remaining--;
+    }
+
+    for (int dz = -1; dz <= 1; dz++) {
+      for (int dx = -1; dx <= 1; dx++) {
+        if (dx == 0 && dz == 0)
+          continue;
+
+        path_node *n = get_node(fw::vector(curr->loc[0] + dx, 0.0f, curr->loc[2] + dz));
+        if (n->closed_run_no == _run_no || !n->passable)
+          continue;
+        if (rgn != nullptr && !in_region(n, _width, _length, *rgn))
+          continue;
+
+        float new_cost_from_start = curr->cost_from_start + (dx == 0 || dz == 0 ? 1.0f : 1.41421356f);
+        if (n->open_run_no != _run_no) {
+          n->previous = curr;
+          n->cost_to_goal = estimate(n);
+          n->cost_from_start = new_cost_from_start;
+          n->open_run_no = _run_no;
+          open_set.push(n);
+        } else if (new_cost_from_start < n->cost_from_start) {
+          n->previous = curr;
+          n->cost_from_start = new_cost_from_start;
+          open_set.decrease(n);
+        }
+      }
+    }
+  }
+}
+
+void path_find::find_costs_in_region(fw::vector const &start, std::vector<fw::vector> const &targets,
+    region const &rgn, std::vector<float> &costs) {
+  std::vector<path_node *> target_nodes(targets.size());
+  for (int i = 0; i < static_cast<int>(targets.size()); i++) {
+    target_nodes[i] = get_node(targets[i]);
+  }
+
+  flood(start, target_nodes, &rgn, false);
+
+  costs.resize(targets.size());
+  for (int i = 0; i < static_cast<int>(targets.size()); i++) {
+    costs[i] = (target_nodes[i]->closed_run_no == _run_no) ? target_nodes[i]->cost_from_start : -1.0f;
+  }
+}
+
+int path_find::find_group(std::vector<std::vector<fw::vector>> &paths, std::vector<fw::vector> const &starts,
+    fw::vector const &goal) {
+  // we'll never reach a start that's not passable, so don't wait for those
+  std::vector<path_node *> start_nodes(starts.size());
+  std::vector<path_node *> targets;
+  for (int i = 0; i < static_cast<int>(starts.size()); i++) {
+    start_nodes[i] = get_node(starts[i]);
+    if (start_nodes[i]->passable) {
+      targets.push_back(start_nodes[i]);
+    }
+  }
+
+  // flood backwards from the goal. Once we're done, each node's "previous" points at the next node along the
+  // path to the goal -- that's our flow field.
+  flood(goal, targets, nullptr, true);
+
+  int num_found = 0;
+  paths.resize(starts.size());
+  for (int i = 0; i < static_cast<int>(starts.size()); i++) {
+    paths[i].clear();
+    if (start_nodes[i]->closed_run_no != _run_no) {
+      continue;
+    }
+
+    for (path_node const *node = start_nodes[i]; node != 0; node = node->previous) {
+      paths[i].push_back(node->loc);
+    }
+    num_found++;
+  }
+
+  return num_found;
+}
+
+bool path_find::is_cell_passable(int x, int z) const {
+  return get_node(fw::vector(x, 0.0f, z))->passable;
+}
+
+void path_find::set_passable(int x, int z, bool passable) {
+  get_node(fw::vector(x, 0.0f, z))->passable = passable;
+}
+
 bool path_find::is_passable(fw::vector const &start, fw::vector const &end) const {
   // we need to determine whether a straight line from start to end is passable
   // or not. We'll trace a line from start to end then look up all the nodes
@@ -1,5 +1,7 @@
 
+#include <algorithm>
 #include <memory>
+#include <vector>
 
 #include <boost/foreach.hpp>
 
@@ -9,6 +11,8 @@
 #include <framework/camera.h>
 #include <framework/logging.h>
 #include <framework/exception.h>
+#include <framework/frame_arena.h>
+#include <framework/frustum.h>
 #include <framework/misc.h>
 #include <framework/shader.h>
 #include <framework/shadows.h>
@@ -17,10 +21,26 @@
 
 static std::shared_ptr<fw::shader> shadow_shader;
 static std::shared_ptr<fw::shader> basic_shader;
+static std::shared_ptr<fw::vertex_buffer> instance_buffer;
+
+// these are set for every draw, so we resolve them up front
+static fw::shader_parameter_handle const worldviewproj_param("worldviewproj");
+static fw::shader_parameter_handle const worldview_param("worldview");
+static fw::shader_parameter_handle const viewproj_param("viewproj");
+static fw::shader_parameter_handle const view_param("view");
+static fw::shader_parameter_handle const lightviewproj_param("lightviewproj");
+static fw::shader_parameter_handle const shadow_map_param("shadow_map");
 
 static bool is_rendering_shadow = false;
 static std::shared_ptr<fw::shadow_source> shadowsrc;
 
+// the frustums of the light cameras we rendered the shadow maps with last frame (see scenegraph::might_cast_shadow)
+static std::vector<fw::frustum> g_shadow_frustums;
+
+// we keep one shadow_source per shadow-casting light from frame to frame, so that the static casters they've cached
+// in their shadow maps are still around next frame.
+static std::vector<std::shared_ptr<fw::shadow_source>> g_shadow_sources;
+
 static std::map<fw::sg::primitive_type, uint32_t> g_primitive_type_map;
 
 static void ensure_primitive_type_map() {
@@ -87,128 +107,464 @@ std::shared_ptr<fw::shader> node::get_shader() const {
   return shader;
 }
 
-void node::render(scenegraph *sg, fw::matrix const &model_matrix /*= fw::identity()*/) {
-  // if we're not a shadow caster, and we're rendering shadows, don't render the node this time around
-  if (is_rendering_shadow && !_cast_shadows) {
-    return;
-  }
+void node::enqueue(scenegraph &sg, fw::matrix const &model_matrix /*= fw::identity()*/) {
+  sg._num_nodes++;
 
   fw::matrix transform(model_matrix * _world);
   if (_vb) {
-    std::shared_ptr<fw::shader> shader = get_shader();
-    if (is_rendering_shadow) {
-      shader = shadow_shader;
-    }
+    draw_item *item = sg.add_draw_item(render_layer_ordered);
+    item->primitive = _primitive_type;
+    item->cast_shadows = _cast_shadows;
+    item->vb = _vb.get();
+    item->ib = _ib.get();
+    item->shader = get_shader().get();
+    item->shader_params = _shader_params.get();
+    item->transform = transform;
+  }
+
+  // add the children as well
+  BOOST_FOREACH(std::shared_ptr<node> &child_node, _children) {
+    child_node->enqueue(sg, transform);
+  }
+}
+
+void node::populate_clone(std::shared_ptr<node> clone) {
+  clone->_cast_shadows = _cast_shadows;
+  clone->_primitive_type = _primitive_type;
+  clone->_vb = _vb;
+  clone->_ib = _ib;
+  clone->_shader = _shader;
+  if (_shader_params)
+    clone->_shader_params = _shader_params->clone();
+  clone->_parent = _parent;
+  clone->_world = _world;
+
+  // clone the children as well!
+  BOOST_FOREACH(std::shared_ptr<node> child, _children) {
+    clone->_children.push_back(child->clone());
+  }
+}
+
+std::shared_ptr<node> node::clone() {
+  std::shared_ptr<node> clone(new node());
+  populate_clone(clone);
+  return clone;
+}
+
+//-----------------------------------------------------------------------------------------
+
+scenegraph::scenegraph()
+    : _clear_colour(fw::colour(1, 0, 0, 0)), _arena(fw::framework::get_instance()->get_frame_arena()),
+      _first_item(nullptr), _last_item(nullptr), _num_items(0), _num_enqueued_nodes(0), _num_nodes(0),
+      _sorted_items(nullptr), _num_sorted_items(0), _num_draw_calls(0), _has_view_frustum(false),
+      _view_position(0, 0, 0), _num_visible_objects(0), _num_culled_objects(0) {
+}
 
-    fw::camera *camera = sg->get_camera();
+scenegraph::scenegraph(fw::frame_arena &arena)
+    : _clear_colour(fw::colour(1, 0, 0, 0)), _arena(arena), _first_item(nullptr), _last_item(nullptr), _num_items(0),
+      _num_enqueued_nodes(0), _num_nodes(0), _sorted_items(nullptr), _num_sorted_items(0), _num_draw_calls(0),
+      _has_view_frustum(false), _view_position(0, 0, 0), _num_visible_objects(0), _num_culled_objects(0) {
+}
+
+scenegraph::~scenegraph() {
+}
+
+draw_item *scenegraph::add_draw_item(render_layer layer /*= render_layer_opaque*/) {
+  draw_item *item = _arena.create<draw_item>();
+  item->layer = layer;
+  item->sequence = _num_items++;
+  item->cast_shadows = true;
+  item->transform = fw::identity();
+
+  if (_last_item == nullptr) {
+    _first_item = item;
+  } else {
+    _last_item->next = item;
+  }
+  _last_item = item;
+  return item;
+}
+
+bool scenegraph::is_visible(fw::vector const &centre, float radius, float lod_size /*= 0.0f*/) {
+  if (!_has_view_frustum) {
+    fw::camera *camera = get_camera();
     if (camera == nullptr) {
       camera = fw::framework::get_instance()->get_camera();
     }
+    if (camera == nullptr) {
+      _num_visible_objects++;
+      return true;
+    }
 
-    if (!shader) {
-      render_noshader(camera, transform);
-    } else {
-      render_shader(shader, camera, transform);
+    _view_frustum.set_matrix(camera->get_view_matrix() * camera->get_projection_matrix());
+    _view_position = camera->get_position();
+    _has_view_frustum = true;
+  }
+
+  bool visible = true;
+  if (radius > 0.0f) {
+    if (!_view_frustum.intersects_sphere(centre, radius)) {
+      visible = false;
+    } else if (lod_size > 0.0f) {
+      float max_distance = radius / lod_size;
+      visible = ((centre - _view_position).length_squared() <= max_distance * max_distance);
     }
   }
 
-  // render the children as well (todo: pass transformations)
-  BOOST_FOREACH(std::shared_ptr<node> &child_node, _children) {
-    child_node->render(sg, transform);
+  if (visible) {
+    _num_visible_objects++;
+  } else {
+    _num_culled_objects++;
   }
+  return visible;
 }
 
-// this is called when we're rendering a given shader
-void node::render_shader(std::shared_ptr<fw::shader> shader, fw::camera *camera, fw::matrix const &transform) {
-  std::shared_ptr<fw::shader_parameters> parameters;
-  if (_shader_params) {
-    parameters = _shader_params;
+bool scenegraph::might_cast_shadow(fw::vector const &centre, float radius) const {
+  if (radius <= 0.0f) {
+    return true;
+  }
+
+  BOOST_FOREACH(fw::frustum const &frustum, g_shadow_frustums) {
+    if (frustum.intersects_sphere(centre, radius)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// we only need to group draws with the same state together, so we just take a few bits from each pointer rather than
+// trying to assign unique ids. A collision just means two states might be interleaved, which is harmless.
+static inline uint64_t state_bits(void const *ptr) {
+  return (reinterpret_cast<uintptr_t>(ptr) >> 4) & 0xffff;
+}
+
+// the sort key is (from most- to least-significant): layer, then for opaque items, shader, parameters, vertex buffer
+// and index buffer. Ordered items just use their sequence number so they're drawn in the order they were added.
+static uint64_t calculate_sort_key(draw_item const *item) {
+  uint64_t key = static_cast<uint64_t>(item->layer) << 63;
+  if (item->layer == render_layer_opaque) {
+    key |= state_bits(item->shader) << 47;
+    key |= state_bits(item->shader_params) << 31;
+    key |= state_bits(item->vb) << 15;
+    key |= state_bits(item->ib) >> 1;
   } else {
-    parameters = shader->create_parameters();
+    key |= item->sequence;
+  }
+  return key;
+}
+
+draw_item * const *scenegraph::get_render_queue(int *num_items) {
+  // nodes are turned into draw items lazily, because they can be modified after they've been added
+  for (; _num_enqueued_nodes < _root_nodes.size(); _num_enqueued_nodes++) {
+    _root_nodes[_num_enqueued_nodes]->enqueue(*this);
+  }
+
+  if (_num_sorted_items != _num_items) {
+    _sorted_items = _arena.create_array<draw_item *>(_num_items);
+    int index = 0;
+    for (draw_item *item = _first_item; item != nullptr; item = item->next) {
+      item->sort_key = calculate_sort_key(item);
+      _sorted_items[index++] = item;
+    }
+    std::sort(_sorted_items, _sorted_items + _num_items, [](draw_item const *lhs, draw_item const *rhs) {
+      if (lhs->sort_key != rhs->sort_key) {
+        return lhs->sort_key < rhs->sort_key;
+      }
+      return lhs->sequence < rhs->sequence;
+    });
+    _num_sorted_items = _num_items;
+  }
+
+  *num_items = _num_sorted_items;
+  return _sorted_items;
+}
+
+}
+
+//-----------------------------------------------------------------------------------------
+static const bool g_shadow_debug = false;
+
+// sets the lightviewproj and shadow_map parameters, if there's a shadow source and we're not drawing the shadow map
+// itself. lightviewproj takes points through the given transform into the shadow map's texture space.
+static void set_shadow_parameters(fw::shader_parameters *parameters, fw::matrix const &transform) {
+  if (is_rendering_shadow || !shadowsrc) {
+    return;
+  }
+
+  fw::matrix lightviewproj = transform * shadowsrc->get_camera().get_view_matrix();
+  lightviewproj *= shadowsrc->get_camera().get_projection_matrix();
+
+  fw::matrix bias = fw::matrix(
+      0.5, 0.0, 0.0, 0.0,
+      0.0, 0.5, 0.0, 0.0,
+      0.0, 0.0, 0.5, 0.0,
+      0.5, 0.5, 0.5, 1.0
+  );
+
+  parameters->set_matrix(lightviewproj_param, bias * lightviewproj);
+  parameters->set_texture(shadow_map_param, shadowsrc->get_shadowmap()->get_depth_buffer());
+}
+
+// issues the draw call for a single draw item with the given shader
+static void draw(sg::draw_item const *item, fw::shader *shader, fw::camera *camera) {
+  std::shared_ptr<fw::shader_parameters> temp_parameters;
+  fw::shader_parameters *parameters = item->shader_params;
+  if (parameters == nullptr) {
+    temp_parameters = shader->create_parameters();
+    parameters = temp_parameters.get();
+  }
+
+  if (item->colour_param != nullptr) {
+    parameters->set_colour(*item->colour_param, item->colour);
   }
 
   // add the world_view and world_view_proj parameters as well as shadow parameters
   if (camera != nullptr) {
     fw::matrix worldview = camera->get_view_matrix();
-    worldview = transform * worldview;
+    worldview = item->transform * worldview;
     fw::matrix worldviewproj = worldview * camera->get_projection_matrix();
 
-    parameters->set_matrix("worldviewproj", worldviewproj);
-    parameters->set_matrix("worldview", worldview);
-
-    if (!is_rendering_shadow && shadowsrc) {
-      fw::matrix lightviewproj = transform * shadowsrc->get_camera().get_view_matrix();
-      lightviewproj *= shadowsrc->get_camera().get_projection_matrix();
-
-      fw::matrix bias = fw::matrix(
-          0.5, 0.0, 0.0, 0.0,
-          0.0, 0.5, 0.0, 0.0,
-          0.0, 0.0, 0.5, 0.0,
-          0.5, 0.5, 0.5, 1.0
-      );
-
-      parameters->set_matrix("lightviewproj", bias * lightviewproj);
-      parameters->set_texture("shadow_map", shadowsrc->get_shadowmap()->get_depth_buffer());
-    }
+    parameters->set_matrix(worldviewproj_param, worldviewproj);
+    parameters->set_matrix(worldview_param, worldview);
+    set_shadow_parameters(parameters, item->transform);
   }
 
-  _vb->begin();
+  item->vb->begin();
   shader->begin(parameters);
-  if (_ib) {
-    _ib->begin();
-    FW_CHECKED(glDrawElements(g_primitive_type_map[_primitive_type], _ib->get_num_indices(), GL_UNSIGNED_SHORT, nullptr));
-    _ib->end();
+  if (item->ib != nullptr) {
+    item->ib->begin();
+    FW_CHECKED(glDrawElements(g_primitive_type_map[item->primitive], item->ib->get_num_indices(), GL_UNSIGNED_SHORT,
+        nullptr));
+    item->ib->end();
   } else {
-    FW_CHECKED(glDrawArrays(g_primitive_type_map[_primitive_type], 0, _vb->get_num_vertices()));
+    FW_CHECKED(glDrawArrays(g_primitive_type_map[item->primitive], 0, item->vb->get_num_vertices()));
   }
   shader->end();
-  _vb->end();
+  item->vb->end();
 }
 
-void node::render_noshader(fw::camera *camera, fw::matrix const &transform) {
-  if (!basic_shader) {
-    basic_shader = fw::shader::create("basic.shader");
+// draws count items which all share the same buffers, shader and parameters with a single instanced draw call. The
+// per-item transform and colour go into the instance buffer, and the shader's "instanced" program reads them from
+// there instead of from the worldviewproj/mesh_colour uniforms. Likewise, lightviewproj doesn't include the world
+// transform, the "instanced" program applies the instance's transform first.
+static void draw_instanced(sg::scenegraph &scenegraph, sg::draw_item const * const *items, int count,
+    fw::shader *shader, fw::camera *camera) {
+  sg::draw_item const *first = items[0];
+
+  fw::vertex::instance *instances = scenegraph.get_arena().create_array<fw::vertex::instance>(count);
+  for (int i = 0; i < count; i++) {
+    sg::draw_item const *item = items[i];
+    memcpy(instances[i].world, item->transform.data(), sizeof(instances[i].world));
+    instances[i].r = item->colour.r;
+    instances[i].g = item->colour.g;
+    instances[i].b = item->colour.b;
+    instances[i].a = item->colour.a;
+  }
+  if (!instance_buffer) {
+    instance_buffer = fw::vertex_buffer::create<fw::vertex::instance>(true);
+  }
+  instance_buffer->set_data(count, instances);
+
+  std::shared_ptr<fw::shader_parameters> temp_parameters;
+  fw::shader_parameters *parameters = first->shader_params;
+  if (parameters == nullptr) {
+    temp_parameters = shader->create_parameters();
+    parameters = temp_parameters.get();
+  }
+  if (camera != nullptr) {
+    parameters->set_matrix(viewproj_param, camera->get_view_matrix() * camera->get_projection_matrix());
+    parameters->set_matrix(view_param, camera->get_view_matrix());
+    set_shadow_parameters(parameters, fw::identity());
   }
 
-  render_shader(basic_shader, camera, transform);
+  instance_buffer->begin();
+  first->vb->begin();
+  shader->begin(parameters, "instanced");
+  first->ib->begin();
+  FW_CHECKED(glDrawElementsInstanced(g_primitive_type_map[first->primitive], first->ib->get_num_indices(),
+      GL_UNSIGNED_SHORT, nullptr, count));
+  first->ib->end();
+  shader->end();
+  first->vb->end();
+  fw::vertex::instance::cleanup();
 }
 
-void node::populate_clone(std::shared_ptr<node> clone) {
-  clone->_cast_shadows = _cast_shadows;
-  clone->_primitive_type = _primitive_type;
-  clone->_vb = _vb;
-  clone->_ib = _ib;
-  clone->_shader = _shader;
-  if (_shader_params)
-    clone->_shader_params = _shader_params->clone();
-  clone->_parent = _parent;
-  clone->_world = _world;
+// returns true if the two draw items can be drawn with the same instanced draw call
+static inline bool can_instance_together(sg::draw_item const *lhs, sg::draw_item const *rhs) {
+  return lhs->layer == rhs->layer && lhs->vb == rhs->vb && lhs->ib == rhs->ib && lhs->shader == rhs->shader
+      && lhs->shader_params == rhs->shader_params && lhs->primitive == rhs->primitive
+      && lhs->colour_param == rhs->colour_param && lhs->cast_shadows == rhs->cast_shadows;
+}
 
-  // clone the children as well!
-  BOOST_FOREACH(std::shared_ptr<node> child, _children) {
-    clone->_children.push_back(child->clone());
+// which of the items in the render queue a call to draw_queue is drawing
+enum draw_pass {
+  main_pass,
+  static_shadow_pass,
+  dynamic_shadow_pass
+};
+
+// returns true if the given item should be drawn in the given pass, and (if we have one) is inside the frustum
+static inline bool should_draw(sg::draw_item const *item, draw_pass pass, fw::frustum const *cull) {
+  if (pass == main_pass && item->shadow_only) {
+    return false;
+  }
+  if (pass != main_pass && (!item->cast_shadows || item->static_caster != (pass == static_shadow_pass))) {
+    return false;
   }
+  if (cull != nullptr && item->bounds_radius > 0.0f
+      && !cull->intersects_sphere(item->bounds_centre, item->bounds_radius)) {
+    return false;
+  }
+  return true;
 }
 
-std::shared_ptr<node> node::clone() {
-  std::shared_ptr<node> clone(new node());
-  populate_clone(clone);
-  return clone;
-}
+// draws the items in the scenegraph's render queue that belong in the given pass (in the shadow passes, that's just
+// the ones that cast shadows, with the shadow shader), skipping any that are outside of cull (if it's not null).
+// Returns the number of draw calls we issued.
+static int draw_queue(sg::scenegraph &scenegraph, draw_pass pass, fw::frustum const *cull) {
+  fw::camera *camera = scenegraph.get_camera();
+  if (camera == nullptr) {
+    camera = fw::framework::get_instance()->get_camera();
+  }
 
-//-----------------------------------------------------------------------------------------
+  int num_queued;
+  sg::draw_item * const *queue = scenegraph.get_render_queue(&num_queued);
 
-scenegraph::scenegraph()
-    : _clear_colour(fw::colour(1, 0, 0, 0)) {
+  // filter the queue first, so that items which are instanced together are still next to each other
+  sg::draw_item const **items = scenegraph.get_arena().create_array<sg::draw_item const *>(num_queued);
+  int num_items = 0;
+  for (int i = 0; i < num_queued; i++) {
+    if (should_draw(queue[i], pass, cull)) {
+      items[num_items++] = queue[i];
+    }
+  }
+
+  int num_draw_calls = 0;
+  for (int i = 0; i < num_items; ) {
+    sg::draw_item const *item = items[i];
+
+    // the queue is sorted, so items that can be instanced together will be next to each other. Only opaque items
+    // are instanced, because ordered items need to be drawn in the order they were added.
+    int count = 1;
+    if (item->layer == sg::render_layer_opaque) {
+      while (i + count < num_items && can_instance_together(item, items[i + count])) {
+        count++;
+      }
+    }
+
+    fw::shader *shader = item->shader;
+    if (pass != main_pass) {
+      shader = shadow_shader.get();
+    } else if (shader == nullptr) {
+      if (!basic_shader) {
+        basic_shader = fw::shader::create("basic.shader");
+      }
+      shader = basic_shader.get();
+    }
+
+    if (count > 1 && item->ib != nullptr && shader->has_program("instanced")) {
+      draw_instanced(scenegraph, items + i, count, shader, camera);
+      num_draw_calls++;
+    } else {
+      for (int j = 0; j < count; j++) {
+        draw(items[i + j], shader, camera);
+        num_draw_calls++;
+      }
+    }
+    i += count;
+  }
+
+  return num_draw_calls;
 }
 
-scenegraph::~scenegraph() {
+// a bit of room in front of and behind the shadow casters, so that the light camera's near and far planes don't clip
+// anything that's just outside of their bounds.
+static const float shadow_camera_margin = 20.0f;
+
+// fits the light camera around the visible items in the render queue (shadow-only items are off screen, so we don't
+// need shadows on them). We fit it to the static casters (that is, the visible terrain patches) if there are any,
+// otherwise to every caster we know the bounds of. If we don't know the bounds of anything, we fall back to a
+// perspective projection from the light's position. Casters that aren't visible are still drawn into the shadow map as
+// long as they're inside the fitted camera's frustum.
+static void fit_shadow_camera(fw::light_camera &cam, sg::light const &light, sg::draw_item * const *items,
+    int num_items) {
+  fw::vector direction = light.get_direction();
+  direction.normalize();
+
+  bool found = false;
+  fw::vector mins(0, 0, 0), maxs(0, 0, 0);
+  for (int attempt = 0; attempt < 2 && !found; attempt++) {
+    for (int i = 0; i < num_items; i++) {
+      sg::draw_item const *item = items[i];
+      if (!item->cast_shadows || item->shadow_only || item->bounds_radius <= 0.0f
+          || (attempt == 0 && !item->static_caster)) {
+        continue;
+      }
+
+      fw::vector radius(item->bounds_radius, item->bounds_radius, item->bounds_radius);
+      fw::vector item_mins = item->bounds_centre - radius;
+      fw::vector item_maxs = item->bounds_centre + radius;
+      if (!found) {
+        mins = item_mins;
+        maxs = item_maxs;
+        found = true;
+      } else {
+        for (int j = 0; j < 3; j++) {
+          mins[j] = std::min(mins[j], item_mins[j]);
+          maxs[j] = std::max(maxs[j], item_maxs[j]);
+        }
+      }
+    }
+  }
+
+  if (!found) {
+    cam.set_default_projection();
+    cam.set_view(light.get_position(), direction);
+    return;
+  }
+
+  fw::vector centre = (mins + maxs) * 0.5f;
+  float radius = (maxs - centre).length();
+  cam.set_view(centre - direction * (radius + shadow_camera_margin), direction);
+  cam.set_orthographic(radius * 2.0f, radius * 2.0f, 1.0f, (radius + shadow_camera_margin) * 2.0f);
 }
 
+static inline uint64_t hash_bytes(uint64_t hash, void const *data, std::size_t size) {
+  uint8_t const *bytes = static_cast<uint8_t const *>(data);
+  for (std::size_t i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * 1099511628211ULL;
+  }
+  return hash;
 }
 
-//-----------------------------------------------------------------------------------------
-static const bool g_shadow_debug = false;
+// calculates a value that changes whenever the static casters would render differently into the given camera's
+// shadow map, so we know when we need to re-render them. Only the casters inside the camera's frustum count, since
+// they're the only ones we draw. Returns 0 if there aren't any static casters at all.
+static uint64_t calculate_static_signature(fw::light_camera const &cam, fw::frustum const &light_frustum,
+    sg::draw_item * const *items, int num_items) {
+  uint64_t hash = 14695981039346656037ULL;
+  bool found = false;
+  for (int i = 0; i < num_items; i++) {
+    sg::draw_item const *item = items[i];
+    if (!should_draw(item, static_shadow_pass, &light_frustum)) {
+      continue;
+    }
+
+    found = true;
+    hash = hash_bytes(hash, &item->vb, sizeof(item->vb));
+    hash = hash_bytes(hash, &item->ib, sizeof(item->ib));
+    hash = hash_bytes(hash, item->transform.data(), sizeof(float) * 16);
+  }
+  if (!found) {
+    return 0;
+  }
+
+  uint64_t generation = shadow_source::get_static_generation();
+  hash = hash_bytes(hash, &generation, sizeof(generation));
+  hash = hash_bytes(hash, cam.get_view_matrix().data(), sizeof(float) * 16);
+  hash = hash_bytes(hash, cam.get_projection_matrix().data(), sizeof(float) * 16);
+  return (hash == 0 ? 1 : hash);
+}
 
 // renders the scene!
 void render(sg::scenegraph &scenegraph, std::shared_ptr<fw::framebuffer> render_target /*= nullptr*/,
@@ -221,30 +577,52 @@ void render(sg::scenegraph &scenegraph, std::shared_ptr<fw::framebuffer> render_
     shadow_shader = fw::shader::create("shadow.shader");
   }
 
+  int num_items;
+  sg::draw_item * const *items = scenegraph.get_render_queue(&num_items);
+
   // set up the shadow sources that we'll need to render from first to get the various shadows going.
   std::vector<std::shared_ptr<shadow_source>> shadows;
   for(auto it = scenegraph.get_lights().begin(); it != scenegraph.get_lights().end(); ++it) {
     if ((*it)->get_cast_shadows()) {
-      std::shared_ptr<shadow_source> shdwsrc(new shadow_source());
-      shdwsrc->initialize(g_shadow_debug);
-
-      light_camera &cam = shdwsrc->get_camera();
-      cam.set_location((*it)->get_position());
-      cam.set_direction((*it)->get_direction());
-
+      if (g_shadow_sources.size() <= shadows.size()) {
+        std::shared_ptr<shadow_source> shdwsrc(new shadow_source());
+        shdwsrc->initialize(g_shadow_debug);
+        g_shadow_sources.push_back(shdwsrc);
+      }
+
+      std::shared_ptr<shadow_source> shdwsrc = g_shadow_sources[shadows.size()];
+      fit_shadow_camera(shdwsrc->get_camera(), **it, items, num_items);
       shadows.push_back(shdwsrc);
     }
   }
 
   // render the shadowmap(s) first
+  int num_draw_calls = 0;
   is_rendering_shadow = true;
+  g_shadow_frustums.clear();
   BOOST_FOREACH(shadowsrc, shadows) {
+    light_camera &cam = shadowsrc->get_camera();
+    fw::frustum light_frustum(cam.get_view_matrix() * cam.get_projection_matrix());
+    g_shadow_frustums.push_back(light_frustum);
+    scenegraph.push_camera(&cam);
+
+    // the static casters only need to be re-rendered when they (or the light) have changed since last time,
+    // otherwise we just copy them from last time and render the dynamic casters on top.
+    uint64_t signature = calculate_static_signature(cam, light_frustum, items, num_items);
+    if (signature != 0 && signature != shadowsrc->get_static_signature()) {
+      shadowsrc->begin_static_scene();
+      g->begin_scene();
+      num_draw_calls += draw_queue(scenegraph, static_shadow_pass, &light_frustum);
+      g->end_scene();
+      shadowsrc->set_static_signature(signature);
+    }
+
     shadowsrc->begin_scene();
-    scenegraph.push_camera(&shadowsrc->get_camera());
     g->begin_scene();
-    BOOST_FOREACH(std::shared_ptr<fw::sg::node> node, scenegraph.get_nodes()) {
-      node->render(&scenegraph);
+    if (signature != 0) {
+      shadowsrc->restore_static_casters();
     }
+    num_draw_calls += draw_queue(scenegraph, dynamic_shadow_pass, &light_frustum);
     g->end_scene();
     scenegraph.pop_camera();
     shadowsrc->end_scene();
@@ -257,9 +635,8 @@ void render(sg::scenegraph &scenegraph, std::shared_ptr<fw::framebuffer> render_
 
   // now, render the main scene
   g->begin_scene(scenegraph.get_clear_colour());
-  BOOST_FOREACH(std::shared_ptr<fw::sg::node> node, scenegraph.get_nodes()) {
-    node->render(&scenegraph);
-  }
+  num_draw_calls += draw_queue(scenegraph, main_pass, nullptr);
+  scenegraph.set_num_draw_calls(num_draw_calls);
 
   // make sure the shadowsrc is empty
   std::shared_ptr<shadow_source> debug_shadowsrc;
@@ -1,6 +1,8 @@
-#include <string>
-#include <sstream>
+#include <cstring>
 #include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
@@ -155,10 +157,21 @@ class shader_program {
 private:
   friend class fw::shader_parameters;
 
+  // a uniform in the program, along with a copy of the value we last uploaded to it so that we can skip uploading it
+  // again if it hasn't changed (uniform values are part of the program's state, so they stick around between draws)
+  struct uniform {
+    fw::shader_variable var;
+    bool has_value;
+    float value[16];
+  };
+
   std::string _name;
   std::map<std::string, std::string> _states;
   GLuint _program_id;
-  std::map<std::string, fw::shader_variable> _shader_variables;
+  std::vector<uniform> _uniforms;
+
+  // maps shader_parameter_handle ids to an index in _uniforms (or -1 if this program doesn't have that uniform)
+  std::vector<int> _slots;
 
   /**
    * Called during begin to set the given GL state to the given value.
@@ -172,6 +185,15 @@ public:
   ~shader_program();
 
   void begin();
+
+  // gets the index into _uniforms for the uniform with the given handle id, or -1 if we don't have it
+  int get_slot(int id) const {
+    return (id < static_cast<int>(_slots.size())) ? _slots[id] : -1;
+  }
+
+  // returns true if the given value is different to what we last uploaded to the uniform in the given slot (and
+  // remembers the new value)
+  bool update_value(int slot, float const *value, int count);
 };
 
 shader_program::shader_program(fw::xml_element &program_elem) : _program_id(0) {
@@ -205,8 +227,28 @@ shader_program::shader_program(fw::xml_element &program_elem) : _program_id(0) {
     FW_CHECKED(glGetActiveUniform(_program_id, i, sizeof(buffer), &size, &length, &type, buffer));
     GLint location = glGetUniformLocation(_program_id, buffer);
     std::string name(buffer);
-    _shader_variables[name] = fw::shader_variable(location, name, size, type);
+
+    uniform u;
+    u.var = fw::shader_variable(location, name, size, type);
+    u.has_value = false;
+    _uniforms.push_back(u);
+
+    int id = fw::shader_parameter_handle(name).get_id();
+    if (id >= static_cast<int>(_slots.size())) {
+      _slots.resize(id + 1, -1);
+    }
+    _slots[id] = _uniforms.size() - 1;
+  }
+}
+
+bool shader_program::update_value(int slot, float const *value, int count) {
+  uniform &u = _uniforms[slot];
+  if (u.has_value && memcmp(u.value, value, count * sizeof(float)) == 0) {
+    return false;
   }
+  memcpy(u.value, value, count * sizeof(float));
+  u.has_value = true;
+  return true;
 }
 
 shader_program::~shader_program() {
@@ -262,6 +304,29 @@ void shader_program::apply_state(std::string const &name, std::string const &val
   }
 }
 
+//-------------------------------------------------------------------------
+// returns the id for the given shader parameter name, assigning a new one if we haven't seen it before
+static int get_parameter_id(std::string const &name) {
+  static std::mutex mutex;
+  static std::map<std::string, int> ids;
+
+  std::unique_lock<std::mutex> lock(mutex);
+  auto it = ids.find(name);
+  if (it != ids.end()) {
+    return it->second;
+  }
+
+  int id = static_cast<int>(ids.size());
+  ids[name] = id;
+  return id;
+}
+
+shader_parameter_handle::shader_parameter_handle(std::string const &name) : _id(get_parameter_id(name)) {
+}
+
+shader_parameter_handle::shader_parameter_handle(char const *name) : _id(get_parameter_id(name)) {
+}
+
 //-------------------------------------------------------------------------
 shader_parameters::shader_parameters() {
 }
@@ -273,47 +338,78 @@ void shader_parameters::set_program_name(std::string const &name) {
   _program_name = name;
 }
 
-void shader_parameters::set_texture(std::string const &name, std::shared_ptr<texture> const &tex) {
-  _textures[name] = tex;
+float *shader_parameters::set_value(shader_parameter_handle const &handle, value_type type) {
+  int id = handle.get_id();
+  for (auto it = _values.begin(); it != _values.end(); ++it) {
+    if (it->id == id) {
+      it->type = type;
+      return it->data;
+    }
+  }
+
+  value v;
+  v.id = id;
+  v.type = type;
+  _values.push_back(v);
+  return _values.back().data;
+}
+
+void shader_parameters::set_texture(shader_parameter_handle const &handle, std::shared_ptr<texture> const &tex) {
+  int id = handle.get_id();
+  for (auto it = _textures.begin(); it != _textures.end(); ++it) {
+    if (it->id == id) {
+      it->tex = tex;
+      return;
+    }
+  }
+
+  texture_value tv;
+  tv.id = id;
+  tv.tex = tex;
+  _textures.push_back(tv);
 }
 
-void shader_parameters::set_matrix(std::string const &name, matrix const &m) {
-  _matrices[name] = m;
+void shader_parameters::set_matrix(shader_parameter_handle const &handle, matrix const &m) {
+  memcpy(set_value(handle, value_matrix), m.data(), 16 * sizeof(float));
 }
 
-void shader_parameters::set_vector(std::string const &name, vector const &v) {
-  _vectors[name] = v;
+void shader_parameters::set_vector(shader_parameter_handle const &handle, vector const &v) {
+  memcpy(set_value(handle, value_vector), v.data(), 3 * sizeof(float));
 }
 
-void shader_parameters::set_colour(std::string const &name, colour const &c) {
-  _colours[name] = c;
+void shader_parameters::set_colour(shader_parameter_handle const &handle, colour const &c) {
+  float *data = set_value(handle, value_colour);
+  data[0] = c.r;
+  data[1] = c.g;
+  data[2] = c.b;
+  data[3] = c.a;
 }
 
-void shader_parameters::set_scalar(std::string const &name, float f) {
-  _scalars[name] = f;
+void shader_parameters::set_scalar(shader_parameter_handle const &handle, float f) {
+  *set_value(handle, value_scalar) = f;
 }
 
 std::shared_ptr<shader_parameters> shader_parameters::clone() {
   std::shared_ptr<shader_parameters> clone(new shader_parameters());
+  clone->_program_name = _program_name;
   clone->_textures = _textures;
-  clone->_matrices = _matrices;
-  clone->_vectors = _vectors;
-  clone->_colours = _colours;
-  clone->_scalars = _scalars;
+  clone->_values = _values;
   return clone;
 }
 
 void shader_parameters::apply(shader_program *prog) const {
   int texture_unit = 0;
   for (auto it = _textures.begin(); it != _textures.end(); ++it) {
-    shader_variable const &var = prog->_shader_variables[it->first];
-    if (var.valid) {
+    int slot = prog->get_slot(it->id);
+    if (slot >= 0) {
       FW_CHECKED(glActiveTexture(GL_TEXTURE0 + texture_unit));
-      std::shared_ptr<fw::texture> texture = it->second;
-      if(texture) {
-        texture->bind();
+      if (it->tex) {
+        it->tex->bind();
+      }
+      float unit = static_cast<float>(texture_unit);
+      if (prog->update_value(slot, &unit, 1)) {
+        FW_CHECKED(glUniform1i(prog->_uniforms[slot].var.location, texture_unit));
       }
-      FW_CHECKED(glUniform1i(var.location, texture_unit));
       texture_unit ++;
     }
   }
@@ -323,31 +419,34 @@ void shader_parameters::apply(shader_program *prog) const {
     texture_unit++;
   }
 
-  for (std::map<std::string, matrix>::const_iterator it = _matrices.begin(); it != _matrices.end(); ++it) {
-    shader_variable const &var = prog->_shader_variables[it->first];
-    if (var.valid) {
-      FW_CHECKED(glUniformMatrix4fv(var.location, 1, GL_FALSE, it->second.data()));
-    }
-  }
-
-  for (std::map<std::string, vector>::const_iterator it = _vectors.begin(); it != _vectors.end(); ++it) {
-    shader_variable const &var = prog->_shader_variables[it->first];
-    if (var.valid) {
-      FW_CHECKED(glUniform3fv(var.location, 1, it->second.data()));
-    }
-  }
-
-  for (std::map<std::string, colour>::const_iterator it = _colours.begin(); it != _colours.end(); ++it) {
-    shader_variable const &var = prog->_shader_variables[it->first];
-    if (var.valid) {
-      FW_CHECKED(glUniform4f(var.location, it->second.r, it->second.g, it->second.b, it->second.a));
+  for (auto it = _values.begin(); it != _values.end(); ++it) {
+    int slot = prog->get_slot(it->id);
+    if (slot < 0) {
+      continue;
     }
-  }
 
-  for (std::map<std::string, float>::const_iterator it = _scalars.begin(); it != _scalars.end(); ++it) {
-    shader_variable const &var = prog->_shader_variables[it->first];
-    if (var.valid) {
-      FW_CHECKED(glUniform1f(var.location, it->second));
+    GLint location = prog->_uniforms[slot].var.location;
+    switch (it->type) {
+    case value_matrix:
+      if (prog->update_value(slot, it->data, 16)) {
+        FW_CHECKED(glUniformMatrix4fv(location, 1, GL_FALSE, it->data));
+      }
+      break;
+    case value_vector:
+      if (prog->update_value(slot, it->data, 3)) {
+        FW_CHECKED(glUniform3fv(location, 1, it->data));
+      }
+      break;
+    case value_colour:
+      if (prog->update_value(slot, it->data, 4)) {
+        FW_CHECKED(glUniform4f(location, it->data[0], it->data[1], it->data[2], it->data[3]));
+      }
+      break;
+    case value_scalar:
+      if (prog->update_value(slot, it->data, 1)) {
+        FW_CHECKED(glUniform1f(location, it->data[0]));
+      }
+      break;
     }
   }
 }
@@ -382,18 +481,30 @@ std::shared_ptr<shader> shader::create(std::string const &filename) {
   return shdr;
 }
 
+bool shader::has_program(std::string const &name) const {
+  return _programs.find(name) != _programs.end();
+}
+
 void shader::begin(std::shared_ptr<shader_parameters> parameters) {
-  shader_program *prog;
+  begin(parameters.get());
+}
+
+void shader::begin(shader_parameters *parameters) {
   std::string program_name = _default_program_name;
-  if (parameters && parameters->_program_name != "") {
+  if (parameters != nullptr && parameters->_program_name != "") {
     program_name = parameters->_program_name;
   }
-  prog = _programs[program_name];
+  begin(parameters, program_name);
+}
+
+void shader::begin(shader_parameters *parameters, std::string const &program_name) {
+  auto it = _programs.find(program_name);
+  shader_program *prog = (it == _programs.end()) ? nullptr : it->second;
   if (prog == nullptr) {
     prog = _programs[_default_program_name];
   }
   prog->begin();
-  if (parameters) {
+  if (parameters != nullptr) {
     parameters->apply(prog);
   }
 }
@@ -10,18 +10,44 @@
 namespace fw {
 
 light_camera::light_camera() {
-  set_projection_matrix(cml::constantsf::pi() / 8.0f, 1.0f, 200.0f, 500.0f);
+  set_default_projection();
 }
 
 light_camera::~light_camera() {
 }
 
+void light_camera::set_view(vector const &position, vector const &direction) {
+  _position = position;
+  _forward = direction;
+  _updated = true;
+  update(0.0f);
+}
+
+void light_camera::set_orthographic(float width, float height, float near_plane, float far_plane) {
+  cml::matrix_orthographic_RH(_projection, -width * 0.5f, width * 0.5f, -height * 0.5f, height * 0.5f,
+      near_plane, far_plane, cml::z_clip_neg_one);
+}
+
+void light_camera::set_default_projection() {
+  set_projection_matrix(cml::constantsf::pi() / 8.0f, 1.0f, 200.0f, 500.0f);
+}
+
 //---------------------------------------------------------------------------------------------------------
 // this is a static list of shadow map textures, so we don't have create/destroy them
 // over and over (as shadow_sources get created/destroyed)
 static std::list<std::shared_ptr<framebuffer>> g_shadowbuffers;
 
-shadow_source::shadow_source() {
+static uint64_t g_static_generation = 0;
+
+shadow_source::shadow_source() : _static_signature(0) {
+}
+
+void shadow_source::invalidate_static_casters() {
+  g_static_generation++;
+}
+
+uint64_t shadow_source::get_static_generation() {
+  return g_static_generation;
 }
 
 shadow_source::~shadow_source() {
@@ -46,6 +72,21 @@ void shadow_source::initialize(bool debug /*= false */) {
     _shadowbuffer = g_shadowbuffers.front();
     g_shadowbuffers.pop_front();
   }
+
+  _static_shadowbuffer = std::shared_ptr<framebuffer>(new framebuffer());
+  std::shared_ptr<fw::texture> static_depth_texture(new texture());
+  static_depth_texture->create(_shadowbuffer->get_width(), _shadowbuffer->get_height(), true);
+  _static_shadowbuffer->set_depth_buffer(static_depth_texture);
+  _static_signature = 0;
+}
+
+void shadow_source::begin_static_scene() {
+  framework *frmwrk = fw::framework::get_instance();
+  frmwrk->get_graphics()->set_render_target(_static_shadowbuffer);
+}
+
+void shadow_source::restore_static_casters() {
+  _static_shadowbuffer->copy_depth_to(*_shadowbuffer);
 }
 
 void shadow_source::begin_scene() {
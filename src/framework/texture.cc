@@ -261,6 +261,17 @@ void framebuffer::unbind() {
   FW_CHECKED(glBindFramebuffer(GL_FRAMEBUFFER, 0));
 }
 
+void framebuffer::copy_depth_to(framebuffer &dest) {
+  _data->ensure_initialized();
+  dest._data->ensure_initialized();
+
+  FW_CHECKED(glBindFramebuffer(GL_READ_FRAMEBUFFER, _data->fbo_id));
+  FW_CHECKED(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, dest._data->fbo_id));
+  FW_CHECKED(glBlitFramebuffer(0, 0, get_width(), get_height(), 0, 0, dest.get_width(), dest.get_height(),
+      GL_DEPTH_BUFFER_BIT, GL_NEAREST));
+  FW_CHECKED(glBindFramebuffer(GL_FRAMEBUFFER, dest._data->fbo_id));
+}
+
 int framebuffer::get_width() const {
   if (_data->colour_texture) {
     return _data->colour_texture->get_width();
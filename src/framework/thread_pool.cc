@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <functional>
+
+#include <framework/thread_pool.h>
+
+namespace fw {
+
+thread_pool::thread_pool(int num_threads) :
+    _stopping(false), _fn(nullptr), _count(0), _chunk_size(0), _num_chunks(0), _next_chunk(0), _chunks_done(0),
+    _generation(0) {
+  for (int i = 0; i < num_threads; i++) {
+    _threads.push_back(std::thread(std::bind(&thread_pool::thread_proc, this)));
+  }
+}
+
+thread_pool::~thread_pool() {
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _work_condition.notify_all();
+
+  for (auto it = _threads.begin(); it != _threads.end(); ++it) {
+    it->join();
+  }
+}
+
+void thread_pool::parallel_for(int count, std::function<void(int, int)> const &fn, int min_chunk_size) {
+  if (_threads.empty() || count <= min_chunk_size) {
+    fn(0, count);
+    return;
+  }
+
+  // we make a few chunks per thread, so that if one chunk happens to be expensive the others can pick up the slack
+  int num_threads = get_num_threads() + 1;
+  int chunk_size = std::max(min_chunk_size, (count + (num_threads * 4) - 1) / (num_threads * 4));
+
+  unsigned int generation;
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _fn = &fn;
+    _count = count;
+    _chunk_size = chunk_size;
+    _num_chunks = (count + chunk_size - 1) / chunk_size;
+    _next_chunk = 0;
+    _chunks_done = 0;
+    generation = ++_generation;
+  }
+  _work_condition.notify_all();
+
+  run_chunks(generation);
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (_chunks_done < _num_chunks) {
+    _done_condition.wait(lock);
+  }
+  _fn = nullptr;
+}
+
+void thread_pool::run_chunks(unsigned int generation) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (_generation == generation && _next_chunk < _num_chunks) {
+    int chunk = _next_chunk++;
+    int begin = chunk * _chunk_size;
+    int end = std::min(begin + _chunk_size, _count);
+    std::function<void(int, int)> const *fn = _fn;
+
+    lock.unlock();
+    (*fn)(begin, end);
+    lock.lock();
+
+    if (++_chunks_done == _num_chunks) {
+      _done_condition.notify_all();
+    }
+  }
+}
+
+void thread_pool::thread_proc() {
+  unsigned int last_generation = 0;
+  while (true) {
+    unsigned int generation;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      while (!_stopping && _generation == last_generation) {
+        _work_condition.wait(lock);
+      }
+      if (_stopping) {
+        return;
+      }
+      generation = _generation;
+    }
+
+    run_chunks(generation);
+    last_generation = generation;
+  }
+}
+
+}
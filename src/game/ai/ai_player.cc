@@ -26,7 +26,8 @@ namespace fs = boost::filesystem;
 
 namespace game {
 
-ai_player::ai_player(std::string const &name, script_desc const &desc, uint8_t player_no) {
+ai_player::ai_player(std::string const &name, script_desc const &desc, uint8_t player_no) :
+    _updates_since_prune(0) {
   _script_desc = desc;
   _user_name = name;
   _player_no = player_no;
@@ -50,6 +51,7 @@ ai_player::ai_player(std::string const &name, script_desc const &desc, uint8_t p
           .def("event", &ai_player::l_event)
           .def("register_unit", &ai_player::l_register_unit)
           .def("find_units", &ai_player::l_find_units, luabind::raw(_3))
+          .def("find_units_batch", &ai_player::l_find_units_batch, luabind::raw(_3))
           .def("issue_order", &ai_player::l_issue_order)
   ];
   unit_wrapper::register_class(*script);
@@ -141,117 +143,94 @@ void ai_player::l_register_unit(std::string name, luabind::object creator) {
   _unit_creator_map[name] = creator;
 }
 
-// this is the predicate we pass to the entity manager for our l_findunits() implementation
-struct findunits_predicate {
-private:
-  ai_player *_plyr;
-  std::vector<uint8_t> _player_nos;
-  std::string _unit_type;
-  std::string _state;
-
-public:
-  inline findunits_predicate(ai_player *plyr, luabind::object &params) : _plyr(plyr) {
-    luabind::iterator end;
-    for(luabind::iterator it(params); it != end; ++it) {
-      std::string key = luabind::object_cast<std::string>(it.key());
-
-      if (key == "players" || key == "player") {
-        luabind::object value = *it;
-        if (luabind::type(value) == LUA_TTABLE) {
-          // if it's a table, we treat it as an array
-          fw::debug << "TODO: specifying multiple player_nos is not implemented" << std::endl;
-        } else {
-          // if it's not a table, it should be an integer
-          _player_nos.push_back(luabind::object_cast<uint8_t>(value));
+// parses the parameters to find_units into an entity_query that we can pass to the entity_manager
+void ai_player::parse_query(luabind::object const &params, ent::entity_query &query) {
+  luabind::iterator end;
+  for(luabind::iterator it(params); it != end; ++it) {
+    std::string key = luabind::object_cast<std::string>(it.key());
+
+    if (key == "players" || key == "player") {
+      luabind::object value = *it;
+      if (luabind::type(value) == LUA_TTABLE) {
+        // if it's a table, we treat it as an array
+        for(luabind::iterator player_it(value); player_it != end; ++player_it) {
+          query.player_nos.push_back(luabind::object_cast<int>(*player_it));
         }
-      } else if (key == "unit_type") {
-        _unit_type = luabind::object_cast<std::string>(*it);
-      } else if (key == "state") {
-        _state = luabind::object_cast<std::string>(*it);
       } else {
-        fw::debug << boost::format("WARN: unknown option for findunits: %1%") % key << std::endl;
+        // if it's not a table, it should be an integer
+        query.player_nos.push_back(luabind::object_cast<int>(value));
       }
+    } else if (key == "unit_type") {
+      query.template_name = luabind::object_cast<std::string>(*it);
+    } else if (key == "state") {
+      query.state = luabind::object_cast<std::string>(*it);
+    } else {
+      fw::debug << boost::format("WARN: unknown option for findunits: %1%") % key << std::endl;
     }
+  }
 
-    // set up some defaults if they didn't get set already...
-    if (_player_nos.size() == 0) {
-      _player_nos.push_back(plyr->get_player_no());
-    }
+  // set up some defaults if they didn't get set already...
+  if (query.player_nos.size() == 0) {
+    query.player_nos.push_back(get_player_no());
   }
+}
 
-  inline bool operator()(std::shared_ptr<ent::entity> const &ent) {
-    // if it's not ownable, we don't care about it...
-    ent::ownable_component *ownable = ent->get_component<ent::ownable_component>();
-    if (ownable == nullptr)
-      return false;
-
-    // check that it's one of the players we've asked for
-    bool wrong_player = true;
-    BOOST_FOREACH(uint8_t player_no, _player_nos) {
-      if (player_no == ownable->get_owner()->get_player_no()) {
-        wrong_player = false;
-        break;
-      }
-    }
-    if (wrong_player) {
-      return false;
-    }
+luabind::object ai_player::find_units(ent::entity_query const &query, lua_State *L) {
+  luabind::object units = luabind::newtable(L);
 
-    // if we're looking for a specific unit_type, check the entity's name
-    if (_unit_type != "") {
-      if (_unit_type != ent->get_name()) {
-        return false;
-      }
-    }
+  std::vector<std::weak_ptr<ent::entity>> entities;
+  ent::entity_manager *entmgr = game::world::get_instance()->get_entity_manager();
+  entmgr->find_entities(query, entities);
 
-    // if we're looking for entities in a particular state, then check that
-    if (_state != "") {
-      ent::orderable_component *orderable = ent->get_component<ent::orderable_component>();
-      if (orderable == nullptr) {
-        return false;
-      }
-      std::shared_ptr<game::order> curr_order = orderable->get_current_order();
-      if (curr_order && curr_order->get_state_name() != _state) {
-        return false;
-      } else if (!curr_order && _state != "idle") {
-        return false;
-      }
+  int index = 1;
+  BOOST_FOREACH(std::weak_ptr<ent::entity> &wp, entities) {
+    luabind::object wrapper = get_unit_wrapper(wp);
+    if (!wrapper) {
+      continue;
     }
-
-    return true;
+    units[index++] = wrapper;
   }
-};
+
+  return units;
+}
 
 // this is the "workhorse" of the AI function. it searches for all
 // of the units which match the parameters given (note: because of the
 // luabind::adopt policy, LUA takes ownership of the object we return)
 luabind::object ai_player::l_find_units(luabind::object params, lua_State *L) {
-  luabind::object units = luabind::newtable(L);
-
   // if you pass something that's not a table as the first parameter,
   // we can't do anything so we just return an empty set.
   if (luabind::type(params) != LUA_TTABLE) {
-    return units;
+    return luabind::newtable(L);
   }
 
-  // create the predicate object that does the actual searching
-  findunits_predicate pred(this, params);
+  ent::entity_query query;
+  parse_query(params, query);
+  return find_units(query, L);
+}
 
-  // do the actual search
-  ent::entity_manager *entmgr = game::world::get_instance()->get_entity_manager();
-  std::list<std::weak_ptr<ent::entity>> entities = entmgr->get_entities(pred);
+// like find_units, but takes a table of queries and returns a table with the results of each query under the same
+// key, so that a script can do all of the searches it needs for one tick with a single call.
+luabind::object ai_player::l_find_units_batch(luabind::object queries, lua_State *L) {
+  luabind::object results = luabind::newtable(L);
+  if (luabind::type(queries) != LUA_TTABLE) {
+    return results;
+  }
 
-  int index = 1;
-  BOOST_FOREACH(std::weak_ptr<ent::entity> &wp, entities) {
-    luabind::object wrapper = get_unit_wrapper(wp);
-    if (!wrapper) {
+  luabind::iterator end;
+  for(luabind::iterator it(queries); it != end; ++it) {
+    luabind::object params = *it;
+    if (luabind::type(params) != LUA_TTABLE) {
+      results[it.key()] = luabind::newtable(L);
       continue;
     }
-    units[index++] = wrapper;
+
+    ent::entity_query query;
+    parse_query(params, query);
+    results[it.key()] = find_units(query, L);
   }
 
-  // and return the object
-  return units;
+  return results;
 }
 
 // issues the given orders to the given units. We assime that units is an array
@@ -312,15 +291,14 @@ luabind::object ai_player::get_unit_wrapper(std::weak_ptr<ent::entity> wp) {
     return luabind::object();
   }
 
-  ent::entity_attribute *attr = ent->get_attribute("ai_wrapper");
-  if (attr == nullptr) {
+  unit_wrapper_map::iterator it = _unit_wrappers.find(wp);
+  if (it == _unit_wrappers.end()) {
     luabind::object wrapper = create_unit_wrapper(ent->get_name());
     luabind::object_cast<unit_wrapper *>(wrapper)->set_entity(wp);
-    ent->add_attribute(ent::entity_attribute("ai_wrapper", wrapper));
-    attr = ent->get_attribute("ai_wrapper");
+    it = _unit_wrappers.insert(std::make_pair(wp, wrapper)).first;
   }
 
-  return attr->get_value<luabind::object>();
+  return it->second;
 }
 
 luabind::object ai_player::create_unit_wrapper(std::string const &entity_name) {
@@ -336,6 +314,18 @@ luabind::object ai_player::create_unit_wrapper(std::string const &entity_name) {
 
 void ai_player::update() {
   _upd_queue.update();
+
+  // every now and then, clean out the wrappers for entities that have been destroyed
+  if (++_updates_since_prune >= 100) {
+    _updates_since_prune = 0;
+    for (unit_wrapper_map::iterator it = _unit_wrappers.begin(); it != _unit_wrappers.end(); ) {
+      if (it->first.expired()) {
+        it = _unit_wrappers.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
 }
 
 // this is called when our local player is ready to start the game
@@ -364,7 +354,7 @@ void ai_player::world_loaded() {
 }
 
 // This is called each simulation frame when we get all the commands from other players
-void ai_player::post_commands(std::vector<std::shared_ptr<command>> &) {
+void ai_player::post_commands(std::vector<std::shared_ptr<command>> &, uint32_t) {
 }
 
 }
@@ -1,8 +1,11 @@
 #include <functional>
 #include <thread>
+#include <boost/foreach.hpp>
 
 #include <framework/logging.h>
-#include <framework/path_find.h>
+#include <framework/hierarchical_path_find.h>
+#include <framework/misc.h>
+#include <framework/settings.h>
 
 #include <game/ai/pathing_thread.h>
 #include <game/world/world.h>
@@ -10,59 +13,288 @@
 
 namespace game {
 
-// "no" flags, the default
-int FLAG_NONE = 0;
+// the most worker threads we'll start when "pathing-threads" is left at the default
+static const int MAX_DEFAULT_WORKERS = 4;
 
-// if set, this means out stop() method has been called and the worker thread is to stop
-int FLAG_STOP = 1;
-
-pathing_thread::pathing_thread() : _terrain(nullptr) {
+pathing_thread::pathing_thread() :
+    _terrain(nullptr), _stopping(false), _batching(false), _cache_capacity(0),
+    _average_path_search_time(0.0f) {
+  for (int i = 0; i < num_priorities; i++) {
+    _lanes[i].last_player_no = -1;
+  }
+  _stats.queue_depth = 0;
+  _stats.num_requests = 0;
+  _stats.last_wait_time = 0.0f;
+  _stats.last_search_time = 0.0f;
+  _stats.average_latency = 0.0f;
+  _stats.cache_hits = 0;
+  _stats.cache_misses = 0;
+  _stats.cache_time_saved = 0.0f;
 }
 
 void pathing_thread::start() {
-  // initialize the pather with the current world's map
   _terrain = game::world::get_instance()->get_terrain();
-  std::shared_ptr<fw::path_find> pf(
-      new fw::path_find(_terrain->get_width(), _terrain->get_length(), _terrain->get_collision_data()));
-  _pather = pf;
 
-  // start the thread that will simply wait for jobs to arrive and
-  // then process them in order.
-  _thread = std::thread(std::bind(&pathing_thread::thread_proc, this));
+  fw::settings stg;
+  int num_workers = stg.get_value<int>("pathing-threads");
+  if (num_workers <= 0) {
+    // leave one core for the main thread and one for the simulation thread
+    num_workers = fw::clamp(static_cast<int>(std::thread::hardware_concurrency()) - 2, MAX_DEFAULT_WORKERS, 1);
+  }
+  fw::debug << "pathing_thread: starting " << num_workers << " worker(s)" << std::endl;
+
+  _cache_capacity = stg.get_value<int>("pathing-cache-size");
+
+  // start the threads that will simply wait for jobs to arrive and then process them.
+  for (int i = 0; i < num_workers; i++) {
+    _threads.push_back(std::thread(std::bind(&pathing_thread::thread_proc, this, i)));
+  }
 }
 
 void pathing_thread::stop() {
-  // add an item to the queue to shutdown...
-  path_request_data request;
-  request.flags = FLAG_STOP;
-  _work_queue.enqueue(request);
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _condition.notify_all();
+
+  BOOST_FOREACH(std::thread &thread, _threads) {
+    thread.join();
+  }
+  _threads.clear();
 }
 
 void pathing_thread::request_path(fw::vector const &start, fw::vector const &goal, callback_fn on_path_found) {
+  request_path(0, priority_normal, start, goal, on_path_found);
+}
+
+void pathing_thread::request_path(int player_no, priority prio, fw::vector const &start, fw::vector const &goal,
+    callback_fn on_path_found) {
+  path_request_data request;
+  request.player_no = player_no;
+  request.prio = prio;
+  request.starts.push_back(start);
+  request.callbacks.push_back(on_path_found);
+  request.goal = goal;
+  enqueue(request);
+}
+
+void pathing_thread::request_group_path(int player_no, priority prio, std::vector<fw::vector> const &starts,
+    fw::vector const &goal, std::vector<callback_fn> const &on_paths_found) {
   path_request_data request;
-  request.flags = 0;
-  request.start = start;
+  request.player_no = player_no;
+  request.prio = prio;
+  request.starts = starts;
+  request.callbacks = on_paths_found;
   request.goal = goal;
-  request.callback = on_path_found;
-  _work_queue.enqueue(request);
+  enqueue(request);
 }
 
-void pathing_thread::thread_proc() {
+void pathing_thread::begin_batch() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _batching = true;
+}
+
+void pathing_thread::end_batch() {
+  std::vector<path_request_data> batch;
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _batching = false;
+    batch.swap(_batch);
+  }
+
+  BOOST_FOREACH(path_request_data &request, batch) {
+    enqueue(request);
+  }
+}
+
+void pathing_thread::enqueue(path_request_data &request) {
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_batching) {
+      // if there's already a request from this player to the same goal cell, just add ourselves to it
+      int goal_x = static_cast<int>(request.goal[0]);
+      int goal_z = static_cast<int>(request.goal[2]);
+      BOOST_FOREACH(path_request_data &existing, _batch) {
+        if (existing.player_no == request.player_no && existing.prio == request.prio
+            && static_cast<int>(existing.goal[0]) == goal_x && static_cast<int>(existing.goal[2]) == goal_z) {
+          existing.starts.insert(existing.starts.end(), request.starts.begin(), request.starts.end());
+          existing.callbacks.insert(existing.callbacks.end(), request.callbacks.begin(), request.callbacks.end());
+          return;
+        }
+      }
+      _batch.push_back(request);
+      return;
+    }
+
+    request.enqueue_time = fw::chrono_clock::now();
+    _stats.queue_depth++;
+    _lanes[request.prio].player_queues[request.player_no].push_back(request);
+  }
+  _condition.notify_one();
+}
+
+pathing_thread::stats pathing_thread::get_stats() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _stats;
+}
+
+// Waits for a request to become available and removes it from the queue. Returns false if we've been stopped.
+bool pathing_thread::dequeue(path_request_data &request) {
+  std::unique_lock<std::mutex> lock(_mutex);
   for (;;) {
-    path_request_data request = _work_queue.dequeue();
-    if (request.flags == FLAG_STOP) {
-      fw::debug << "pathing_thread::stop() has been called, thread_proc stopping." << std::endl;
+    if (_stopping) {
+      return false;
+    }
+
+    // the high priority lane always goes first
+    for (int prio = num_priorities - 1; prio >= 0; prio--) {
+      lane &l = _lanes[prio];
+      if (l.player_queues.empty()) {
+        continue;
+      }
+
+      // pick the next player after the one we served last time, wrapping around to the first
+      auto it = l.player_queues.upper_bound(l.last_player_no);
+      if (it == l.player_queues.end()) {
+        it = l.player_queues.begin();
+      }
+
+      request = it->second.front();
+      it->second.pop_front();
+      l.last_player_no = it->first;
+      if (it->second.empty()) {
+        l.player_queues.erase(it);
+      }
+
+      _stats.queue_depth--;
+      return true;
+    }
+
+    _condition.wait(lock);
+  }
+}
+
+uint64_t pathing_thread::get_cache_key(fw::vector const &start, fw::vector const &goal) {
+  uint64_t start_x = static_cast<uint16_t>(static_cast<int>(start[0]));
+  uint64_t start_z = static_cast<uint16_t>(static_cast<int>(start[2]));
+  uint64_t goal_x = static_cast<uint16_t>(static_cast<int>(goal[0]));
+  uint64_t goal_z = static_cast<uint16_t>(static_cast<int>(goal[2]));
+  return (start_x << 48) | (start_z << 32) | (goal_x << 16) | goal_z;
+}
+
+bool pathing_thread::cache_lookup(uint64_t key, std::vector<fw::vector> &path) {
+  std::unique_lock<std::mutex> lock(_cache_mutex);
+  auto it = _cache_index.find(key);
+  if (it == _cache_index.end()) {
+    return false;
+  }
+
+  // move it to the front, since it's now the most recently used
+  _cache.splice(_cache.begin(), _cache, it->second);
+  path = _cache.front().path;
+  return true;
+}
+
+void pathing_thread::cache_store(uint64_t key, std::vector<fw::vector> const &path) {
+  if (_cache_capacity <= 0) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(_cache_mutex);
+  auto it = _cache_index.find(key);
+  if (it != _cache_index.end()) {
+    _cache.erase(it->second);
+    _cache_index.erase(it);
+  }
+
+  cache_entry entry;
+  entry.key = key;
+  entry.path = path;
+  _cache.push_front(entry);
+  _cache_index[key] = _cache.begin();
+
+  while (static_cast<int>(_cache.size()) > _cache_capacity) {
+    _cache_index.erase(_cache.back().key);
+    _cache.pop_back();
+  }
+}
+
+void pathing_thread::thread_proc(int worker_no) {
+  // each worker has its own path_find, because find() modifies the node state as it goes.
+  std::shared_ptr<fw::path_find> pather(
+      new fw::hierarchical_path_find(_terrain->get_width(), _terrain->get_length(), _terrain->get_collision_data()));
+
+  for (;;) {
+    path_request_data request;
+    if (!dequeue(request)) {
+      fw::debug << "pathing_thread::stop() has been called, worker " << worker_no << " stopping." << std::endl;
       return;
     }
 
-    std::vector<fw::vector> path;
-    _pather->find(path, request.start, request.goal);
+    fw::chrono_clock::time_point start_time = fw::chrono_clock::now();
+    int num_starts = static_cast<int>(request.starts.size());
 
-    std::vector<fw::vector> simplified;
-    _pather->simplify_path(path, simplified);
+    // first, check the cache for each start. Whatever's left over needs a search.
+    std::vector<std::vector<fw::vector>> simplified(num_starts);
+    std::vector<uint64_t> keys(num_starts);
+    std::vector<int> misses;
+    for (int i = 0; i < num_starts; i++) {
+      keys[i] = get_cache_key(request.starts[i], request.goal);
+      if (!cache_lookup(keys[i], simplified[i])) {
+        misses.push_back(i);
+      }
+    }
+
+    std::vector<std::vector<fw::vector>> paths(misses.size());
+    if (misses.size() == 1) {
+      pather->find(paths[0], request.starts[misses[0]], request.goal);
+    } else if (misses.size() > 1) {
+      // a group request, we do one search for the whole group. Anybody who couldn't be reached from the goal (e.g.
+      // because they're standing on an impassable cell) gets a search of their own.
+      std::vector<fw::vector> starts;
+      BOOST_FOREACH(int i, misses) {
+        starts.push_back(request.starts[i]);
+      }
+      pather->find_group(paths, starts, request.goal);
+      for (int i = 0; i < static_cast<int>(paths.size()); i++) {
+        if (paths[i].empty()) {
+          pather->find(paths[i], starts[i], request.goal);
+        }
+      }
+    }
+
+    for (int i = 0; i < static_cast<int>(misses.size()); i++) {
+      pather->simplify_path(paths[i], simplified[misses[i]]);
+      cache_store(keys[misses[i]], simplified[misses[i]]);
+    }
+    fw::chrono_clock::time_point end_time = fw::chrono_clock::now();
+
+    typedef std::chrono::duration<float> float_seconds;
+    float wait_time = std::chrono::duration_cast<float_seconds>(start_time - request.enqueue_time).count();
+    float search_time = std::chrono::duration_cast<float_seconds>(end_time - start_time).count();
+    int num_hits = num_starts - static_cast<int>(misses.size());
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _stats.num_requests++;
+      _stats.last_wait_time = wait_time;
+      _stats.last_search_time = search_time;
+      _stats.average_latency = (_stats.average_latency * 0.9f) + ((wait_time + search_time) * 0.1f);
+
+      // we estimate how much time each hit saved us from the average time it takes to find one path
+      if (!misses.empty()) {
+        float per_path = search_time / misses.size();
+        _average_path_search_time = (_average_path_search_time * 0.9f) + (per_path * 0.1f);
+      }
+      _stats.cache_hits += num_hits;
+      _stats.cache_misses += misses.size();
+      _stats.cache_time_saved += num_hits * _average_path_search_time;
+    }
 
-    if (request.callback) {
-      request.callback(simplified);
+    for (int i = 0; i < static_cast<int>(request.callbacks.size()); i++) {
+      if (request.callbacks[i]) {
+        request.callbacks[i](simplified[i]);
+      }
     }
   }
 }
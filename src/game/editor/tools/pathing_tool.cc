@@ -12,12 +12,15 @@
 #include <framework/gui/widget.h>
 #include <framework/gui/window.h>
 #include <framework/input.h>
+#include <framework/logging.h>
 #include <framework/model.h>
 #include <framework/model_manager.h>
 #include <framework/scenegraph.h>
 #include <framework/shader.h>
 #include <framework/paths.h>
 #include <framework/path_find.h>
+#include <framework/hierarchical_path_find.h>
+#include <framework/timer.h>
 
 #include <game/editor/tools/pathing_tool.h>
 #include <game/editor/windows/main_menu.h>
@@ -45,6 +48,9 @@ private:
   bool on_start_click(widget *w);
   bool on_end_click(widget *w);
   bool on_simplify_click(widget *w);
+  bool on_hierarchical_click(widget *w);
+  bool on_jps_click(widget *w);
+  bool on_compare_click(widget *w);
 
 public:
   pathing_tool_window(ed::pathing_tool *tool);
@@ -56,13 +62,19 @@ public:
 
 pathing_tool_window::pathing_tool_window(ed::pathing_tool *tool) :
     _tool(tool), _wnd(nullptr) {
-  _wnd = builder<window>(px(10), px(30), px(100), px(94)) << window::background("frame")
+  _wnd = builder<window>(px(10), px(30), px(100), px(172)) << window::background("frame")
       << (builder<button>(px(4), px(4), sum(pct(100), px(-8)), px(30)) << button::text("Start") << widget::id(START_ID)
           << widget::click(std::bind(&pathing_tool_window::on_start_click, this, _1)))
       << (builder<button>(px(4), px(38), sum(pct(100), px(-8)), px(30)) << button::text("End") << widget::id(END_ID)
           << widget::click(std::bind(&pathing_tool_window::on_end_click, this, _1)))
       << (builder<checkbox>(px(4), px(72), sum(pct(100), px(-8)), px(18)) << checkbox::text("Simplify")
-          << widget::click(std::bind(&pathing_tool_window::on_simplify_click, this, _1)));
+          << widget::click(std::bind(&pathing_tool_window::on_simplify_click, this, _1)))
+      << (builder<checkbox>(px(4), px(94), sum(pct(100), px(-8)), px(18)) << checkbox::text("Hierarchical")
+          << widget::click(std::bind(&pathing_tool_window::on_hierarchical_click, this, _1)))
+      << (builder<checkbox>(px(4), px(116), sum(pct(100), px(-8)), px(18)) << checkbox::text("JPS")
+          << widget::click(std::bind(&pathing_tool_window::on_jps_click, this, _1)))
+      << (builder<button>(px(4), px(138), sum(pct(100), px(-8)), px(30)) << button::text("Compare")
+          << widget::click(std::bind(&pathing_tool_window::on_compare_click, this, _1)));
   fw::framework::get_instance()->get_gui()->attach_widget(_wnd);
 }
 
@@ -99,6 +111,21 @@ bool pathing_tool_window::on_simplify_click(widget *w) {
   return true;
 }
 
+bool pathing_tool_window::on_hierarchical_click(widget *w) {
+  _tool->set_hierarchical(dynamic_cast<checkbox *>(w)->is_checked());
+  return true;
+}
+
+bool pathing_tool_window::on_jps_click(widget *w) {
+  _tool->set_jps(dynamic_cast<checkbox *>(w)->is_checked());
+  return true;
+}
+
+bool pathing_tool_window::on_compare_click(widget *w) {
+  _tool->compare_searches();
+  return true;
+}
+
 //-----------------------------------------------------------------------------
 
 class collision_patch {
@@ -167,7 +194,8 @@ namespace ed {
 REGISTER_TOOL("pathing", pathing_tool);
 
 pathing_tool::pathing_tool(editor_world *wrld) :
-    tool(wrld), _start_set(false), _end_set(false), _test_mode(test_none), _simplify(true) {
+    tool(wrld), _start_set(false), _end_set(false), _test_mode(test_none), _simplify(true),
+    _hierarchical(false) {
   _wnd = new pathing_tool_window(this);
   _marker = fw::framework::get_instance()->get_model_manager()->get_model("marker");
 }
@@ -182,15 +210,37 @@ void pathing_tool::activate() {
 
   int width = get_terrain()->get_width();
   int length = get_terrain()->get_length();
-  _collision_data.resize(width * length);
-  get_terrain()->build_collision_data(_collision_data);
+  std::vector<bool> collision_data(width * length);
+  get_terrain()->build_collision_data(collision_data);
+
+  if (_path_find && collision_data.size() == _collision_data.size()) {
+    // the terrain may have been edited since we were last active, so just update the cells that have changed. The
+    // hierarchical path_find will only rebuild the sectors those cells touch.
+    bool changed = false;
+    for (int z = 0; z < length; z++) {
+      for (int x = 0; x < width; x++) {
+        bool passable = collision_data[(z * width) + x];
+        if (passable != _collision_data[(z * width) + x]) {
+          _path_find->set_passable(x, z, passable);
+          _hierarchical_path_find->set_passable(x, z, passable);
+          changed = true;
+        }
+      }
+    }
+    _collision_data = collision_data;
+    if (changed) {
+      _patches.clear();
+    }
+  } else {
+    _collision_data = collision_data;
+    std::shared_ptr<fw::timed_path_find> pf(new fw::timed_path_find(width, length, _collision_data));
+    _path_find = pf;
+    std::shared_ptr<fw::hierarchical_path_find> hpf(new fw::hierarchical_path_find(width, length, _collision_data));
+    _hierarchical_path_find = hpf;
+  }
 
   _patches.resize((width / PATCH_SIZE) * (length / PATCH_SIZE));
 
-  std::shared_ptr<fw::timed_path_find> pf(
-      new fw::timed_path_find(get_terrain()->get_width(), get_terrain()->get_length(), _collision_data));
-  _path_find = pf;
-
   fw::input *inp = fw::framework::get_instance()->get_input();
   _keybind_tokens.push_back(
       inp->bind_key("Left-Mouse", fw::input_binding(std::bind(&pathing_tool::on_key, this, _1, _2))));
@@ -281,6 +331,16 @@ void pathing_tool::set_simplify(bool value) {
   find_path();
 }
 
+void pathing_tool::set_jps(bool value) {
+  _path_find->set_search_mode(value ? fw::path_find::search_jps : fw::path_find::search_astar);
+  find_path();
+}
+
+void pathing_tool::set_hierarchical(bool value) {
+  _hierarchical = value;
+  find_path();
+}
+
 void pathing_tool::set_test_start() {
   _test_mode = test_start;
 }
@@ -311,18 +371,77 @@ void pathing_tool::on_key(std::string keyname, bool is_down) {
   }
 }
 
+void pathing_tool::compare_searches() {
+  if (!_start_set || !_end_set) {
+    statusbar->set_message("Set a start and end first.");
+    return;
+  }
+
+  // run the same search a few times with each kind of search (A* with each kind of open set, then JPS) so that we
+  // can see how they compare on this map. We also compare the length of the paths they find, since they should all
+  // come up with paths of about the same length.
+  static const int num_searches = 3;
+  static const int num_runs = 10;
+  fw::path_find::open_set_kind kinds[num_searches] = {
+      fw::path_find::open_set_heap, fw::path_find::open_set_multiset, fw::path_find::open_set_heap};
+  fw::path_find::search_mode modes[num_searches] = {
+      fw::path_find::search_astar, fw::path_find::search_astar, fw::path_find::search_jps};
+  float times[num_searches];
+  float lengths[num_searches];
+  fw::path_find::search_mode old_mode = _path_find->get_search_mode();
+  for (int i = 0; i < num_searches; i++) {
+    _path_find->set_open_set_kind(kinds[i]);
+    _path_find->set_search_mode(modes[i]);
+    times[i] = 0.0f;
+    lengths[i] = 0.0f;
+    for (int run = 0; run < num_runs; run++) {
+      std::vector<fw::vector> full_path;
+      _path_find->find(full_path, _start_pos, _end_pos);
+      times[i] += _path_find->total_time;
+      if (run == 0) {
+        for (int j = 1; j < static_cast<int>(full_path.size()); j++) {
+          lengths[i] += (full_path[j] - full_path[j - 1]).length();
+        }
+      }
+    }
+    times[i] /= num_runs;
+  }
+  _path_find->set_open_set_kind(fw::path_find::open_set_heap);
+  _path_find->set_search_mode(old_mode);
+
+  std::string msg = (boost::format(
+      "heap: %1$.2fms (length %2$.1f), multiset: %3$.2fms (length %4$.1f), JPS: %5$.2fms (length %6$.1f)")
+      % (times[0] * 1000.0f) % lengths[0] % (times[1] * 1000.0f) % lengths[1]
+      % (times[2] * 1000.0f) % lengths[2]).str();
+  fw::debug << "pathing_tool: " << msg << std::endl;
+  statusbar->set_message(msg);
+}
+
 void pathing_tool::find_path() {
   if (!_start_set || !_end_set)
     return;
 
   std::vector<fw::vector> full_path;
-  if (!_path_find->find(full_path, _start_pos, _end_pos)) {
-    statusbar->set_message((boost::format("No path found after %1%ms") % (_path_find->total_time * 1000.0f)).str());
+  bool found;
+  float total_time;
+  if (_hierarchical) {
+    fw::timer tmr;
+    tmr.start();
+    found = _hierarchical_path_find->find(full_path, _start_pos, _end_pos);
+    tmr.stop();
+    total_time = tmr.get_total_time();
+  } else {
+    found = _path_find->find(full_path, _start_pos, _end_pos);
+    total_time = _path_find->total_time;
+  }
+
+  if (!found) {
+    statusbar->set_message((boost::format("No path found after %1%ms") % (total_time * 1000.0f)).str());
   } else {
     std::vector<fw::vector> path;
     _path_find->simplify_path(full_path, path);
     statusbar->set_message((boost::format("Path found in %1%ms, %2% nodes, %3% nodes (simplified)")
-        % (_path_find->total_time * 1000.0f)
+        % (total_time * 1000.0f)
         % full_path.size()
         % path.size()).str());
 
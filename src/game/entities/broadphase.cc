@@ -0,0 +1,133 @@
+#include <boost/foreach.hpp>
+
+#include <framework/misc.h>
+
+#include <game/entities/broadphase.h>
+#include <game/entities/entity.h>
+#include <game/entities/entity_manager.h>
+#include <game/entities/damageable_component.h>
+#include <game/entities/position_component.h>
+#include <game/entities/projectile_component.h>
+#include <game/entities/selectable_component.h>
+
+namespace ent {
+
+broadphase::broadphase() :
+    _num_pairs(0), _num_projectiles(0) {
+}
+
+void broadphase::update(entity_manager *entity_mgr, patch_manager *patch_mgr) {
+  _num_pairs = 0;
+  _num_projectiles = 0;
+
+  find_neighbours(patch_mgr);
+  sweep_projectiles(entity_mgr, patch_mgr);
+}
+
+void broadphase::find_neighbours(patch_manager *patch_mgr) {
+  float max_dist_sq = static_cast<float>(NEIGHBOUR_DISTANCE * NEIGHBOUR_DISTANCE);
+  BOOST_FOREACH(std::vector<position_component *> &cell, patch_mgr->_cells) {
+    BOOST_FOREACH(position_component *pos, cell) {
+      pos->_nearest_neighbour = nullptr;
+      pos->_nearest_neighbour_dist_sq = max_dist_sq;
+    }
+  }
+
+  // we visit each pair of cells that are close enough to each other only once, by only looking at the cells "after"
+  // each cell (the rest of its row, and the rows below it).
+  int range = NEIGHBOUR_DISTANCE / patch_manager::CELL_SIZE;
+  for (int cell_z = 0; cell_z < patch_mgr->_cells_long; cell_z++) {
+    for (int cell_x = 0; cell_x < patch_mgr->_cells_wide; cell_x++) {
+      std::vector<position_component *> &cell = patch_mgr->_cells[patch_mgr->get_cell_index(cell_x, cell_z)];
+      if (cell.empty()) {
+        continue;
+      }
+
+      for (int z = 0; z <= range; z++) {
+        for (int x = -range; x <= range; x++) {
+          if (z == 0 && x < 0) {
+            continue;
+          }
+
+          bool same_cell = (x == 0 && z == 0);
+          std::vector<position_component *> &other_cell =
+              patch_mgr->_cells[patch_mgr->get_cell_index(cell_x + x, cell_z + z)];
+          for (size_t i = 0; i < cell.size(); i++) {
+            position_component *a = cell[i];
+            for (size_t j = same_cell ? i + 1 : 0; j < other_cell.size(); j++) {
+              position_component *b = other_cell[j];
+              _num_pairs++;
+
+              fw::vector dir = patch_mgr->get_direction(a->_pos, b->_pos);
+              float dist_sq = dir[0] * dir[0] + dir[2] * dir[2];
+              if (dist_sq < a->_nearest_neighbour_dist_sq) {
+                a->_nearest_neighbour = b;
+                a->_nearest_neighbour_dist_sq = dist_sq;
+              }
+              if (dist_sq < b->_nearest_neighbour_dist_sq) {
+                b->_nearest_neighbour = a;
+                b->_nearest_neighbour_dist_sq = dist_sq;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+void broadphase::sweep_projectiles(entity_manager *entity_mgr, patch_manager *patch_mgr) {
+  BOOST_FOREACH(std::weak_ptr<entity> &wp, entity_mgr->get_entities_by_component<projectile_component>()) {
+    std::shared_ptr<entity> ent = wp.lock();
+    if (!ent) {
+      continue;
+    }
+    projectile_component *projectile = ent->get_component<projectile_component>();
+    position_component *our_pos = ent->get_component<position_component>();
+    if (projectile == nullptr || our_pos == nullptr) {
+      continue;
+    }
+    _num_projectiles++;
+
+    // we sweep from where we were at the last update to where we are now (the first time, that's just a point)
+    fw::vector end = our_pos->_pos;
+    fw::vector start = projectile->_has_last_position ? projectile->_last_position : end;
+    projectile->_last_position = end;
+    projectile->_has_last_position = true;
+
+    fw::vector path = patch_mgr->get_direction(start, end);
+    float length = path.length();
+    fw::vector dir = (length > 0.0f) ? path / length : fw::vector(0, 0, 0);
+
+    std::shared_ptr<entity> creator = ent->get_creator().lock();
+    std::shared_ptr<entity> hit;
+    float hit_along = length;
+    patch_mgr->for_each_near_ray(start, dir, length, [&](position_component *pos, fw::vector const &pos_unwrapped) {
+      if (pos == our_pos) {
+        return;
+      }
+      std::shared_ptr<entity> other = pos->get_entity().lock();
+      if (!other || other == creator || !other->contains_component<damageable_component>()) {
+        return;
+      }
+
+      float hit_distance = 0.5f;
+      selectable_component *selectable = other->get_component<selectable_component>();
+      if (selectable != nullptr) {
+        hit_distance = selectable->get_selection_radius();
+      }
+
+      // find the point along our path that's closest to them, and check whether it's close enough to hit
+      float along = fw::clamp(cml::dot(pos_unwrapped - start, dir), length, 0.0f);
+      fw::vector closest = start + dir * along;
+      if ((pos_unwrapped - closest).length_squared() < hit_distance * hit_distance && (!hit || along < hit_along)) {
+        hit = other;
+        hit_along = along;
+      }
+    });
+
+    projectile->_hit = hit;
+  }
+}
+
+}
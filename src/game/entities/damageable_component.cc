@@ -1,3 +1,4 @@
+#include <cmath>
 #include <functional>
 #include <boost/foreach.hpp>
 
@@ -17,7 +18,8 @@ using namespace std::placeholders;
 // register the damageable component with the entity_factory
 ENT_COMPONENT_REGISTER("Damageable", damageable_component);
 
-damageable_component::damageable_component() {
+damageable_component::damageable_component() :
+    _state_hash(0) {
 }
 
 damageable_component::~damageable_component() {
@@ -36,9 +38,16 @@ void damageable_component::initialize() {
   entity_attribute *health = entity->get_attribute("health");
   if (health != nullptr) {
     health->sig_value_changed.connect(std::bind(&damageable_component::check_explode, this, _2));
+    update_state_hash(health->get_value<float>());
   }
 }
 
+void damageable_component::update_state_hash(float health) {
+  std::shared_ptr<entity> entity(_entity);
+  int64_t quantized = static_cast<int64_t>(std::floor(health * 16.0f + 0.5f));
+  entity->update_state_hash(_state_hash, hash_state(identifier, quantized));
+}
+
 void damageable_component::apply_damage(float amt) {
   std::shared_ptr<entity> entity(_entity);
   entity_attribute *attr = entity->get_attribute("health");
@@ -53,7 +62,9 @@ void damageable_component::apply_damage(float amt) {
 // this is called whenever our health attribute changes value. we check whether it's
 // hit 0, and explode if it has
 void damageable_component::check_explode(boost::any health_value) {
-  if (boost::any_cast<float>(health_value) <= 0) {
+  float health = boost::any_cast<float>(health_value);
+  update_state_hash(health);
+  if (health <= 0) {
     explode();
   }
 }
@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
 
 #include <framework/framework.h>
 #include <framework/graphics.h>
@@ -11,42 +13,82 @@
 #include <game/entities/entity.h>
 #include <game/entities/entity_debug.h>
 #include <game/entities/entity_factory.h>
+#include <game/entities/entity_manager.h>
 #include <game/entities/position_component.h>
 #include <game/entities/moveable_component.h>
 
 namespace ent {
 
+fw::memory_pool *get_entity_pool() {
+  // this is never deleted, since entities could outlive any static object we might delete it in
+  static fw::memory_pool *pool = new fw::memory_pool();
+  return pool;
+}
+
 entity::entity(entity_manager *mgr, entity_id id) :
-    _mgr(mgr), _debug_view(0), _debug_flags(static_cast<entity_debug_flags>(0)), _id(id),
-    _create_time(0) {
+    _components(component_list::allocator_type(get_entity_pool())),
+    _attributes(std::less<std::string>(), attribute_map::allocator_type(get_entity_pool())),
+    _mgr(mgr), _debug_view(0), _debug_flags(static_cast<entity_debug_flags>(0)), _id(id), _index(0),
+    _state_hash(0), _base_state_hash(0), _in_state_hash(true), _create_time(0) {
+  std::fill(_component_table, _component_table + MAX_COMPONENT_SLOTS, nullptr);
 }
 
 entity::~entity() {
-  BOOST_FOREACH(auto &pair, _components) {
-    delete pair.second;
+  BOOST_FOREACH(entity_component *comp, _components) {
+    delete comp;
+  }
+}
+
+void *entity::operator new(std::size_t size) {
+  return get_entity_pool()->allocate(size);
+}
+
+void entity::operator delete(void *ptr, std::size_t size) {
+  get_entity_pool()->deallocate(ptr, size);
+}
+
+void entity::update_state_hash(uint64_t &part, uint64_t value) {
+  uint64_t delta = value - part;
+  part = value;
+  _state_hash += delta;
+  if (_in_state_hash) {
+    _mgr->add_to_state_hash(delta);
   }
 }
 
 void entity::add_component(entity_component *comp) {
+  int identifier = comp->get_identifier();
+  int slot = get_component_slot(identifier);
+  if (identifier % COMPONENT_IDENTIFIER_STEP != 0 || slot < 0 || slot >= MAX_COMPONENT_SLOTS) {
+    BOOST_THROW_EXCEPTION(fw::exception() << fw::message_error_info(
+        "invalid component identifier: " + boost::lexical_cast<std::string>(identifier)));
+  }
+
   // you can only have one component of each type
-  auto it = _components.find(comp->get_identifier());
-  if (it != _components.end())
+  if (_component_table[slot] != nullptr)
     BOOST_THROW_EXCEPTION(fw::exception() << fw::message_error_info("only one component of each type is allowed."));
 
-  _components[comp->get_identifier()] = comp;
+  _component_table[slot] = comp;
+  component_list::iterator it = std::upper_bound(_components.begin(), _components.end(), comp,
+      [](entity_component *lhs, entity_component *rhs) {
+        return lhs->get_identifier() < rhs->get_identifier();
+      });
+  _components.insert(it, comp);
 }
 
 entity_component *entity::get_component(int identifier) {
-  auto it = _components.find(identifier);
-  if (it == _components.end()) {
+  int slot = get_component_slot(identifier);
+  if (identifier % COMPONENT_IDENTIFIER_STEP != 0 || slot < 0 || slot >= MAX_COMPONENT_SLOTS) {
     return nullptr;
   }
 
-  return (*it).second;
+  return _component_table[slot];
 }
 
 bool entity::contains_component(int identifier) const {
-  return (_components.find(identifier) != _components.end());
+  int slot = get_component_slot(identifier);
+  return (identifier % COMPONENT_IDENTIFIER_STEP == 0 && slot >= 0 && slot < MAX_COMPONENT_SLOTS
+      && _component_table[slot] != nullptr);
 }
 
 void entity::add_attribute(entity_attribute const &attr) {
@@ -70,20 +112,20 @@ entity_attribute *entity::get_attribute(std::string const &name) {
 
 void entity::initialize() {
   _create_time = fw::framework::get_instance()->get_timer()->get_total_time();
-  BOOST_FOREACH(auto &pair, _components) {
-    pair.second->initialize();
+  BOOST_FOREACH(entity_component *comp, _components) {
+    comp->initialize();
   }
 }
 
 void entity::update(float dt) {
-  BOOST_FOREACH(auto &pair, _components) {
-    pair.second->update(dt);
+  BOOST_FOREACH(entity_component *comp, _components) {
+    comp->update(dt);
   }
 }
 
 void entity::render(fw::sg::scenegraph &scenegraph, fw::matrix const &transform) {
-  BOOST_FOREACH(auto &pair, _components) {
-    pair.second->render(scenegraph, transform);
+  BOOST_FOREACH(entity_component *comp, _components) {
+    comp->render(scenegraph, transform);
   }
 
   if (_debug_view != nullptr) {
@@ -128,6 +170,14 @@ entity_debug_view *entity::get_debug_view() {
 entity_component::entity_component() {
 }
 
+void *entity_component::operator new(std::size_t size) {
+  return get_entity_pool()->allocate(size);
+}
+
+void entity_component::operator delete(void *ptr, std::size_t size) {
+  get_entity_pool()->deallocate(ptr, size);
+}
+
 entity_component::~entity_component() {
 }
 
@@ -18,6 +18,8 @@
 #include <game/entities/entity_manager.h>
 #include <game/entities/position_component.h>
 #include <game/entities/moveable_component.h>
+#include <game/world/world.h>
+#include <game/ai/pathing_thread.h>
 
 using namespace std::placeholders;
 using namespace fw::gui;
@@ -28,6 +30,11 @@ enum ids {
   SHOW_STEERING_ID = 3642,
   POSITION_ID,
   GOAL_ID,
+  PATHING_ID,
+  PATHING_CACHE_ID,
+  ENTITIES_ID,
+  ALLOCATIONS_ID,
+  BROADPHASE_ID,
 };
 
 entity_debug::entity_debug(entity_manager *mgr) :
@@ -39,7 +46,7 @@ entity_debug::~entity_debug() {
 }
 
 void entity_debug::initialize() {
-  _wnd = builder<window>(px(10), px(10), px(200), px(106))
+  _wnd = builder<window>(px(10), px(10), px(200), px(256))
       << window::background("frame") << widget::visible(false)
       << (builder<checkbox>(px(10), px(10), sum(pct(100), px(-20)), px(26))
           << checkbox::text("Show steering") << widget::id(SHOW_STEERING_ID)
@@ -48,6 +55,16 @@ void entity_debug::initialize() {
           << label::text("Pos: ") << widget::id(POSITION_ID))
       << (builder<label>(px(10), px(76), sum(pct(100), px(-20)), px(20))
           << label::text("Goal: ") << widget::id(GOAL_ID))
+      << (builder<label>(px(10), px(106), sum(pct(100), px(-20)), px(20))
+          << label::text("Pathing: ") << widget::id(PATHING_ID))
+      << (builder<label>(px(10), px(136), sum(pct(100), px(-20)), px(20))
+          << label::text("Cache: ") << widget::id(PATHING_CACHE_ID))
+      << (builder<label>(px(10), px(166), sum(pct(100), px(-20)), px(20))
+          << label::text("Entities: ") << widget::id(ENTITIES_ID))
+      << (builder<label>(px(10), px(196), sum(pct(100), px(-20)), px(20))
+          << label::text("Allocs: ") << widget::id(ALLOCATIONS_ID))
+      << (builder<label>(px(10), px(226), sum(pct(100), px(-20)), px(20))
+          << label::text("Broadphase: ") << widget::id(BROADPHASE_ID))
       ;
   fw::framework::get_instance()->get_gui()->attach_widget(_wnd);
 
@@ -62,6 +79,27 @@ void entity_debug::update() {
   std::string new_pos_value;
   std::string new_goal_value;
 
+  _wnd->find<label>(ENTITIES_ID)->set_text((boost::format("Entities: %1%, %2$.2fms (%3% thr)")
+      % _mgr->get_entity_count() % (_mgr->get_update_time() * 1000.0f) % (_mgr->get_num_update_threads() + 1)).str());
+
+  // how many allocations we've made for entities, and how many of them actually had to go to the heap
+  fw::memory_pool *pool = get_entity_pool();
+  _wnd->find<label>(ALLOCATIONS_ID)->set_text((boost::format("Allocs: %1% (%2% heap), %3% live")
+      % pool->get_num_allocations() % pool->get_num_heap_allocations() % pool->get_num_live()).str());
+
+  broadphase const &bp = _mgr->get_broadphase();
+  _wnd->find<label>(BROADPHASE_ID)->set_text((boost::format("Broadphase: %1% pairs, %2% proj")
+      % bp.get_num_pairs() % bp.get_num_projectiles()).str());
+
+  game::pathing_thread *pathing = game::world::get_instance()->get_pathing();
+  if (pathing != nullptr) {
+    game::pathing_thread::stats stats = pathing->get_stats();
+    _wnd->find<label>(PATHING_ID)->set_text((boost::format("Pathing: %1% queued, %2$.1fms avg")
+        % stats.queue_depth % (stats.average_latency * 1000.0f)).str());
+    _wnd->find<label>(PATHING_CACHE_ID)->set_text((boost::format("Cache: %1%/%2% hits, %3$.0fms saved")
+        % stats.cache_hits % (stats.cache_hits + stats.cache_misses) % (stats.cache_time_saved * 1000.0f)).str());
+  }
+
   std::list<std::weak_ptr<entity> > selection = _mgr->get_selection();
   if (selection.size() > 0) {
     // we display some info about the selected entity (if there's more than one, we just use the first one from the
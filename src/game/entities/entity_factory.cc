@@ -13,9 +13,33 @@ namespace fs = boost::filesystem;
 
 namespace ent {
 
+// this is what we register for each component type, a function to create a new one and a function to copy an
+// existing one (the prototype)
+struct component_type {
+  std::function<entity_component *()> create_fn;
+  std::function<entity_component *(entity_component const *)> clone_fn;
+};
+
+/**
+ * An entity_prototype is compiled from an entity template when it's loaded. It contains the decoded attributes and
+ * a "prototype" of each component that's already had the template applied to it. Creating a new entity is then just a
+ * matter of copying the attributes and cloning each of the components, without touching Lua at all.
+ */
+struct entity_prototype {
+  struct component_prototype {
+    entity_component *prototype;
+    std::function<entity_component *(entity_component const *)> clone_fn;
+  };
+
+  std::vector<entity_attribute> attributes;
+  std::vector<component_prototype> components;
+};
+
 typedef std::map<std::string, fw::lua_context *> entity_template_map;
+typedef std::map<std::string, entity_prototype *> entity_prototype_map;
 static entity_template_map *entity_templates = nullptr;
-static std::map<std::string, std::function<entity_component *()>> *comp_registry = nullptr;
+static entity_prototype_map *entity_prototypes = nullptr;
+static std::map<std::string, component_type> *comp_registry = nullptr;
 
 entity_factory::entity_factory() {
   if (entity_templates == nullptr) {
@@ -27,14 +51,30 @@ entity_factory::~entity_factory() {
 }
 
 void entity_factory::populate(std::shared_ptr<entity> ent, std::string name) {
-  // first, find the template we'll use for creating the entity
-  luabind::object entity_template = get_template(name);
-  if (!entity_template) {
+  // first, find the prototype we'll use for creating the entity
+  entity_prototype_map::iterator it = entity_prototypes->find(name);
+  if (it == entity_prototypes->end()) {
     fw::debug << boost::format("  warning: unknown entity: %1%") % name << std::endl;
     return;
   }
+  entity_prototype *prototype = it->second;
 
   // add all of the attributes before we add any of the components
+  BOOST_FOREACH(entity_attribute const &attr, prototype->attributes) {
+    ent->add_attribute(attr);
+  }
+
+  // then add all of the components as well
+  BOOST_FOREACH(entity_prototype::component_prototype const &comp_prototype, prototype->components) {
+    entity_component *comp = comp_prototype.clone_fn(comp_prototype.prototype);
+    ent->add_component(comp);
+    comp->set_entity(ent);
+  }
+}
+
+entity_prototype *entity_factory::compile_template(luabind::object const &entity_template) {
+  entity_prototype *prototype = new entity_prototype();
+
   for (luabind::iterator it(entity_template), end; it != end; ++it) {
     if (it.key() == "components") {
       continue;
@@ -48,20 +88,24 @@ void entity_factory::populate(std::shared_ptr<entity> ent, std::string name) {
     } else {
       // table? maybe a vector?
     }
-    entity_attribute attr(luabind::object_cast<std::string>(it.key()), value);
-    ent->add_attribute(attr);
+    prototype->attributes.push_back(entity_attribute(luabind::object_cast<std::string>(it.key()), value));
   }
 
-  // then add all of the components as well
   for (luabind::iterator it(entity_template["components"]), end; it != end; ++it) {
     luabind::object comp_tmpl(*it);
-    entity_component *comp = create_component(luabind::object_cast<std::string>(it.key()));
+    std::string component_type_name = luabind::object_cast<std::string>(it.key());
+    entity_component *comp = create_component(component_type_name);
     if (comp != nullptr) {
       comp->apply_template(comp_tmpl);
-      ent->add_component(comp);
-      comp->set_entity(ent);
+
+      entity_prototype::component_prototype comp_prototype;
+      comp_prototype.prototype = comp;
+      comp_prototype.clone_fn = (*comp_registry)[component_type_name].clone_fn;
+      prototype->components.push_back(comp_prototype);
     }
   }
+
+  return prototype;
 }
 
 luabind::object entity_factory::get_template(std::string name) {
@@ -102,6 +146,7 @@ void entity_factory::get_buildable_templates(std::string const &build_group,
  // registers them in the entity_template_map
 void entity_factory::load_entities() {
   entity_templates = new entity_template_map();
+  entity_prototypes = new entity_prototype_map();
 
   fs::path base_path = fw::install_base_path() / "entities";
   fs::directory_iterator end_it;
@@ -115,29 +160,32 @@ void entity_factory::load_entities() {
       luabind::object tmpl = luabind::globals(*ctx)["Entity"];
       tmpl["name"] = tmpl_name;
 
-      // TODO: loop through components and register their identifier(?)
       (*entity_templates)[tmpl_name] = ctx;
+      (*entity_prototypes)[tmpl_name] = compile_template(tmpl);
     }
   }
 }
 
 entity_component *entity_factory::create_component(std::string component_type_name) {
-  std::function<entity_component *()> fn = (*comp_registry)[component_type_name];
-  if (!fn) {
+  std::map<std::string, component_type>::iterator it = comp_registry->find(component_type_name);
+  if (it == comp_registry->end()) {
     fw::debug << boost::format("  warning: skipping unknown component \"%1%\"") % component_type_name << std::endl;
     return nullptr;
   }
 
-  return fn();
+  return it->second.create_fn();
 }
 
 //-------------------------------------------------------------------------
-component_register::component_register(char const *name, std::function<entity_component *()> fn) {
+component_register::component_register(char const *name, std::function<entity_component *()> create_fn,
+    std::function<entity_component *(entity_component const *)> clone_fn) {
   if (comp_registry == nullptr) {
-    comp_registry = new std::map<std::string, std::function<entity_component *()>>();
+    comp_registry = new std::map<std::string, component_type>();
   }
 
-  (*comp_registry)[name] = fn;
+  component_type &type = (*comp_registry)[name];
+  type.create_fn = create_fn;
+  type.clone_fn = clone_fn;
 }
 
 }
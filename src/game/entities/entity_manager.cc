@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <fstream>
 #include <functional>
 #include <boost/foreach.hpp>
 
@@ -9,6 +11,9 @@
 #include <framework/timer.h>
 #include <framework/misc.h>
 #include <framework/logging.h>
+#include <framework/scenegraph.h>
+#include <framework/settings.h>
+#include <framework/thread_pool.h>
 
 #include <game/world/terrain.h>
 #include <game/world/world.h>
@@ -18,17 +23,22 @@
 #include <game/entities/entity_debug.h>
 #include <game/entities/position_component.h>
 #include <game/entities/ownable_component.h>
+#include <game/entities/orderable_component.h>
 #include <game/entities/selectable_component.h>
+#include <game/entities/entity_attribute.h>
+#include <game/simulation/player.h>
 
 using namespace std::placeholders;
 
 namespace ent {
 
 entity_manager::entity_manager() :
-    _patch_mgr(0), _debug(0) {
+    _patch_mgr(0), _debug(0), _update_time(0.0f), _update_passes(MAX_COMPONENT_SLOTS), _update_pool(nullptr),
+    _state_hash(0), _view_distance(1), _lod_cull_size(0.0f) {
 }
 
 entity_manager::~entity_manager() {
+  delete _update_pool;
   delete _patch_mgr;
   delete _debug;
 }
@@ -39,6 +49,22 @@ void entity_manager::initialize() {
 
   _debug = new entity_debug(this);
   _patch_mgr = new patch_manager(static_cast<float>(trn->get_width()), static_cast<float>(trn->get_length()));
+
+  fw::settings stg;
+  int num_threads = stg.get_value<int>("entity-update-threads");
+  if (num_threads < 0) {
+    // leave one core for the simulation thread and one for pathing (the main thread pitches in as well)
+    num_threads = fw::clamp(static_cast<int>(std::thread::hardware_concurrency()) - 3, 7, 0);
+  }
+  fw::debug << "entity_manager: updating entities with " << num_threads << " extra thread(s)" << std::endl;
+  _update_pool = new fw::thread_pool(num_threads);
+
+  _view_distance = std::max(0, stg.get_value<int>("view-distance"));
+  _lod_cull_size = stg.get_value<float>("lod-cull-size");
+}
+
+int entity_manager::get_num_update_threads() const {
+  return _update_pool == nullptr ? 0 : _update_pool->get_num_threads();
 }
 
 std::shared_ptr<entity> entity_manager::create_entity(std::string const &template_name, entity_id id) {
@@ -47,7 +73,9 @@ std::shared_ptr<entity> entity_manager::create_entity(std::string const &templat
 
 std::shared_ptr<entity> entity_manager::create_entity(std::shared_ptr<entity> created_by,
     std::string const &template_name, entity_id id) {
-  std::shared_ptr<entity> ent(new entity(this, id));
+  // the shared_ptr's control block comes from the entity pool as well
+  std::shared_ptr<entity> ent(new entity(this, id), std::default_delete<entity>(),
+      fw::pool_allocator<entity>(get_entity_pool()));
   ent->_name = template_name;
   ent->_creator = created_by;
 
@@ -77,15 +105,25 @@ std::shared_ptr<entity> entity_manager::create_entity(std::shared_ptr<entity> cr
 
   fw::debug << boost::format("created entity: %1% (identifier: %2%)") % template_name % id << std::endl;
 
-  BOOST_FOREACH(auto &pair, ent->_components) {
-    entity_component *comp = pair.second;
-    if (comp->allow_get_by_component()) {
-      std::list<std::weak_ptr<entity>> &entities_by_component = get_entities_by_component(comp->get_identifier());
-      entities_by_component.push_back(ent);
-    }
+  // the owner index is updated by the ownable_component itself, when the owner is set
+  on_state_changed(ent, "", ent->get_component<orderable_component>() != nullptr ? "idle" : "");
+  {
+    std::unique_lock<std::mutex> lock(_index_mutex);
+    _entities_by_template[template_name][ent.get()] = ent;
+  }
+
+  // the entity's identity (identifier and template) is part of the state hash, too
+  uint64_t base_hash = hash_state(0, id);
+  BOOST_FOREACH(char ch, template_name) {
+    base_hash = hash_state(base_hash, static_cast<uint8_t>(ch));
   }
+  ent->update_state_hash(ent->_base_state_hash, base_hash);
 
-  _all_entities.push_back(ent);
+  // we might be on the simulation thread, so the entity isn't added to _all_entities until the next update()
+  {
+    std::unique_lock<std::mutex> lock(_index_mutex);
+    _created_entities.push_back(ent);
+  }
   return ent;
 }
 
@@ -95,6 +133,7 @@ void entity_manager::destroy(std::weak_ptr<entity> entity) {
     float age = sp->get_age();
     fw::debug << boost::format("destroying entity: %1% (age: %2%)") % sp->get_name() % age << std::endl;
 
+    std::unique_lock<std::mutex> lock(_index_mutex);
     _destroyed_entities.push_back(sp);
   }
 }
@@ -151,61 +190,184 @@ std::weak_ptr<entity> entity_manager::get_entity_at_cursor() {
 }
 
 std::weak_ptr<entity> entity_manager::get_entity(fw::vector const &start, fw::vector const &direction) {
-  fw::vector location = get_view_centre();
+  // we walk along the ray from the start until it hits the ground (plus a bit, in case there's something tall behind
+  // the point where it hits) and choose the selectable entity closest to the start that the ray passes through.
+  game::terrain *trn = game::world::get_instance()->get_terrain();
+  fw::vector ground = trn->get_cursor_location(start, direction);
+  float length = (ground - start).length() + patch_manager::CELL_SIZE * 2.0f;
+
+  std::shared_ptr<entity> closest;
+  float closest_distance = 0.0f;
+  _patch_mgr->for_each_near_ray(start, direction, length,
+      [&](position_component *pos, fw::vector const &pos_unwrapped) {
+    std::shared_ptr<entity> entity = pos->get_entity().lock();
+    if (!entity)
+      return;
+
+    selectable_component *sel = entity->get_component<selectable_component>();
+    if (sel == nullptr)
+      return;
+
+    float distance = fw::distance_between_line_and_point(start, direction, pos_unwrapped);
+    if (distance < sel->get_selection_radius()) {
+      float along = cml::dot(pos_unwrapped - start, direction);
+      if (!closest || along < closest_distance) {
+        closest = entity;
+        closest_distance = along;
+      }
+    }
+  });
 
-  int centre_patch_x = (int) (location[0] / patch_manager::PATCH_SIZE);
-  int centre_patch_z = (int) (location[2] / patch_manager::PATCH_SIZE);
+  return std::weak_ptr<entity>(closest);
+}
 
-  for (int patch_z = centre_patch_z - 1; patch_z <= centre_patch_z + 1; patch_z++) {
-    for (int patch_x = centre_patch_x - 1; patch_x <= centre_patch_x + 1; patch_x++) {
-      patch *p = _patch_mgr->get_patch(patch_x, patch_z);
+std::weak_ptr<entity> entity_manager::get_entity(entity_id id) {
+  std::unique_lock<std::mutex> lock(_index_mutex);
+  auto it = _entity_indices.find(id);
+  if (it != _entity_indices.end()) {
+    return std::weak_ptr<entity>(_all_entities[it->second]);
+  }
 
-      fw::vector offset = fw::vector(
-          (float) (patch_x * patch_manager::PATCH_SIZE) - p->get_origin()[0],
-          0,
-          (float) (patch_z * patch_manager::PATCH_SIZE) - p->get_origin()[2]);
+  // it might have been created since the last update(), in which case it's not in the index yet
+  BOOST_FOREACH(std::shared_ptr<entity> const &ent, _created_entities) {
+    if (ent->get_id() == id) {
+      return std::weak_ptr<entity>(ent);
+    }
+  }
+  return std::weak_ptr<entity>();
+}
 
-      std::list<std::weak_ptr<entity> > patch_entities = p->get_entities();
-      for (auto it = patch_entities.begin(); it != patch_entities.end(); ++it) {
-        std::shared_ptr<entity> entity = (*it).lock();
-        if (!entity)
-          continue;
+void entity_manager::on_owner_changed(std::shared_ptr<entity> const &ent, int old_player_no, int new_player_no) {
+  update_index(_entities_by_owner, ent, old_player_no, new_player_no);
+}
 
-        selectable_component *sel = entity->get_component<selectable_component>();
-        if (sel == nullptr)
-          continue;
+void entity_manager::on_state_changed(std::shared_ptr<entity> const &ent, std::string const &old_state,
+    std::string const &new_state) {
+  update_index(_entities_by_state, ent, old_state, new_state);
+}
 
-        position_component *pos = entity->get_component<position_component>();
-        if (pos == nullptr)
-          continue;
+void entity_manager::update_index(std::unordered_map<int, entity_set> &index, std::shared_ptr<entity> const &ent,
+    int old_key, int new_key) {
+  if (old_key == new_key) {
+    return;
+  }
 
-        float distance = fw::distance_between_line_and_point(start, direction, pos->get_position(false) + offset);
-        if (distance < sel->get_selection_radius()) {
-          return std::weak_ptr < ent::entity > (entity);
-        }
-      }
-    }
+  std::unique_lock<std::mutex> lock(_index_mutex);
+  if (old_key >= 0) {
+    index[old_key].erase(ent.get());
   }
+  if (new_key >= 0) {
+    index[new_key][ent.get()] = ent;
+  }
+}
 
-  return std::weak_ptr<entity>();
+void entity_manager::update_index(std::unordered_map<std::string, entity_set> &index,
+    std::shared_ptr<entity> const &ent, std::string const &old_key, std::string const &new_key) {
+  if (old_key == new_key) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(_index_mutex);
+  if (!old_key.empty()) {
+    index[old_key].erase(ent.get());
+  }
+  if (!new_key.empty()) {
+    index[new_key][ent.get()] = ent;
+  }
 }
 
-std::weak_ptr<entity> entity_manager::get_entity(entity_id id) {
-  // obviously, this is dumb... we should index entities by the identifier for fast access
-  BOOST_FOREACH(std::shared_ptr<entity> &ent, _all_entities) {
-    if (ent->get_id() == id)
-      return std::weak_ptr<entity>(ent);
+void entity_manager::find_entities(entity_query const &query, std::vector<std::weak_ptr<entity>> &results) {
+  std::unique_lock<std::mutex> lock(_index_mutex);
+
+  // collect the index (or, for the owners, indexes) for each part of the query. A player can be named more than once
+  // (e.g. {players={1,1}}), but we only want to walk their entities once.
+  static entity_set const empty_set;
+  std::vector<entity_set const *> owner_sets;
+  size_t owner_count = 0;
+  BOOST_FOREACH(int player_no, query.player_nos) {
+    auto it = _entities_by_owner.find(player_no);
+    if (it != _entities_by_owner.end()
+        && std::find(owner_sets.begin(), owner_sets.end(), &it->second) == owner_sets.end()) {
+      owner_sets.push_back(&it->second);
+      owner_count += it->second.size();
+    }
+  }
+  entity_set const *template_set = nullptr;
+  if (!query.template_name.empty()) {
+    auto it = _entities_by_template.find(query.template_name);
+    template_set = (it == _entities_by_template.end()) ? &empty_set : &it->second;
+  }
+  entity_set const *state_set = nullptr;
+  if (!query.state.empty()) {
+    auto it = _entities_by_state.find(query.state);
+    state_set = (it == _entities_by_state.end()) ? &empty_set : &it->second;
   }
 
-  return std::weak_ptr<entity>();
+  // we walk whichever of them is smallest, and check the candidates against the others
+  auto matches = [&](entity *ent) {
+    if (!query.player_nos.empty()) {
+      bool found = false;
+      BOOST_FOREACH(entity_set const *owner_set, owner_sets) {
+        if (owner_set->find(ent) != owner_set->end()) {
+          found = true;
+          break;
+        }
+      }
+      if (!found) {
+        return false;
+      }
+    }
+    if (template_set != nullptr && template_set->find(ent) == template_set->end()) {
+      return false;
+    }
+    if (state_set != nullptr && state_set->find(ent) == state_set->end()) {
+      return false;
+    }
+    return true;
+  };
+
+  std::vector<std::shared_ptr<entity>> found;
+  auto walk = [&](entity_set const &candidates) {
+    BOOST_FOREACH(auto const &kvp, candidates) {
+      std::shared_ptr<entity> ent = kvp.second.lock();
+      if (ent && matches(kvp.first)) {
+        found.push_back(ent);
+      }
+    }
+  };
+
+  if (template_set != nullptr && (query.player_nos.empty() || template_set->size() <= owner_count)
+      && (state_set == nullptr || template_set->size() <= state_set->size())) {
+    walk(*template_set);
+  } else if (state_set != nullptr && (query.player_nos.empty() || state_set->size() <= owner_count)) {
+    walk(*state_set);
+  } else if (!query.player_nos.empty()) {
+    BOOST_FOREACH(entity_set const *owner_set, owner_sets) {
+      walk(*owner_set);
+    }
+  } else {
+    // no criteria at all, so everything matches
+    BOOST_FOREACH(auto const &kvp, _entities_by_template) {
+      walk(kvp.second);
+    }
+  }
+  lock.unlock();
+
+  // the indexes are unordered, but we want the results in a predictable order
+  std::sort(found.begin(), found.end(), [](std::shared_ptr<entity> const &lhs, std::shared_ptr<entity> const &rhs) {
+    return lhs->get_id() < rhs->get_id();
+  });
+  BOOST_FOREACH(std::shared_ptr<entity> &ent, found) {
+    results.push_back(ent);
+  }
 }
 
 // gets a reference to a list of all the entities with the component with the given identifier.
-std::list<std::weak_ptr<entity> > &entity_manager::get_entities_by_component(int identifier) {
+std::vector<std::weak_ptr<entity> > &entity_manager::get_entities_by_component(int identifier) {
   auto it = _entities_by_component.find(identifier);
   if (it == _entities_by_component.end()) {
     // put a new one on and return that
-    _entities_by_component[identifier] = std::list<std::weak_ptr<entity>>();
+    _entities_by_component[identifier] = std::vector<std::weak_ptr<entity>>();
     it = _entities_by_component.find(identifier);
   }
 
@@ -247,30 +409,140 @@ void entity_manager::clear_selection() {
   _selected_entities.clear();
 }
 
+void entity_manager::add_created() {
+  std::vector<std::shared_ptr<entity>> created;
+  {
+    std::unique_lock<std::mutex> lock(_index_mutex);
+    BOOST_FOREACH(std::shared_ptr<entity> &ent, _created_entities) {
+      ent->_index = _all_entities.size();
+      if (ent->get_id() != 0) {
+        _entity_indices[ent->get_id()] = ent->_index;
+      }
+      _all_entities.push_back(ent);
+    }
+    created.swap(_created_entities);
+  }
+
+  BOOST_FOREACH(std::shared_ptr<entity> &ent, created) {
+    BOOST_FOREACH(entity_component *comp, ent->_components) {
+      if (comp->allow_get_by_component()) {
+        get_entities_by_component(comp->get_identifier()).push_back(ent);
+      }
+    }
+  }
+}
+
 void entity_manager::cleanup_destroyed() {
-  // go through the destroyed list and destroy all entities that have been marked as such
-  BOOST_FOREACH(auto ent, _destroyed_entities) {
-    for (auto it = _all_entities.begin(); it != _all_entities.end();) {
-      if (*it == ent) {
-        it = _all_entities.erase(it);
-      } else {
-        ++it;
+  std::vector<std::shared_ptr<entity>> destroyed;
+  {
+    std::unique_lock<std::mutex> lock(_index_mutex);
+    destroyed.swap(_destroyed_entities);
+  }
+  if (destroyed.empty()) {
+    return;
+  }
+
+  // go through the destroyed list and destroy all entities that have been marked as such. We swap the last entity
+  // into the destroyed entity's slot, so each removal is constant time. Only the main thread changes _all_entities,
+  // so we only need the lock while we're changing it (the simulation thread could be looking something up).
+  BOOST_FOREACH(auto ent, destroyed) {
+    size_t index = ent->_index;
+    if (index >= _all_entities.size() || _all_entities[index] != ent) {
+      continue; // already destroyed (e.g. destroy() was called twice)
+    }
+
+    ownable_component *ownable = ent->get_component<ownable_component>();
+    if (ownable != nullptr && ownable->get_owner() != nullptr) {
+      on_owner_changed(ent, ownable->get_owner()->get_player_no(), -1);
+    }
+    orderable_component *orderable = ent->get_component<orderable_component>();
+    if (orderable != nullptr) {
+      on_state_changed(ent, orderable->get_state_name(), "");
+    }
+    add_to_state_hash(0 - ent->_state_hash);
+    ent->_in_state_hash = false;
+
+    // the last reference to the entity might be dropped on another thread, so we can't leave this to the
+    // position_component's destructor
+    position_component *pos = ent->get_component<position_component>();
+    if (pos != nullptr) {
+      _patch_mgr->remove_from_cell(pos);
+    }
+
+    std::unique_lock<std::mutex> lock(_index_mutex);
+    _entities_by_template[ent->get_name()].erase(ent.get());
+    if (ent->get_id() != 0) {
+      _entity_indices.erase(ent->get_id());
+    }
+    if (index != _all_entities.size() - 1) {
+      std::shared_ptr<entity> &moved = _all_entities[index];
+      moved = _all_entities.back();
+      moved->_index = index;
+      if (moved->get_id() != 0) {
+        _entity_indices[moved->get_id()] = index;
       }
     }
+    _all_entities.pop_back();
   }
-  _destroyed_entities.clear();
 
   // clear the other entity list(s) of entities that have been destroyed
   _selected_entities.remove_if(std::bind(&std::weak_ptr<entity> ::expired, _1));
 
-  BOOST_FOREACH(auto it, _entities_by_component) {
-    it.second.remove_if(std::bind(&std::weak_ptr<entity>::expired, _1));
+  BOOST_FOREACH(auto &it, _entities_by_component) {
+    std::vector<std::weak_ptr<entity>> &entities = it.second;
+    entities.erase(std::remove_if(entities.begin(), entities.end(),
+        std::bind(&std::weak_ptr<entity>::expired, _1)), entities.end());
+  }
+}
+
+void entity_manager::request_state_dump(std::string const &path) {
+  std::unique_lock<std::mutex> lock(_state_dump_mutex);
+  _state_dump_path = path;
+}
+
+void entity_manager::dump_state(std::ostream &out) {
+  std::vector<std::shared_ptr<entity>> sorted(_all_entities);
+  std::stable_sort(sorted.begin(), sorted.end(), [](std::shared_ptr<entity> const &lhs,
+      std::shared_ptr<entity> const &rhs) {
+    if (lhs->get_id() != rhs->get_id()) {
+      return lhs->get_id() < rhs->get_id();
+    }
+    return lhs->get_name() < rhs->get_name();
+  });
+
+  out << boost::format("state hash: %1$016x, %2% entities") % get_state_hash() % sorted.size() << std::endl;
+  BOOST_FOREACH(std::shared_ptr<entity> &ent, sorted) {
+    out << boost::format("%1$08x %2% hash=%3$016x") % ent->get_id() % ent->get_name() % ent->_state_hash;
+
+    position_component *pos = ent->get_component<position_component>();
+    if (pos != nullptr) {
+      fw::vector p = pos->get_position(false);
+      out << boost::format(" pos=(%1$.4f, %2$.4f, %3$.4f)") % p[0] % p[1] % p[2];
+    }
+
+    entity_attribute *health = ent->get_attribute("health");
+    if (health != nullptr) {
+      out << boost::format(" health=%1$.4f") % health->get_value<float>();
+    }
+    out << std::endl;
   }
 }
 
 void entity_manager::update() {
+  add_created();
   cleanup_destroyed();
 
+  std::string state_dump_path;
+  {
+    std::unique_lock<std::mutex> lock(_state_dump_mutex);
+    std::swap(state_dump_path, _state_dump_path);
+  }
+  if (!state_dump_path.empty()) {
+    fw::debug << "dumping entity state to: " << state_dump_path << std::endl;
+    std::ofstream out(state_dump_path.c_str());
+    dump_state(out);
+  }
+
   // work out the current "view centre" which is used for things like drawing
   // the entities centred around the camera and so on.
   game::world *wrld = game::world::get_instance();
@@ -284,11 +556,45 @@ void entity_manager::update() {
       location[1],
       fw::constrain(location[2], this->get_patch_manager()->get_world_length(), 0.0f));
 
-  // update all of the entities
+  _broadphase.update(this, _patch_mgr);
+
+  // update all of the entities. We do one pass per kind of component, so first we collect all the components. Note
+  // that entities created during the update (e.g. a missile that was just fired) aren't updated until next frame.
   float dt = fw::framework::get_instance()->get_timer()->get_frame_time();
+  fw::chrono_clock::time_point update_start(fw::chrono_clock::now());
+  BOOST_FOREACH(auto &pass, _update_passes) {
+    pass.clear();
+  }
   BOOST_FOREACH(auto &ent, _all_entities) {
-    ent->update(dt);
+    BOOST_FOREACH(entity_component *comp, ent->_components) {
+      _update_passes[get_component_slot(comp->get_identifier())].push_back(comp);
+    }
+  }
+
+  BOOST_FOREACH(std::vector<entity_component *> &components, _update_passes) {
+    if (components.empty()) {
+      continue;
+    }
+
+    if (components[0]->allow_parallel_update()) {
+      _update_pool->parallel_for(static_cast<int>(components.size()), [&components, dt](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+          components[i]->update(dt);
+        }
+      });
+
+      // now apply the deferred effects, one at a time and in a fixed order so the result is deterministic
+      BOOST_FOREACH(entity_component *comp, components) {
+        comp->commit_update();
+      }
+    } else {
+      BOOST_FOREACH(entity_component *comp, components) {
+        comp->update(dt);
+      }
+    }
   }
+  _update_time = std::chrono::duration_cast<std::chrono::microseconds>(
+      fw::chrono_clock::now() - update_start).count() / 1000000.0f;
 
   // update the entity_debug interface
   _debug->update();
@@ -300,8 +606,8 @@ void entity_manager::render(fw::sg::scenegraph &scenegraph) {
   int centre_patch_x = (int) (location[0] / patch_manager::PATCH_SIZE);
   int centre_patch_z = (int) (location[2] / patch_manager::PATCH_SIZE);
 
-  for (int patch_z = centre_patch_z - 1; patch_z <= centre_patch_z + 1; patch_z++) {
-    for (int patch_x = centre_patch_x - 1; patch_x <= centre_patch_x + 1; patch_x++) {
+  for (int patch_z = centre_patch_z - _view_distance; patch_z <= centre_patch_z + _view_distance; patch_z++) {
+    for (int patch_x = centre_patch_x - _view_distance; patch_x <= centre_patch_x + _view_distance; patch_x++) {
       patch *p = _patch_mgr->get_patch(patch_x, patch_z);
 
       fw::matrix trans = fw::translation(fw::vector(
@@ -309,12 +615,14 @@ void entity_manager::render(fw::sg::scenegraph &scenegraph) {
           0,
           (float) (patch_z * patch_manager::PATCH_SIZE) - p->get_origin()[2]));
 
-      std::list<std::weak_ptr<entity> > patch_entities = p->get_entities();
+      std::list<std::weak_ptr<entity> > const &patch_entities = p->get_entities();
       for (auto it = patch_entities.begin(); it != patch_entities.end(); ++it) {
         std::shared_ptr<entity> entity = (*it).lock();
         if (!entity)
           continue;
 
+        // every entity is rendered, even off screen, because components other than the mesh have work to do when they
+        // render. The mesh_component does its own culling.
         entity->render(scenegraph, trans);
       }
     }
@@ -11,6 +11,7 @@
 
 #include <game/entities/entity.h>
 #include <game/entities/entity_factory.h>
+#include <game/entities/entity_manager.h>
 #include <game/entities/position_component.h>
 #include <game/entities/mesh_component.h>
 #include <game/entities/ownable_component.h>
@@ -47,7 +48,41 @@ void mesh_component::initialize() {
   _ownable_component = entity->get_component<ownable_component>();
 }
 
+bool mesh_component::get_bounds(fw::matrix const &transform, fw::vector &centre, float &radius) {
+  if (!_model || _model->get_bounds_radius() <= 0.0f) {
+    return false;
+  }
+
+  std::shared_ptr<entity> entity(_entity);
+  position_component *pos = entity->get_component<position_component>();
+  if (pos == nullptr) {
+    return false;
+  }
+
+  fw::matrix world = pos->get_transform() * transform;
+  centre = cml::transform_point(world, _model->get_bounds_centre());
+  radius = _model->get_bounds_radius() * fw::max_scale(world);
+  return true;
+}
+
 void mesh_component::render(fw::sg::scenegraph &scenegraph, fw::matrix const &transform) {
+  fw::vector bounds_centre;
+  float bounds_radius;
+  if (!get_bounds(transform, bounds_centre, bounds_radius)) {
+    // we don't know how big we are yet, so we can't cull
+    render_model(scenegraph, transform, false);
+    return;
+  }
+
+  std::shared_ptr<entity> entity(_entity);
+  if (scenegraph.is_visible(bounds_centre, bounds_radius, entity->get_manager()->get_lod_cull_size())) {
+    render_model(scenegraph, transform, false);
+  } else if (scenegraph.might_cast_shadow(bounds_centre, bounds_radius)) {
+    render_model(scenegraph, transform, true);
+  }
+}
+
+void mesh_component::render_model(fw::sg::scenegraph &scenegraph, fw::matrix const &transform, bool shadow_only) {
   std::shared_ptr<entity> entity(_entity);
   position_component *pos = entity->get_component<position_component>();
   if (pos != nullptr) {
@@ -62,7 +97,7 @@ void mesh_component::render(fw::sg::scenegraph &scenegraph, fw::matrix const &tr
       }
     }
 
-    _model->render(scenegraph, pos->get_transform() * transform);
+    _model->render(scenegraph, pos->get_transform() * transform, shadow_only);
   }
 }
 }
@@ -20,7 +20,7 @@ ENT_COMPONENT_REGISTER("Moveable", moveable_component);
 
 moveable_component::moveable_component() :
     _position_component(nullptr), _pathing_component(nullptr), _speed(3.0f), _turn_speed(1.0f),
-    _avoid_collisions(true), _is_moving(false) {
+    _avoid_collisions(true), _is_moving(false), _has_next(false) {
 }
 
 moveable_component::~moveable_component() {
@@ -89,7 +89,8 @@ void moveable_component::update(float dt) {
     return;
   }
 
-  fw::vector pos = _position_component->get_position();
+  // we're updated in parallel, so we must not let get_position() update the patch/cell/hash state for us.
+  fw::vector pos = _position_component->get_position(false);
   fw::vector goal = _intermediate_goal;
   fw::vector dir = _position_component->get_direction_to(goal);
   float distance = dir.length();
@@ -104,7 +105,7 @@ void moveable_component::update(float dt) {
 
   // if we're avoiding obstacles, we'll need to figure out what is the closest entity to us
   if (_avoid_collisions) {
-    std::shared_ptr<ent::entity> obstacle = _position_component->get_nearest_entity().lock();
+    std::shared_ptr<ent::entity> obstacle = _position_component->get_nearest_neighbour().lock();
     if (obstacle) {
       fw::vector obstacle_dir = _position_component->get_direction_to(obstacle);
       float obstacle_distance = obstacle_dir.length();
@@ -172,14 +173,23 @@ void moveable_component::update(float dt) {
   }
 
   // turn towards the goal
-  dir = steer(_position_component->get_position(),
+  dir = steer(_position_component->get_position(false),
       _position_component->get_direction(), dir, turn_speed * dt, show_steering);
 
   // move in the direction we're facing
   pos += (dir * dt * speed);
 
-  _position_component->set_direction(dir);
-  _position_component->set_position(pos);
+  _next_dir = dir;
+  _next_pos = pos;
+  _has_next = true;
+}
+
+void moveable_component::commit_update() {
+  if (_has_next) {
+    _position_component->set_direction(_next_dir);
+    _position_component->set_position(_next_pos);
+    _has_next = false;
+  }
 }
 
 // applies a steering factor to the "curr_direction" so that we slowly turn towards the goal_direction.
@@ -1,4 +1,5 @@
 #include <game/entities/entity_factory.h>
+#include <game/entities/entity_manager.h>
 #include <game/entities/orderable_component.h>
 #include <game/simulation/commands.h>
 #include <game/simulation/orders.h>
@@ -17,9 +18,19 @@ orderable_component::~orderable_component() {
 }
 
 void orderable_component::execute_order(std::shared_ptr<game::order> const &order) {
+  std::string old_state = get_state_name();
   _curr_order = order;
   _order_pending = false;
   _curr_order->begin(_entity);
+  update_state_index(old_state);
+}
+
+// lets the entity_manager know that our state has changed from the given state (to whatever it is now)
+void orderable_component::update_state_index(std::string const &old_state) {
+  std::shared_ptr<entity> entity = _entity.lock();
+  if (entity) {
+    entity->get_manager()->on_state_changed(entity, old_state, get_state_name());
+  }
 }
 
 void orderable_component::update(float dt) {
@@ -27,7 +38,9 @@ void orderable_component::update(float dt) {
     // if we've currently got an order, update it and check whether it's finished
     _curr_order->update(dt);
     if (_curr_order->is_complete()) {
+      std::string old_state = get_state_name();
       _curr_order.reset();
+      update_state_index(old_state);
     }
   }
 
@@ -62,4 +75,12 @@ std::shared_ptr<game::order> orderable_component::get_current_order() const {
   return _curr_order;
 }
 
+std::string orderable_component::get_state_name() const {
+  std::shared_ptr<game::order> curr_order = _curr_order;
+  if (curr_order) {
+    return curr_order->get_state_name();
+  }
+  return "idle";
+}
+
 }
@@ -1,4 +1,5 @@
 #include <game/entities/entity_factory.h>
+#include <game/entities/entity_manager.h>
 #include <game/entities/ownable_component.h>
 
 #include <game/simulation/simulation_thread.h>
@@ -13,11 +14,22 @@ ownable_component::ownable_component() :
     _owner(nullptr) {
 }
 
+// we don't copy the signal (or anything connected to it), just the owner
+ownable_component::ownable_component(ownable_component const &copy) :
+    entity_component(copy), _owner(copy._owner) {
+}
+
 ownable_component::~ownable_component() {
 }
 
 void ownable_component::set_owner(game::player *owner) {
+  int old_player_no = (_owner == nullptr) ? -1 : _owner->get_player_no();
   _owner = owner;
+
+  std::shared_ptr<entity> entity = _entity.lock();
+  if (entity) {
+    entity->get_manager()->on_owner_changed(entity, old_player_no, (owner == nullptr) ? -1 : owner->get_player_no());
+  }
   owner_changed_event(this);
 }
 
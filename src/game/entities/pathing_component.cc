@@ -1,4 +1,5 @@
 #include <functional>
+#include <memory>
 
 #include <framework/framework.h>
 #include <framework/logging.h>
@@ -9,6 +10,8 @@
 #include <game/entities/pathing_component.h>
 #include <game/entities/position_component.h>
 #include <game/entities/moveable_component.h>
+#include <game/entities/ownable_component.h>
+#include <game/simulation/player.h>
 #include <game/world/world.h>
 #include <game/ai/pathing_thread.h>
 
@@ -20,7 +23,8 @@ using namespace std::placeholders;
 ENT_COMPONENT_REGISTER("Pathing", pathing_component);
 
 pathing_component::pathing_component() :
-    _position(nullptr), _moveable(nullptr), _curr_goal_node(0), _last_request_time(0.0f) {
+    _position(nullptr), _moveable(nullptr), _ownable(nullptr), _curr_goal_node(0),
+    _last_request_time(0.0f) {
 }
 
 pathing_component::~pathing_component() {
@@ -31,10 +35,17 @@ void pathing_component::initialize() {
   if (ent) {
     _position = ent->get_component<position_component>();
     _moveable = ent->get_component<moveable_component>();
+    _ownable = ent->get_component<ownable_component>();
   }
 }
 
 void pathing_component::update(float dt) {
+  std::shared_ptr<std::vector<fw::vector>> found_path =
+      std::atomic_exchange(&_found_path, std::shared_ptr<std::vector<fw::vector>>());
+  if (found_path) {
+    set_path(*found_path);
+  }
+
   // follow the path... todo: this can be done SOOOOOO much better!
   while (is_following_path()) {
     fw::vector goal = _path[_curr_goal_node];
@@ -77,18 +88,30 @@ void pathing_component::set_goal(fw::vector const &goal) {
   _last_request_time = now;
   _last_request_goal = goal;
 
+  // orders from the local player jump ahead of everybody else's in the pathing queue
+  int player_no = 0;
+  game::pathing_thread::priority prio = game::pathing_thread::priority_normal;
+  if (_ownable != nullptr && _ownable->get_owner() != nullptr) {
+    player_no = _ownable->get_owner()->get_player_no();
+    if (_ownable->is_local_player()) {
+      prio = game::pathing_thread::priority_high;
+    }
+  }
+
   auto pathing_thread = game::world::get_instance()->get_pathing();
-  pathing_thread->request_path(_position->get_position(), goal,
+  pathing_thread->request_path(player_no, prio, _position->get_position(false), goal,
       std::bind(&pathing_component::on_path_found, this, _1));
 }
 
 void pathing_component::stop() {
+  std::atomic_store(&_found_path, std::shared_ptr<std::vector<fw::vector>>());
   _path.clear();
   _curr_goal_node = 0;
 }
 
+// this is called on the pathing_thread, we just leave the path for update() to pick up
 void pathing_component::on_path_found(std::vector<fw::vector> const &path) {
-  set_path(path);
+  std::atomic_store(&_found_path, std::make_shared<std::vector<fw::vector>>(path));
 }
 
 }
@@ -1,3 +1,5 @@
+#include <cassert>
+#include <cmath>
 #include <functional>
 #include <boost/foreach.hpp>
 
@@ -20,10 +22,13 @@ ENT_COMPONENT_REGISTER("Position", position_component);
 
 position_component::position_component() :
     _pos(0, 0, 0), _dir(0, 0, 1), _up(0, 1, 0), _pos_updated(true), _sit_on_terrain(false),
-    _orient_to_terrain(false), _patch(0) {
+    _orient_to_terrain(false), _patch(0), _cell_mgr(nullptr), _cell_index(-1), _cell_slot(-1),
+    _state_hash(0), _nearest_neighbour(nullptr), _nearest_neighbour_dist_sq(0.0f) {
 }
 
 position_component::~position_component() {
+  // entity_manager::cleanup_destroyed takes us out of the spatial index (on the main thread) before we get here
+  assert(_cell_mgr == nullptr);
 }
 
 void position_component::apply_template(luabind::object const &tmpl) {
@@ -89,6 +94,7 @@ void position_component::set_final_position() {
       new_patch->add_entity(entity);
       _patch = new_patch;
     }
+    pmgr->update_cell(this);
 
     _pos_updated = false;
   }
@@ -101,6 +107,13 @@ void position_component::set_position(fw::vector const &pos) {
 
   _pos = fw::vector(fw::constrain(pos[0], world_width, 0.0f), pos[1], fw::constrain(pos[2], world_length, 0.0f));
 
+  // the height is derived from the terrain, so only x and z go into the state hash. They're quantized so that tiny
+  // floating-point differences don't show up as a desync. We update it here rather than in set_final_position so
+  // that the hash doesn't depend on whether anybody has asked for our position since we moved.
+  int64_t qx = static_cast<int64_t>(std::floor(_pos[0] * 16.0f + 0.5f));
+  int64_t qz = static_cast<int64_t>(std::floor(_pos[2] * 16.0f + 0.5f));
+  entity->update_state_hash(_state_hash, hash_state(hash_state(identifier, qx), qz));
+
   _pos_updated = true;
 }
 
@@ -151,42 +164,32 @@ fw::vector position_component::get_direction_to(fw::vector const &point) const {
 fw::vector position_component::get_direction_to(std::shared_ptr<entity> entity) const {
   position_component *their_position = entity->get_component<position_component>();
   if (their_position != nullptr)
-    return get_direction_to(their_position->get_position());
+    return get_direction_to(their_position->get_position(false));
 
   return fw::vector(0, 0, 0);
 }
 
 // searches for the nearest entity to us which matches the given predicate
 std::weak_ptr<entity> position_component::get_nearest_entity(
-    std::function<bool(std::shared_ptr<entity> const &)> pred) const {
-  std::shared_ptr<entity> closest;
-  float closest_distance = 0.0f;
-
-  std::shared_ptr<entity> us(_entity);
-  std::list<std::weak_ptr<entity>> patch_entities = _patch->get_entities();
-  for (auto it = patch_entities.begin(); it != patch_entities.end(); ++it) {
-    std::shared_ptr<entity> ent = (*it).lock();
-    if (!ent) {
-      continue;
-    }
+    std::function<bool(std::shared_ptr<entity> const &)> pred, float max_distance) const {
+  if (_cell_mgr == nullptr) {
+    return std::weak_ptr<entity>();
+  }
 
-    if (ent == us) {
-      continue;
+  position_component const *us = this;
+  position_component *closest = _cell_mgr->get_nearest(_pos, max_distance, [us, &pred](position_component *pos) {
+    if (pos == us) {
+      return false;
     }
 
-    position_component *their_pos = ent->get_component<position_component>();
-    if (their_pos == nullptr) {
-      continue;
-    }
+    std::shared_ptr<entity> ent = pos->_entity.lock();
+    return ent && pred(ent);
+  });
 
-    float dist = get_direction_to(their_pos->get_position()).length_squared();
-    if (!closest || (closest_distance > dist && pred(ent))) {
-      closest = ent;
-      closest_distance = dist;
-    }
+  if (closest == nullptr) {
+    return std::weak_ptr<entity>();
   }
-
-  return std::weak_ptr<entity>(closest);
+  return closest->_entity;
 }
 
 // searches for the nearest entity to us
@@ -194,6 +197,13 @@ std::weak_ptr<entity> position_component::get_nearest_entity() const {
   return get_nearest_entity([](std::shared_ptr<entity> const &) { return true; });
 }
 
+std::weak_ptr<entity> position_component::get_nearest_neighbour() const {
+  if (_nearest_neighbour == nullptr) {
+    return std::weak_ptr<entity>();
+  }
+  return _nearest_neighbour->_entity;
+}
+
 std::weak_ptr<entity> position_component::get_nearest_entity_with_component(int component_type) const {
   return get_nearest_entity([component_type](std::shared_ptr<entity> const &ent) {
     return ent->contains_component(component_type);
@@ -235,6 +245,10 @@ patch_manager::patch_manager(float size_x, float size_z) {
   _patch_width = static_cast<int>(size_x / PATCH_SIZE);
   _patch_length = static_cast<int>(size_z / PATCH_SIZE);
 
+  _cells_wide = _patch_width * (PATCH_SIZE / CELL_SIZE);
+  _cells_long = _patch_length * (PATCH_SIZE / CELL_SIZE);
+  _cells.resize(_cells_wide * _cells_long);
+
   _patches.resize(_patch_width * _patch_length);
   for (int z = 0; z < _patch_length; z++) {
     for (int x = 0; x < _patch_width; x++) {
@@ -249,6 +263,13 @@ patch_manager::~patch_manager() {
     delete patch;
   }
   _patches.clear();
+
+  // anybody still in the spatial index (shouldn't be anyone, really) needs to forget about us
+  BOOST_FOREACH(auto &cell, _cells) {
+    BOOST_FOREACH(position_component *pos, cell) {
+      pos->_cell_mgr = nullptr;
+    }
+  }
 }
 
 patch *patch_manager::get_patch(float x, float z) {
@@ -276,4 +297,92 @@ int patch_manager::get_patch_index(int patch_x, int patch_z, int *new_patch_x /*
   return (get_patch_width() * patch_z) + patch_x;
 }
 
+int patch_manager::get_cell_index(int cell_x, int cell_z) const {
+  cell_x = fw::constrain(cell_x, _cells_wide);
+  cell_z = fw::constrain(cell_z, _cells_long);
+  return (_cells_wide * cell_z) + cell_x;
+}
+
+void patch_manager::update_cell(position_component *pos) {
+  int cell_x = static_cast<int>(floor(pos->_pos[0] / CELL_SIZE));
+  int cell_z = static_cast<int>(floor(pos->_pos[2] / CELL_SIZE));
+  int cell_index = get_cell_index(cell_x, cell_z);
+  if (pos->_cell_mgr == this && pos->_cell_index == cell_index) {
+    return;
+  }
+
+  if (pos->_cell_mgr != nullptr) {
+    pos->_cell_mgr->remove_from_cell(pos);
+  }
+
+  std::vector<position_component *> &cell = _cells[cell_index];
+  pos->_cell_mgr = this;
+  pos->_cell_index = cell_index;
+  pos->_cell_slot = static_cast<int>(cell.size());
+  cell.push_back(pos);
+}
+
+void patch_manager::remove_from_cell(position_component *pos) {
+  if (pos->_cell_mgr != this) {
+    return;
+  }
+
+  // swap the last entry in the cell into this one's slot, so we don't have to search
+  std::vector<position_component *> &cell = _cells[pos->_cell_index];
+  position_component *last = cell.back();
+  cell[pos->_cell_slot] = last;
+  last->_cell_slot = pos->_cell_slot;
+  cell.pop_back();
+
+  pos->_cell_mgr = nullptr;
+  pos->_cell_index = -1;
+  pos->_cell_slot = -1;
+}
+
+fw::vector patch_manager::get_direction(fw::vector const &from, fw::vector const &to) const {
+  float width = get_world_width();
+  float length = get_world_length();
+
+  fw::vector dir = to - from;
+  dir[0] = fw::constrain(dir[0] + (width * 0.5f), width, 0.0f) - (width * 0.5f);
+  dir[2] = fw::constrain(dir[2] + (length * 0.5f), length, 0.0f) - (length * 0.5f);
+  return dir;
+}
+
+position_component *patch_manager::get_nearest(fw::vector const &centre, float max_distance,
+    std::function<bool(position_component *)> const &pred) const {
+  int centre_x = static_cast<int>(floor(centre[0] / CELL_SIZE));
+  int centre_z = static_cast<int>(floor(centre[2] / CELL_SIZE));
+  int max_ring = std::min(static_cast<int>(ceil(max_distance / CELL_SIZE)),
+      std::max(_cells_wide, _cells_long) / 2);
+
+  position_component *nearest = nullptr;
+  float nearest_dist_sq = max_distance * max_distance;
+  auto visitor = [&nearest, &nearest_dist_sq, &pred](position_component *pos, fw::vector const &dir) {
+    float dist_sq = dir[0] * dir[0] + dir[2] * dir[2];
+    if (dist_sq < nearest_dist_sq && pred(pos)) {
+      nearest = pos;
+      nearest_dist_sq = dist_sq;
+    }
+  };
+
+  // search outwards in "rings" of cells around the centre. Once we've searched a ring, anything in the rings further
+  // out is at least ring * CELL_SIZE away, so if we've found something closer than that we can stop.
+  for (int ring = 0; ring <= max_ring; ring++) {
+    for (int z = -ring; z <= ring; z++) {
+      int x_step = (z == -ring || z == ring) ? 1 : ring * 2;
+      for (int x = -ring; x <= ring; x += x_step) {
+        visit_cell(get_cell_index(centre_x + x, centre_z + z), centre, visitor);
+      }
+    }
+
+    float ring_distance = static_cast<float>(ring * CELL_SIZE);
+    if (nearest != nullptr && nearest_dist_sq <= ring_distance * ring_distance) {
+      break;
+    }
+  }
+
+  return nearest;
+}
+
 }
@@ -23,7 +23,7 @@ ENT_COMPONENT_REGISTER("BallisticProjectile", ballistic_projectile_component);
 
 //-------------------------------------------------------------------------
 projectile_component::projectile_component() :
-    _our_moveable(0), _our_position(nullptr), _target_position(nullptr) {
+    _has_last_position(false), _our_moveable(0), _our_position(nullptr), _target_position(nullptr) {
 }
 
 projectile_component::~projectile_component() {
@@ -48,26 +48,13 @@ void projectile_component::set_target(std::weak_ptr<entity> target) {
 
 void projectile_component::update(float) {
   bool exploded = false;
-  std::shared_ptr<ent::entity> entity(_entity);
-
-  // find the nearest damagable entity - if it's closer than the "hit" distance, then we've hit them!
-  std::shared_ptr<ent::entity> nearest =
-      _our_position->get_nearest_entity_with_component<damageable_component>().lock();
-  std::shared_ptr<ent::entity> creator = entity->get_creator().lock();
-  if (nearest && nearest != creator) {
-    fw::vector nearest_dir = _our_position->get_direction_to(nearest);
-    float nearest_distance = nearest_dir.length();
-
-    float hit_distance = 0.5f;
-    selectable_component *selectable = nearest->get_component<selectable_component>();
-    if (selectable != 0) {
-      hit_distance = selectable->get_selection_radius();
-    }
 
-    if (nearest_distance < hit_distance) {
-      explode(nearest);
-      exploded = true;
-    }
+  // the broadphase has already checked whether we passed close enough to a damageable entity to hit it since the
+  // last update
+  std::shared_ptr<ent::entity> hit = _hit.lock();
+  if (hit) {
+    explode(hit);
+    exploded = true;
   }
 
   if (!exploded) {
@@ -27,6 +27,12 @@ selectable_component::selectable_component() :
     _is_selected(false), _selection_radius(2.0f), _is_highlighted(false), _ownable(nullptr) {
 }
 
+// we don't copy the sig_selected signal (or anything connected to it)
+selectable_component::selectable_component(selectable_component const &copy) :
+    entity_component(copy), _is_selected(copy._is_selected), _selection_radius(copy._selection_radius),
+    _ownable(copy._ownable), _highlight_colour(copy._highlight_colour), _is_highlighted(copy._is_highlighted) {
+}
+
 selectable_component::~selectable_component() {
 }
 
@@ -57,6 +57,9 @@ void game_screen::show() {
     plyr->world_loaded();
   }
 
+  // now everything's loaded, the simulation can start running turns
+  simulation_thread::get_instance()->start_game();
+
   // show the initial set of windows
 //  hud_chat->show();
   hud_minimap->show();
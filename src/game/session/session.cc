@@ -1,3 +1,5 @@
+#include <boost/format.hpp>
+
 #include <framework/exception.h>
 #include <framework/settings.h>
 #include <framework/http.h>
@@ -12,7 +14,7 @@ namespace game {
 session *session::_instance = new session();
 
 session::session() :
-    _user_id(0), _session_id(0), _state(session::disconnected) {
+    _user_id(0), _session_id(0), _state(session::disconnected), _loopback(false), _loopback_base_port(0) {
 }
 
 session::~session() {
@@ -27,6 +29,16 @@ std::shared_ptr<session_request> session::login(std::string const &username, std
   return req;
 }
 
+// "logs in" without talking to the server, see the header for what that means for confirm_player.
+void session::login_loopback(uint32_t user_id, int base_port) {
+  _loopback = true;
+  _loopback_base_port = base_port;
+  _user_id = user_id;
+  _user_name = (boost::format("player%1%") % user_id).str();
+  fw::debug << boost::format("logged in (loopback), user-id: %1%") % user_id << std::endl;
+  set_state(session::logged_in);
+}
+
 // logs the user out and removes their session information
 std::shared_ptr<session_request> session::logout() {
   std::shared_ptr<session_request> req(new logout_session_request());
@@ -57,8 +69,15 @@ std::shared_ptr<session_request> session::get_games_list(
 }
 
 // requests that the server "confirms" that the given session_id is a valid one.
-std::shared_ptr<session_request> session::confirm_player(uint64_t game_id, uint32_t user_id) {
-  std::shared_ptr<session_request> req(new confirm_player_session_request(game_id, user_id));
+std::shared_ptr<session_request> session::confirm_player(uint64_t game_id, uint32_t user_id,
+    std::function<void(session_request &)> handler) {
+  std::shared_ptr<session_request> req;
+  if (_loopback) {
+    req.reset(new loopback_confirm_player_session_request(game_id, user_id, _loopback_base_port));
+  } else {
+    req.reset(new confirm_player_session_request(game_id, user_id));
+  }
+  req->set_complete_handler(handler);
   add_request(req);
   return req;
 }
@@ -34,7 +34,7 @@ session_request::update_result session_request::update() {
     }
 
     // now that we're finished, call the on_complete_handler if we have one
-    if (!_on_complete_handler) {
+    if (_on_complete_handler) {
       _on_complete_handler(*this);
     }
 
@@ -340,4 +340,29 @@ bool confirm_player_session_request::parse_response(fw::xml_element &xml) {
   return true;
 }
 
+//-------------------------------------------------------------------------
+
+loopback_confirm_player_session_request::loopback_confirm_player_session_request(uint64_t game_id, uint32_t user_id,
+    int base_port) :
+    confirm_player_session_request(game_id, user_id), _base_port(base_port) {
+}
+
+loopback_confirm_player_session_request::~loopback_confirm_player_session_request() {
+}
+
+void loopback_confirm_player_session_request::begin(std::string) {
+  _confirmed = true;
+  _player_no = static_cast<uint8_t>(_other_user_id);
+  _other_user_name = (boost::format("player%1%") % _other_user_id).str();
+  _other_address = (boost::format("127.0.0.1:%1%") % (_base_port + _other_user_id)).str();
+  fw::debug << get_description() << " (loopback)" << std::endl;
+}
+
+session_request::update_result loopback_confirm_player_session_request::update() {
+  if (_on_complete_handler) {
+    _on_complete_handler(*this);
+  }
+  return session_request::finished;
+}
+
 }
@@ -7,12 +7,23 @@ namespace po = boost::program_options;
 
 namespace game {
 
-  void settings_initialize(int argc, char** argv) {
+  // Registers all of the game's settings, plus the given extra options (used by the test programs that run bits of the
+  // game, so that they can have settings of their own) and reads them from the command line and config file.
+  void settings_initialize(int argc, char** argv, po::options_description const &extra_options,
+      std::string const &config_file) {
     po::options_description additional_options("Additional options");
     additional_options.add_options()
         ("server-url", po::value<std::string>()->default_value("http://svc.warworlds.codeka.com/"), "The URL we use to log in, find other games, and so on. Usually you won't change the default.")
         ("listen-port", po::value<std::string>()->default_value("9347"), "The port we listen on. You can specify a range with the syntax aaa-bbb")
         ("auto-login", po::value<std::string>()->default_value(""), "A string used to automatically log on to the server. The value is obfuscated.")
+        ("pathing-threads", po::value<int>()->default_value(0), "The number of threads to use for path-finding. If 0, we'll pick a number based on the number of cores.")
+        ("pathing-cache-size", po::value<int>()->default_value(256), "The number of paths to keep in the path cache. If 0, paths are not cached.")
+        ("entity-update-threads", po::value<int>()->default_value(-1), "The number of extra threads used to update entities. If -1, we'll pick a number based on the number of cores.")
+        ("net-compact-encoding", po::value<bool>()->default_value(true), "If true, we'll use the compact encoding for commands with peers that support it.")
+        ("turn-stats-interval", po::value<int>()->default_value(500), "The number of turns between writing turn timing and network statistics to the log. If 0, we don't collect them.")
+        ("desync-check-interval", po::value<int>()->default_value(0), "The number of turns between comparing our state hash with our peers. If 0 (the default), we don't check for desyncs. The hash isn't taken at the same point in the simulation on every peer, so expect false positives.")
+        ("view-distance", po::value<int>()->default_value(1), "The number of terrain (and entity) patches in each direction from the centre of the view that we draw, if they're in the view frustum.")
+        ("lod-cull-size", po::value<float>()->default_value(0.0f), "Entity meshes are not drawn when their radius is less than this fraction of their distance from the camera (e.g. 0.005). If 0 (the default), they're only culled by the view frustum.")
       ;
 
     po::options_description keybinding_options("Key bindings");
@@ -25,7 +36,11 @@ namespace game {
       ;
 
     po::options_description options;
-    options.add(additional_options).add(keybinding_options);
-    fw::settings::initialize(options, argc, argv, "default.conf");
+    options.add(additional_options).add(keybinding_options).add(extra_options);
+    fw::settings::initialize(options, argc, argv, config_file);
+  }
+
+  void settings_initialize(int argc, char** argv) {
+    settings_initialize(argc, argv, po::options_description(), "default.conf");
   }
 }
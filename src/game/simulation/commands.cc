@@ -22,24 +22,9 @@
 
 namespace game {
 
-// this is a helper macro for registering command types with the command_factory
-#define COMMAND_REGISTER(type) \
-  std::shared_ptr<command> create_ ## type (uint8_t player_no) { \
-    return std::shared_ptr<command>(new type(player_no)); \
-  } \
-  command_registrar reg_ ## type(type::identifier, &create_ ## type)
-
-typedef std::function<std::shared_ptr<command>(uint8_t)> create_command_fn;
 typedef std::map<uint8_t, create_command_fn> command_registry_map;
 static command_registry_map *g_command_registry = nullptr;
 
-// this is a helper class that you use indirectly via the COMMAND_REGISTER macro
-// to register a command.
-class command_registrar {
-public:
-  command_registrar(uint8_t id, create_command_fn fn);
-};
-
 command_registrar::command_registrar(uint8_t id, create_command_fn fn) {
   if (g_command_registry == nullptr)
     g_command_registry = new command_registry_map();
@@ -74,6 +59,7 @@ std::shared_ptr<command> create_command(uint8_t id) {
 COMMAND_REGISTER(connect_player_command);
 COMMAND_REGISTER(create_entity_command);
 COMMAND_REGISTER(order_command);
+COMMAND_REGISTER(turn_settings_command);
 
 //-------------------------------------------------------------------------
 
@@ -107,7 +93,11 @@ static volatile std::atomic<ent::entity_id> g_next_entity_number;
 
 ent::entity_id generate_entity_id() {
   uint32_t entity_id = ++g_next_entity_number;
-  uint8_t player_id = simulation_thread::get_instance()->get_local_player()->get_player_no();
+
+  // there's no local player until the simulation_thread is initialized (e.g. in packet-test, which only serializes
+  // commands). The identifier of a command that's about to be deserialized gets overwritten anyway.
+  local_player *plyr = simulation_thread::get_instance()->get_local_player();
+  uint8_t player_id = (plyr != nullptr) ? plyr->get_player_no() : 0;
 
   if (entity_id > 0x00ffffff) {
     // this is probably pretty bad! I can't imagine a game that needs 16 million entities...
@@ -126,30 +116,35 @@ create_entity_command::~create_entity_command() {
 }
 
 void create_entity_command::serialize(fw::net::packet_buffer &buffer) {
-  buffer << _entity_id;
-  buffer << template_name;
-  buffer << initial_position;
-  buffer << initial_goal;
+  write_entity_id(buffer, _entity_id);
+  buffer.write_string_ref(template_name);
+  buffer.write_position(initial_position);
+  buffer.write_position(initial_goal);
 }
 
 void create_entity_command::deserialize(fw::net::packet_buffer &buffer) {
-  buffer >> _entity_id;
-  buffer >> template_name;
-  buffer >> initial_position;
-  buffer >> initial_goal;
+  _entity_id = read_entity_id(buffer);
+  template_name = buffer.read_string_ref();
+  initial_position = buffer.read_position();
+  initial_goal = buffer.read_position();
 }
 
 void create_entity_command::execute() {
   ent::entity_manager *ent_mgr = game::world::get_instance()->get_entity_manager();
   std::shared_ptr<ent::entity> ent = ent_mgr->create_entity(template_name, static_cast<ent::entity_id>(_entity_id));
 
+  // the positions are quantized the same as the compact encoding does, so we get the same result whether this command
+  // came from us or from a peer (in either encoding)
+  fw::vector quantized_position = fw::net::packet_buffer::quantize_position(initial_position);
+  fw::vector quantized_goal = fw::net::packet_buffer::quantize_position(initial_goal);
+
   ent::position_component *position = ent->get_component<ent::position_component>();
   if (position != nullptr) {
-    position->set_position(initial_position);
+    position->set_position(quantized_position);
 
     ent::moveable_component *moveable = ent->get_component<ent::moveable_component>();
     if (moveable != nullptr) {
-      fw::vector goal = position->get_position() + (initial_goal - initial_position);
+      fw::vector goal = position->get_position() + (quantized_goal - quantized_position);
       moveable->set_goal(goal, true /* skip_pathing */);
     }
   }
@@ -169,13 +164,13 @@ order_command::~order_command() {
 }
 
 void order_command::serialize(fw::net::packet_buffer &buffer) {
-  buffer << entity;
+  write_entity_id(buffer, entity);
   buffer << order->get_identifier();
   order->serialize(buffer);
 }
 
 void order_command::deserialize(fw::net::packet_buffer &buffer) {
-  buffer >> entity;
+  entity = read_entity_id(buffer);
 
   uint16_t order_id;
   buffer >> order_id;
@@ -195,4 +190,48 @@ void order_command::execute() {
   }
 }
 
+//-------------------------------------------------------------------------
+turn_settings_command::turn_settings_command(uint8_t player_no) :
+    command(player_no), turn_length(0), command_delay(0), switch_turn(0) {
+}
+
+turn_settings_command::~turn_settings_command() {
+}
+
+void turn_settings_command::serialize(fw::net::packet_buffer &buffer) {
+  buffer << turn_length;
+  buffer << command_delay;
+  buffer << switch_turn;
+}
+
+void turn_settings_command::deserialize(fw::net::packet_buffer &buffer) {
+  buffer >> turn_length;
+  buffer >> command_delay;
+  buffer >> switch_turn;
+}
+
+void turn_settings_command::execute() {
+  simulation_thread::get_instance()->set_turn_settings(turn_length, command_delay, switch_turn);
+}
+
+//-------------------------------------------------------------------------
+void write_entity_id(fw::net::packet_buffer &buffer, ent::entity_id id) {
+  if (buffer.is_compact()) {
+    buffer.write_uint((id << 8) | (id >> 24));
+  } else {
+    buffer << id;
+  }
+}
+
+ent::entity_id read_entity_id(fw::net::packet_buffer &buffer) {
+  if (buffer.is_compact()) {
+    uint32_t value = buffer.read_uint();
+    return (value >> 8) | (value << 24);
+  } else {
+    ent::entity_id id;
+    buffer >> id;
+    return id;
+  }
+}
+
 }
@@ -4,6 +4,7 @@
 #include <framework/packet_buffer.h>
 #include <framework/exception.h>
 
+#include <game/simulation/commands.h>
 #include <game/simulation/orders.h>
 #include <game/entities/builder_component.h>
 #include <game/entities/entity_manager.h>
@@ -102,11 +103,11 @@ bool build_order::is_complete() {
 }
 
 void build_order::serialize(fw::net::packet_buffer &buffer) {
-  buffer << template_name;
+  buffer.write_string_ref(template_name);
 }
 
 void build_order::deserialize(fw::net::packet_buffer &buffer) {
-  buffer >> template_name;
+  template_name = buffer.read_string_ref();
 }
 
 //-------------------------------------------------------------------------
@@ -123,6 +124,8 @@ void move_order::begin(std::weak_ptr<ent::entity> const &ent) {
   std::shared_ptr<ent::entity> entity(_entity);
 
   // move towards the component, if we don't have a moveable component, nothing will happen.
+  // we quantize the goal the same as the compact encoding does so that it's the same no matter where it came from
+  goal = fw::net::packet_buffer::quantize_position(goal);
   auto moveable = entity->get_component<ent::moveable_component>();
   if (moveable != nullptr) {
     moveable->set_goal(goal);
@@ -151,11 +154,11 @@ bool move_order::is_complete() {
 }
 
 void move_order::serialize(fw::net::packet_buffer &buffer) {
-  buffer << goal;
+  buffer.write_position(goal);
 }
 
 void move_order::deserialize(fw::net::packet_buffer &buffer) {
-  buffer >> goal;
+  goal = buffer.read_position();
 }
 
 //-----------------------------------------------------------------------------
@@ -202,11 +205,11 @@ bool attack_order::is_complete() {
 }
 
 void attack_order::serialize(fw::net::packet_buffer &buffer) {
-  buffer << target;
+  write_entity_id(buffer, target);
 }
 
 void attack_order::deserialize(fw::net::packet_buffer &buffer) {
-  buffer >> target;
+  target = read_entity_id(buffer);
 }
 
 
@@ -14,10 +14,11 @@ PACKET_REGISTER(join_response_packet);
 PACKET_REGISTER(chat_packet);
 PACKET_REGISTER(start_game_packet);
 PACKET_REGISTER(command_packet);
+PACKET_REGISTER(state_hash_packet);
 
 //-------------------------------------------------------------------------
 
-join_request_packet::join_request_packet() : _user_id(-1) {
+join_request_packet::join_request_packet() : _user_id(-1), _supports_compact(false) {
 }
 
 join_request_packet::~join_request_packet() {
@@ -26,16 +27,25 @@ join_request_packet::~join_request_packet() {
 void join_request_packet::serialize(fw::net::packet_buffer &buffer) {
   buffer << _user_id;
   buffer << _colour;
+  buffer << static_cast<uint8_t>(_supports_compact ? 1 : 0);
 }
 
 void join_request_packet::deserialize(fw::net::packet_buffer &buffer) {
   buffer >> _user_id;
   buffer >> _colour;
+
+  // older peers don't send this, so they get the old encoding
+  _supports_compact = false;
+  if (buffer.get_remaining() > 0) {
+    uint8_t supports_compact;
+    buffer >> supports_compact;
+    _supports_compact = (supports_compact != 0);
+  }
 }
 
 //-------------------------------------------------------------------------
 
-join_response_packet::join_response_packet() {
+join_response_packet::join_response_packet() : _use_compact(false) {
 }
 
 join_response_packet::~join_response_packet() {
@@ -49,6 +59,7 @@ void join_response_packet::serialize(fw::net::packet_buffer &buffer) {
   }
   buffer << _my_colour;
   buffer << _your_colour;
+  buffer << static_cast<uint8_t>(_use_compact ? 1 : 0);
 }
 
 void join_response_packet::deserialize(fw::net::packet_buffer &buffer) {
@@ -65,6 +76,13 @@ void join_response_packet::deserialize(fw::net::packet_buffer &buffer) {
   }
   buffer >> _my_colour;
   buffer >> _your_colour;
+
+  _use_compact = false;
+  if (buffer.get_remaining() > 0) {
+    uint8_t use_compact;
+    buffer >> use_compact;
+    _use_compact = (use_compact != 0);
+  }
 }
 
 //-------------------------------------------------------------------------
@@ -99,13 +117,16 @@ void start_game_packet::deserialize(fw::net::packet_buffer &) {
 
 //----------------------------------------------------------------------------
 
-command_packet::command_packet() {
+command_packet::command_packet() :
+    _turn(0) {
 }
 
 command_packet::~command_packet() {
 }
 
 void command_packet::serialize(fw::net::packet_buffer &buffer) {
+  buffer << _turn;
+
   uint8_t num_commands = static_cast<uint8_t>(_commands.size());
   buffer << num_commands;
 
@@ -115,7 +136,7 @@ void command_packet::serialize(fw::net::packet_buffer &buffer) {
     if (cmd->get_player() != nullptr) {
       buffer << cmd->get_player()->get_player_no();
     } else {
-      buffer << 0;
+      buffer << static_cast<uint8_t>(0);
     }
 
     cmd->serialize(buffer);
@@ -123,6 +144,8 @@ void command_packet::serialize(fw::net::packet_buffer &buffer) {
 }
 
 void command_packet::deserialize(fw::net::packet_buffer &buffer) {
+  buffer >> _turn;
+
   uint8_t num_commands;
   buffer >> num_commands;
 
@@ -140,4 +163,23 @@ void command_packet::deserialize(fw::net::packet_buffer &buffer) {
   }
 }
 
+//----------------------------------------------------------------------------
+
+state_hash_packet::state_hash_packet() :
+    _turn(0), _state_hash(0) {
+}
+
+state_hash_packet::~state_hash_packet() {
+}
+
+void state_hash_packet::serialize(fw::net::packet_buffer &buffer) {
+  buffer << _turn;
+  buffer << _state_hash;
+}
+
+void state_hash_packet::deserialize(fw::net::packet_buffer &buffer) {
+  buffer >> _turn;
+  buffer >> _state_hash;
+}
+
 }
@@ -28,7 +28,10 @@ void player::update() {
 void player::send_chat_msg(std::string const &) {
 }
 
-void player::post_commands(std::vector<std::shared_ptr<command>> &) {
+void player::post_commands(std::vector<std::shared_ptr<command>> &, uint32_t) {
+}
+
+void player::post_state_hash(uint32_t, uint64_t) {
 }
 
 void player::world_loaded() {
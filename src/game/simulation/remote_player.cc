@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <functional>
 #include <memory>
 #include <boost/foreach.hpp>
@@ -5,6 +6,7 @@
 #include <framework/net.h>
 #include <framework/logging.h>
 #include <framework/misc.h>
+#include <framework/settings.h>
 
 #include <game/session/session.h>
 #include <game/session/session_request.h>
@@ -20,7 +22,8 @@ using namespace std::placeholders;
 namespace game {
 
 remote_player::remote_player(fw::net::host *host, fw::net::peer *peer, bool connected) :
-    _host(host), _peer(peer), _connected(connected) {
+    _host(host), _peer(peer), _connected(connected), _supports_compact(false), _has_command_turn(false),
+    _command_turn(0) {
   peer->set_handler(std::bind(&remote_player::packet_handler, this, _1));
 
   // give them a temporary username until the connection process has completed.
@@ -48,12 +51,20 @@ void remote_player::local_player_is_ready() {
   _peer->send(pkt);
 }
 
-void remote_player::post_commands(std::vector<std::shared_ptr<command>> &commands) {
+void remote_player::post_commands(std::vector<std::shared_ptr<command>> &commands, uint32_t turn) {
   command_packet pkt;
+  pkt.set_turn(turn);
   pkt.set_commands(commands);
   _peer->send(pkt);
 }
 
+void remote_player::post_state_hash(uint32_t turn, uint64_t state_hash) {
+  state_hash_packet pkt;
+  pkt.set_turn(turn);
+  pkt.set_state_hash(state_hash);
+  _peer->send(pkt);
+}
+
 // this is called whenever we receive a packet from our peer, we need to work out
 // what kind of packet it is and hand it off to the correct handler function.
 void remote_player::packet_handler(std::shared_ptr<fw::net::packet> const &pkt) {
@@ -73,6 +84,9 @@ void remote_player::packet_handler(std::shared_ptr<fw::net::packet> const &pkt)
   case command_packet::identifier:
     pkt_command(pkt);
     break;
+  case state_hash_packet::identifier:
+    pkt_state_hash(pkt);
+    break;
 
   default:
     fw::debug << "  warning: unknown packet type: " << pkt->get_identifier() << std::endl;
@@ -86,11 +100,11 @@ void remote_player::pkt_join_req(std::shared_ptr<fw::net::packet> pkt) {
   std::shared_ptr<join_request_packet> req(std::dynamic_pointer_cast<join_request_packet>(pkt));
   _user_id = req->get_user_id();
   _colour = req->get_colour();
+  _supports_compact = req->get_supports_compact();
 
   // call the session and confirm the fact that this player is valid and that.
-  std::shared_ptr<game::session_request> sess_req = session::get_instance()->confirm_player(
-      simulation_thread::get_instance()->get_game_id(), _user_id);
-  sess_req->set_complete_handler(std::bind(&remote_player::join_complete, this, _1));
+  session::get_instance()->confirm_player(simulation_thread::get_instance()->get_game_id(), _user_id,
+      std::bind(&remote_player::join_complete, this, _1));
 
   simulation_thread::get_instance()->sig_players_changed();
 }
@@ -98,7 +112,9 @@ void remote_player::pkt_join_req(std::shared_ptr<fw::net::packet> pkt) {
 void remote_player::pkt_join_resp(std::shared_ptr<fw::net::packet> pkt) {
   std::shared_ptr<join_response_packet> resp(std::dynamic_pointer_cast<join_response_packet>(pkt));
 
-  fw::debug << boost::format("connected to host, map is: %1%") % resp->get_map_name() << std::endl;
+  fw::debug << boost::format("connected to host, map is: %1%, compact encoding: %2%")
+      % resp->get_map_name() % resp->get_use_compact() << std::endl;
+  _peer->set_compact_encoding(resp->get_use_compact());
   BOOST_FOREACH(uint32_t other_user_id, resp->get_other_users()) {
     // the colour that we sent will be echo'd back to us, usually
     _colour = resp->get_my_colour();
@@ -112,9 +128,8 @@ void remote_player::pkt_join_resp(std::shared_ptr<fw::net::packet> pkt) {
       simulation_thread::get_instance()->get_local_player()->set_colour(your_colour);
 
       // call the session and confirm the fact that this player is valid and that.
-      std::shared_ptr<game::session_request> sess_req = session::get_instance()->confirm_player(
-          simulation_thread::get_instance()->get_game_id(), _user_id);
-      sess_req->set_complete_handler(std::bind(&remote_player::connect_complete, this, _1));
+      session::get_instance()->confirm_player(simulation_thread::get_instance()->get_game_id(), _user_id,
+          std::bind(&remote_player::connect_complete, this, _1));
     } else {
       // it's not the host we just connected to, so we'll have toconnect to them as well!
       // but first, check whether we've already connected to them
@@ -133,9 +148,8 @@ void remote_player::pkt_join_resp(std::shared_ptr<fw::net::packet> pkt) {
 
       if (need_connect) {
         // call the session and confirm the fact that this player is valid and that, then connect to them
-        std::shared_ptr<game::session_request> sess_req = session::get_instance()->confirm_player(
-            simulation_thread::get_instance()->get_game_id(), other_user_id);
-        sess_req->set_complete_handler(std::bind(&remote_player::new_player_confirmed, this, _1));
+        session::get_instance()->confirm_player(simulation_thread::get_instance()->get_game_id(), other_user_id,
+            std::bind(&remote_player::new_player_confirmed, this, _1));
       }
     }
   }
@@ -155,14 +169,23 @@ void remote_player::pkt_start_game(std::shared_ptr<fw::net::packet> pkt) {
   _is_ready_to_start = true;
 }
 
-// this is sent to us at the beginning of the turn, we need to enqueue the commands
-// for the next turn.
+// this is sent to us at the beginning of each of our peer's turns, we need to enqueue the commands for the turn
+// they're meant for.
 void remote_player::pkt_command(std::shared_ptr<fw::net::packet> pkt) {
   std::shared_ptr<command_packet> command_pkt(std::dynamic_pointer_cast<command_packet>(pkt));
+  uint32_t turn = command_pkt->get_turn();
   BOOST_FOREACH(std::shared_ptr<command> &cmd, command_pkt->get_commands()) {
     fw::debug << "got command, id: " << static_cast<int>(cmd->get_identifier()) << std::endl;
-    simulation_thread::get_instance()->enqueue_command(cmd);
+    simulation_thread::get_instance()->enqueue_command(cmd, turn);
   }
+
+  _has_command_turn = true;
+  _command_turn = std::max(_command_turn, turn);
+}
+
+void remote_player::pkt_state_hash(std::shared_ptr<fw::net::packet> pkt) {
+  std::shared_ptr<state_hash_packet> hash_pkt(std::dynamic_pointer_cast<state_hash_packet>(pkt));
+  simulation_thread::get_instance()->check_state_hash(this, hash_pkt->get_turn(), hash_pkt->get_state_hash());
 }
 
 // checks whether the given colour is already taken (ignoring the given player)
@@ -218,7 +241,14 @@ void remote_player::join_complete(session_request &req) {
 
     resp.get_other_users().push_back(plyr->get_user_id());
   }
+
+  // we use the compact encoding only if they support it and we haven't turned it off. The response itself goes out
+  // in the old encoding, and everything after that uses the new one.
+  fw::settings stg;
+  bool use_compact = _supports_compact && stg.get_value<bool>("net-compact-encoding");
+  resp.set_use_compact(use_compact);
   _peer->send(resp);
+  _peer->set_compact_encoding(use_compact);
 
   simulation_thread::get_instance()->sig_players_changed();
 }
@@ -240,6 +270,14 @@ void remote_player::new_player_confirmed(session_request &req) {
   simulation_thread::get_instance()->connect_player(cpsr.get_address());
 }
 
+int remote_player::get_round_trip_time() const {
+  return _peer->get_round_trip_time();
+}
+
+int remote_player::get_round_trip_time_variance() const {
+  return _peer->get_round_trip_time_variance();
+}
+
 void remote_player::update() {
   if (!_connected && _peer->is_connected()) {
     fw::colour our_colour = simulation_thread::get_instance()->get_local_player()->get_colour();
@@ -248,6 +286,8 @@ void remote_player::update() {
     join_request_packet pkt;
     pkt.set_user_id(session::get_instance()->get_user_id());
     pkt.set_colour(our_colour);
+    fw::settings stg;
+    pkt.set_supports_compact(stg.get_value<bool>("net-compact-encoding"));
     _peer->send(pkt);
 
     _connected = true;
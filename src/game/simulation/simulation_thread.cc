@@ -1,10 +1,12 @@
 
+#include <algorithm>
 #include <thread>
 #include <boost/foreach.hpp>
 
 #include <framework/logging.h>
 #include <framework/lua.h>
 #include <framework/net.h>
+#include <framework/paths.h>
 #include <framework/settings.h>
 #include <framework/exception.h>
 #include <framework/timer.h>
@@ -15,13 +17,17 @@
 #include <game/simulation/local_player.h>
 #include <game/simulation/commands.h>
 #include <game/ai/ai_player.h>
+#include <game/ai/pathing_thread.h>
+#include <game/entities/entity_manager.h>
+#include <game/world/world.h>
 
 namespace game {
 
 simulation_thread *simulation_thread::instance = new simulation_thread();
 
 simulation_thread::simulation_thread() :
-    _host(nullptr), _turn(0), _game_id(0), _local_player(nullptr), _stopped(false) {
+    _host(nullptr), _turn(0), _last_command_turn(0), _game_id(0), _local_player(nullptr), _stopped(false),
+    _game_started(false), _desync_check_interval(0), _desync_detected(false) {
 }
 
 simulation_thread::~simulation_thread() {
@@ -67,6 +73,10 @@ void simulation_thread::new_game(uint64_t game_id) {
   _game_id = game_id;
 }
 
+void simulation_thread::start_game() {
+  _game_started = true;
+}
+
 int simulation_thread::get_listen_port() const {
   return _host->get_listen_port();
 }
@@ -96,23 +106,61 @@ player *simulation_thread::get_player(uint8_t player_no) const {
 }
 
 void simulation_thread::post_command(std::shared_ptr<command> &cmd) {
+  std::unique_lock<std::mutex> lock(_posted_commands_mutex);
   _posted_commands.push_back(cmd);
 }
 
+turn_id simulation_thread::get_command_turn() const {
+  // our own commands are delayed by enough turns that they should reach all our peers before they're executed
+  return std::max(_turn + _turn_scheduler.get_command_delay(), _last_command_turn);
+}
+
+void simulation_thread::commit_first_turns() {
+  // the first commands we post will be for turn (1 + command_delay), so there's nothing from us before that
+  std::vector<std::shared_ptr<command>> no_commands;
+  _last_command_turn = _turn_scheduler.get_command_delay();
+  BOOST_FOREACH(player *p, _players) {
+    p->post_commands(no_commands, _last_command_turn);
+  }
+}
+
+void simulation_thread::accept_new_connections() {
+  std::vector<fw::net::peer *> new_connections = _host->get_new_connections();
+  BOOST_FOREACH(fw::net::peer *new_peer, new_connections) {
+    _players.push_back(new remote_player(_host, new_peer, true));
+    sig_players_changed();
+  }
+}
+
 void simulation_thread::enqueue_posted_commands() {
-  BOOST_FOREACH(std::shared_ptr<command> &cmd, _posted_commands) {
-    enqueue_command(cmd);
+  std::vector<std::shared_ptr<command>> posted_commands;
+  {
+    std::unique_lock<std::mutex> lock(_posted_commands_mutex);
+    posted_commands.swap(_posted_commands);
   }
 
-  BOOST_FOREACH(player *p, _players) {
-    p->post_commands(_posted_commands);
+  turn_id turn = get_command_turn();
+  _last_command_turn = turn;
+  BOOST_FOREACH(std::shared_ptr<command> &cmd, posted_commands) {
+    enqueue_command(cmd, turn);
   }
 
-  _posted_commands.clear();
+  // we tell our peers about our commands even when there aren't any, so that they know they're not waiting for us
+  BOOST_FOREACH(player *p, _players) {
+    p->post_commands(posted_commands, turn);
+  }
 }
 
-void simulation_thread::enqueue_command(std::shared_ptr<command> &cmd) {
-  turn_id turn = _turn + 1;
+void simulation_thread::enqueue_command(std::shared_ptr<command> &cmd, turn_id turn) {
+  if (turn <= _turn) {
+    // we never run a turn until we've got every player's commands for it, so the player sent this for a turn they'd
+    // already told us they had no more commands for. Running it on a later turn would only put us out of sync with
+    // everybody else, so all we can do is report it.
+    fw::debug << boost::format("  error: command %1% for turn %2% arrived at turn %3%, dropping it")
+        % static_cast<int>(cmd->get_identifier()) % turn % _turn << std::endl;
+    on_desync(_turn);
+    return;
+  }
 
   command_queue::iterator it = _commands.find(turn);
   if (it == _commands.end()) {
@@ -124,6 +172,112 @@ void simulation_thread::enqueue_command(std::shared_ptr<command> &cmd) {
   command_list.push_back(cmd);
 }
 
+bool simulation_thread::has_all_commands(turn_id turn) const {
+  BOOST_FOREACH(player *plyr, _players) {
+    remote_player *remote = dynamic_cast<remote_player *>(plyr);
+    if (remote != nullptr && !remote->has_commands_for_turn(turn)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool simulation_thread::is_behind() const {
+  BOOST_FOREACH(player *plyr, _players) {
+    remote_player *remote = dynamic_cast<remote_player *>(plyr);
+    if (remote != nullptr && remote->has_commands_after_turn(_last_command_turn)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void simulation_thread::update_turn_settings() {
+  int turn_length, command_delay;
+  if (!_turn_scheduler.update(_players, turn_length, command_delay)) {
+    return;
+  }
+
+  // only the (non-AI) player with the lowest player_no gets to choose the settings
+  BOOST_FOREACH(player *plyr, _players) {
+    if (dynamic_cast<ai_player *>(plyr) == nullptr && plyr->get_player_no() < _local_player->get_player_no()) {
+      return;
+    }
+  }
+
+  // the command is executed on get_command_turn() by everybody, and the settings switch on the turn after that
+  std::shared_ptr<turn_settings_command> cmd(create_command<turn_settings_command>());
+  cmd->turn_length = static_cast<uint16_t>(turn_length);
+  cmd->command_delay = static_cast<uint8_t>(command_delay);
+  cmd->switch_turn = get_command_turn() + 1;
+  post_command(cmd);
+}
+
+void simulation_thread::update_state_hash() {
+  if (_desync_check_interval <= 0 || (_turn % _desync_check_interval) != 0 || world::get_instance() == nullptr) {
+    return;
+  }
+
+  uint64_t local_hash = world::get_instance()->get_entity_manager()->get_state_hash();
+  _state_hashes[_turn] = local_hash;
+  BOOST_FOREACH(player *plyr, _players) {
+    plyr->post_state_hash(_turn, local_hash);
+  }
+
+  // check any hashes our peers sent before we got to this turn
+  for (auto it = _remote_state_hashes.begin(); it != _remote_state_hashes.end();) {
+    if (it->turn <= _turn) {
+      auto local_it = _state_hashes.find(it->turn);
+      if (local_it != _state_hashes.end()) {
+        compare_state_hash(it->plyr, it->turn, local_it->second, it->state_hash);
+      }
+      it = _remote_state_hashes.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  // we don't need to keep our hashes around forever, just long enough for the slowest peer to catch up
+  turn_id oldest_turn = _turn - std::min(_turn, static_cast<turn_id>(_desync_check_interval * 10));
+  _state_hashes.erase(_state_hashes.begin(), _state_hashes.lower_bound(oldest_turn));
+}
+
+void simulation_thread::check_state_hash(player *plyr, turn_id turn, uint64_t state_hash) {
+  if (turn > _turn) {
+    remote_state_hash remote = {plyr, turn, state_hash};
+    _remote_state_hashes.push_back(remote);
+    return;
+  }
+
+  auto it = _state_hashes.find(turn);
+  if (it != _state_hashes.end()) {
+    compare_state_hash(plyr, turn, it->second, state_hash);
+  }
+}
+
+void simulation_thread::compare_state_hash(player *plyr, turn_id turn, uint64_t local_hash, uint64_t remote_hash) {
+  if (local_hash == remote_hash) {
+    return;
+  }
+
+  fw::debug << boost::format("  error: desync detected at turn %1%, player %2% has state hash %3$016x, ours is %4$016x")
+      % turn % plyr->get_user_name() % remote_hash % local_hash << std::endl;
+  on_desync(turn);
+}
+
+void simulation_thread::on_desync(turn_id turn) {
+  // dump our state the first time it happens so it can be compared with the other player's dump, after that the
+  // dumps would just be noise.
+  if (!_desync_detected && world::get_instance() != nullptr) {
+    _desync_detected = true;
+    int player_no = static_cast<int>(_local_player->get_player_no());
+    std::string filename = (boost::format("desync-%1%-%2%.txt") % turn % player_no).str();
+    world::get_instance()->get_entity_manager()->request_state_dump(fw::resolve(filename, true).string());
+  }
+}
+
 void simulation_thread::add_ai_player(ai_player *plyr) {
   _players.push_back(plyr);
   sig_players_changed();
@@ -137,43 +291,102 @@ void simulation_thread::thread_proc() {
         << fw::message_error_info("could not listen on port(s): " + stg.get_value<std::string>("listen-port")));
   }
 
+  _desync_check_interval = stg.get_value<int>("desync-check-interval");
+  _turn_stats.set_report_interval(stg.get_value<int>("turn-stats-interval"));
+
   std::mutex mutex;
 
+  fw::chrono_clock::time_point last_start;
   while (!_stopped) {
     fw::chrono_clock::time_point start(fw::chrono_clock::now());
     _host->update();
+
+    // until the game starts, there's no turns to run. We just keep the connections and players up to date
+    if (!_game_started) {
+      accept_new_connections();
+      BOOST_FOREACH(player *plyr, _players) {
+        plyr->update();
+      }
+
+      std::unique_lock<std::mutex> lock(mutex);
+      _stopped_cond.wait_until(lock, start + std::chrono::milliseconds(_turn_scheduler.get_turn_length()));
+      continue;
+    }
+    if (_turn == 0 && _last_command_turn == 0) {
+      commit_first_turns();
+    }
+
+    // we can't run the next turn until every peer's commands for it have arrived (they'll stall for us, too)
+    if (!has_all_commands(_turn + 1)) {
+      _turn_stats.add_stall();
+      std::unique_lock<std::mutex> lock(mutex);
+      _stopped_cond.wait_until(lock, start + std::chrono::milliseconds(1));
+      continue;
+    }
     _turn++;
+    _turn_scheduler.start_turn(_turn);
 
-    // at the start of each turn, we post the commands for the *next* turn
+    // at the start of each turn, we post the commands for a later turn (see turn_scheduler)
+    update_turn_settings();
     enqueue_posted_commands();
 
     // next, check for any new connections that the host has detected for us, this shouldn't happen
     // once the game is underway, but you never know (in that case, we need to reject them!)
-    std::vector<fw::net::peer *> new_connections = _host->get_new_connections();
-    BOOST_FOREACH(fw::net::peer *new_peer, new_connections) {
-      _players.push_back(new remote_player(_host, new_peer, true));
-      sig_players_changed();
-    }
+    accept_new_connections();
 
     // execute all of the commands that are due this turn
     command_queue::iterator it = _commands.find(_turn);
     if (it != _commands.end()) {
+      // batch up any path requests the commands make, so that a group of units given the same move order only
+      // needs one search between them.
+      pathing_thread *pathing = nullptr;
+      if (world::get_instance() != nullptr) {
+        pathing = world::get_instance()->get_pathing();
+      }
+      if (pathing != nullptr) {
+        pathing->begin_batch();
+      }
+
+      fw::chrono_clock::time_point execute_start(fw::chrono_clock::now());
       command_queue::mapped_type &command_list = it->second;
       BOOST_FOREACH(std::shared_ptr<command> &cmd, command_list) {
         cmd->execute();
       }
+      float execute_ms = std::chrono::duration_cast<std::chrono::microseconds>(
+          fw::chrono_clock::now() - execute_start).count() / 1000.0f;
+      _turn_stats.add_execute_time(execute_ms, static_cast<int>(command_list.size()));
+
+      if (pathing != nullptr) {
+        pathing->end_batch();
+      }
 
       // we'll not need this turn again...
       _commands.erase(it);
     }
 
+    update_state_hash();
+
     // finally, update each player.
     BOOST_FOREACH(player *plyr, _players) {
       plyr->update();
     }
 
+    fw::chrono_clock::time_point end(fw::chrono_clock::now());
+    float turn_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0f;
+    float turn_period = 0.0f;
+    if (_turn > 1) {
+      turn_period = std::chrono::duration_cast<std::chrono::microseconds>(start - last_start).count() / 1000.0f;
+    }
+    _turn_stats.end_turn(_turn, turn_time, turn_period, _host);
+    last_start = start;
+
+    // if a peer is ahead of us (say, they started before we did) we run our turns back-to-back until we catch up
+    if (is_behind()) {
+      continue;
+    }
+
     std::unique_lock<std::mutex> lock(mutex);
-    _stopped_cond.wait_until(lock, start + std::chrono::milliseconds(200));
+    _stopped_cond.wait_until(lock, start + std::chrono::milliseconds(_turn_scheduler.get_turn_length()));
   }
 }
 
@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <boost/foreach.hpp>
+#include <boost/format.hpp>
+
+#include <framework/logging.h>
+#include <framework/misc.h>
+
+#include <game/simulation/turn_scheduler.h>
+#include <game/simulation/player.h>
+#include <game/simulation/remote_player.h>
+
+namespace game {
+
+// this is added to the measured latency to give a little bit of extra room
+static const int SAFETY_MARGIN = 20; // ms
+
+turn_scheduler::turn_scheduler() :
+    _turn_length(MAX_TURN_LENGTH), _command_delay(1), _measured_latency(0), _measured_jitter(0),
+    _turns_until_check(CHECK_INTERVAL), _has_pending(false), _pending_turn_length(0), _pending_command_delay(0),
+    _pending_switch_turn(0) {
+  static_assert(CHECK_INTERVAL > MAX_COMMAND_DELAY + 1, "settings could change again before they've switched");
+}
+
+bool turn_scheduler::update(std::vector<player *> const &players, int &new_turn_length, int &new_command_delay) {
+  if (--_turns_until_check > 0) {
+    return false;
+  }
+  _turns_until_check = CHECK_INTERVAL;
+
+  int max_latency = 0;
+  int max_jitter = 0;
+  BOOST_FOREACH(player *plyr, players) {
+    remote_player *remote = dynamic_cast<remote_player *>(plyr);
+    if (remote == nullptr) {
+      continue;
+    }
+
+    max_latency = std::max(max_latency, remote->get_round_trip_time());
+    max_jitter = std::max(max_jitter, remote->get_round_trip_time_variance());
+  }
+  _measured_latency = max_latency;
+  _measured_jitter = max_jitter;
+
+  // a command needs about half the round-trip time to reach our peers, plus some extra to absorb jitter. We try to
+  // cover that with two turns, and then make sure the delay covers it even if the turn length was clamped.
+  int target_delay = (max_latency / 2) + (max_jitter * 2) + SAFETY_MARGIN;
+  int turn_length = fw::clamp(((target_delay / 2) + 9) / 10 * 10, MAX_TURN_LENGTH, MIN_TURN_LENGTH);
+  int command_delay = fw::clamp((target_delay + turn_length - 1) / turn_length, MAX_COMMAND_DELAY, 1);
+
+  // don't bother changing for small differences, the latency fluctuates a little all the time
+  if (std::abs(turn_length - _turn_length) <= 10 && command_delay == _command_delay) {
+    return false;
+  }
+
+  new_turn_length = turn_length;
+  new_command_delay = command_delay;
+  return true;
+}
+
+void turn_scheduler::set_settings(int turn_length, int command_delay, uint32_t switch_turn) {
+  _has_pending = true;
+  _pending_turn_length = fw::clamp(turn_length, MAX_TURN_LENGTH, MIN_TURN_LENGTH);
+  _pending_command_delay = fw::clamp(command_delay, MAX_COMMAND_DELAY, 1);
+  _pending_switch_turn = switch_turn;
+}
+
+void turn_scheduler::start_turn(uint32_t turn) {
+  if (!_has_pending || turn < _pending_switch_turn) {
+    return;
+  }
+
+  fw::debug << boost::format("turn settings changed at turn %1%: %2%ms turns, commands %3% turn(s) ahead"
+      " (latency: %4%ms +/- %5%ms)") % turn % _pending_turn_length % _pending_command_delay % _measured_latency
+      % _measured_jitter << std::endl;
+  _turn_length = _pending_turn_length;
+  _command_delay = _pending_command_delay;
+  _has_pending = false;
+}
+
+}
@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <boost/format.hpp>
+
+#include <framework/logging.h>
+#include <framework/net.h>
+
+#include <game/simulation/turn_stats.h>
+
+namespace game {
+
+turn_stats::turn_stats() :
+    _report_interval(0), _execute_time(0.0f), _num_commands(0), _num_stalls(0), _bytes_sent(0), _bytes_received(0) {
+}
+
+void turn_stats::add_execute_time(float ms, int num_commands) {
+  _execute_time += ms;
+  _num_commands += num_commands;
+}
+
+void turn_stats::end_turn(uint32_t turn, float turn_time, float turn_period, fw::net::host *host) {
+  if (_report_interval <= 0) {
+    return;
+  }
+
+  _turn_times.push_back(turn_time);
+  if (turn_period > 0.0f) {
+    _turn_periods.push_back(turn_period);
+  }
+
+  if (static_cast<int>(_turn_times.size()) >= _report_interval) {
+    report(turn, host);
+  }
+}
+
+// note: this sorts the samples
+float turn_stats::get_percentile(std::vector<float> &samples, float percentile) {
+  if (samples.empty()) {
+    return 0.0f;
+  }
+
+  std::sort(samples.begin(), samples.end());
+  size_t index = static_cast<size_t>(percentile * (samples.size() - 1) + 0.5f);
+  return samples[std::min(index, samples.size() - 1)];
+}
+
+void turn_stats::report(uint32_t turn, fw::net::host *host) {
+  float num_turns = static_cast<float>(_turn_times.size());
+  uint64_t bytes_sent = host->get_bytes_sent() - _bytes_sent;
+  uint64_t bytes_received = host->get_bytes_received() - _bytes_received;
+
+  float time_p50 = get_percentile(_turn_times, 0.5f);
+  float time_p95 = get_percentile(_turn_times, 0.95f);
+  float time_p99 = get_percentile(_turn_times, 0.99f);
+  float time_max = _turn_times.back(); // the samples are sorted now
+  float period_p50 = get_percentile(_turn_periods, 0.5f);
+  float period_p95 = get_percentile(_turn_periods, 0.95f);
+  float period_p99 = get_percentile(_turn_periods, 0.99f);
+
+  fw::debug << boost::format("turn stats (to turn %1%, %2% turns):") % turn % _turn_times.size() << std::endl;
+  fw::debug << boost::format("  turn time: p50=%1$.2fms p95=%2$.2fms p99=%3$.2fms max=%4$.2fms")
+      % time_p50 % time_p95 % time_p99 % time_max << std::endl;
+  fw::debug << boost::format("  turn period: p50=%1$.2fms p95=%2$.2fms p99=%3$.2fms")
+      % period_p50 % period_p95 % period_p99 << std::endl;
+  fw::debug << boost::format("  commands: %1% executed in %2$.2fms (%3$.3fms per turn)")
+      % _num_commands % _execute_time % (_execute_time / num_turns) << std::endl;
+  fw::debug << boost::format("  stalls: %1% (waiting for other players' commands)") % _num_stalls << std::endl;
+  fw::debug << boost::format("  network: %1$.1f bytes sent, %2$.1f bytes received per turn")
+      % (bytes_sent / num_turns) % (bytes_received / num_turns) << std::endl;
+
+  _turn_times.clear();
+  _turn_periods.clear();
+  _execute_time = 0.0f;
+  _num_commands = 0;
+  _num_stalls = 0;
+  _bytes_sent = host->get_bytes_sent();
+  _bytes_received = host->get_bytes_received();
+}
+
+}
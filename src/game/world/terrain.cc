@@ -1,3 +1,4 @@
+#include <algorithm>
 
 #include <framework/graphics.h>
 #include <framework/misc.h>
@@ -9,14 +10,16 @@
 #include <framework/input.h>
 #include <framework/vector.h>
 #include <framework/scenegraph.h>
+#include <framework/settings.h>
 #include <framework/shader.h>
+#include <framework/shadows.h>
 #include <game/world/terrain.h>
 #include <game/world/terrain_helper.h>
 
 namespace game {
 
 terrain::terrain() :
-    _width(0), _length(0), _heights(nullptr) {
+    _view_distance(1), _width(0), _length(0), _heights(nullptr) {
 }
 
 terrain::~terrain() {
@@ -33,6 +36,9 @@ void terrain::initialize() {
   // load the shader file that we'll use for rendering
   _shader = fw::shader::create("terrain.shader");
 
+  fw::settings stg;
+  _view_distance = std::max(0, stg.get_value<int>("view-distance"));
+
   // TODO: this should come from the world_reader
   set_layer(0, std::shared_ptr<fw::bitmap>(new fw::bitmap(fw::resolve("terrain/grass-01.jpg"))));
   set_layer(1, std::shared_ptr<fw::bitmap>(new fw::bitmap(fw::resolve("terrain/rock-01.jpg"))));
@@ -114,8 +120,17 @@ void terrain::bake_patch(int patch_x, int patch_z) {
 
   std::shared_ptr<terrain_patch> patch(_patches[index]);
   patch->vb->set_data(num_verts, vert_data, 0);
+
+  patch->min_height = patch->max_height = (num_verts > 0 ? vert_data[0].y : 0.0f);
+  for (int i = 1; i < num_verts; i++) {
+    patch->min_height = std::min(patch->min_height, vert_data[i].y);
+    patch->max_height = std::max(patch->max_height, vert_data[i].y);
+  }
   delete[] vert_data;
 
+  // the terrain is cached in the shadow maps, so they'll need to be re-rendered now
+  fw::shadow_source::invalidate_static_casters();
+
   patch->shader_params = _shader->create_parameters();
   if (_layers.size() >= 1)
     patch->shader_params->set_texture("layer1", _layers[0]);
@@ -169,27 +184,44 @@ void terrain::render(fw::sg::scenegraph &scenegraph) {
   int centre_patch_x = (int) (location[0] / PATCH_SIZE);
   int centre_patch_z = (int) (location[2] / PATCH_SIZE);
 
-  for (int patch_z = centre_patch_z - 1; patch_z <= centre_patch_z + 1; patch_z++) {
-    for (int patch_x = centre_patch_x - 1; patch_x <= centre_patch_x + 1; patch_x++) {
+  float half_size = PATCH_SIZE * 0.5f;
+  for (int patch_z = centre_patch_z - _view_distance; patch_z <= centre_patch_z + _view_distance; patch_z++) {
+    for (int patch_x = centre_patch_x - _view_distance; patch_x <= centre_patch_x + _view_distance; patch_x++) {
       int patch_index = get_patch_index(patch_x, patch_z);
 
-      std::shared_ptr<terrain_patch> patch(_patches[patch_index]);
+      terrain_patch *patch = _patches[patch_index].get();
+
+      // the bounding sphere is around the patch's box, which is as tall as the range of heights in the patch
+      float half_height = (patch->max_height - patch->min_height) * 0.5f;
+      fw::vector bounds_centre(
+          patch_x * PATCH_SIZE + half_size,
+          patch->min_height + half_height,
+          patch_z * PATCH_SIZE + half_size);
+      float bounds_radius = sqrt(half_size * half_size * 2.0f + half_height * half_height);
+
+      // patches that are off screen can still cast a shadow onto the ones that aren't
+      bool shadow_only = !scenegraph.is_visible(bounds_centre, bounds_radius);
+      if (shadow_only && !scenegraph.might_cast_shadow(bounds_centre, bounds_radius)) {
+        continue;
+      }
 
       // set up the world matrix for this patch so that it's being rendered at the right offset
-      std::shared_ptr<fw::sg::node> node(new fw::sg::node());
-      fw::matrix world = fw::translation(
+      fw::sg::draw_item *item = scenegraph.add_draw_item();
+      item->transform = fw::translation(
           static_cast<float>(patch_x * PATCH_SIZE), 0,
           static_cast<float>(patch_z * PATCH_SIZE));
-      node->set_world_matrix(world);
-
-      // we have to set up the scenegraph node with these manually
-      node->set_vertex_buffer(patch->vb);
-      node->set_index_buffer(_ib);
-      node->set_shader(_shader);
-      node->set_shader_parameters(patch->shader_params);
-      node->set_primitive_type(fw::sg::primitive_trianglestrip);
 
-      scenegraph.add_node(node);
+      // the patch owns its buffers and parameters, so they'll outlive the frame
+      item->vb = patch->vb.get();
+      item->ib = _ib.get();
+      item->shader = _shader.get();
+      item->shader_params = patch->shader_params.get();
+      item->primitive = fw::sg::primitive_trianglestrip;
+
+      item->static_caster = true;
+      item->shadow_only = shadow_only;
+      item->bounds_centre = bounds_centre;
+      item->bounds_radius = bounds_radius;
     }
   }
 }
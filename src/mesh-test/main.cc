@@ -1,3 +1,4 @@
+#include <cmath>
 #include <iostream>
 
 #include <boost/program_options.hpp>
@@ -33,6 +34,7 @@ public:
   bool initialize(fw::framework *frmwrk);
   void update(float dt);
   void render(fw::sg::scenegraph &scenegraph);
+  void render_stress_test(fw::sg::scenegraph &scenegraph, fw::matrix const &rotation);
 };
 
 static std::shared_ptr<fw::model> g_model;
@@ -40,6 +42,7 @@ static bool g_show_ground = false;
 static std::shared_ptr<fw::sg::node> g_ground;
 static bool g_rotating = false;
 static float g_rotate_angle = 0.0f;
+static bool g_stress_test = false;
 
 bool restart_handler(fw::gui::widget *wdgt) {
   fw::settings stg;
@@ -69,13 +72,24 @@ bool rotate_handler(fw::gui::widget *wdgt) {
   return true;
 }
 
+bool stress_handler(fw::gui::widget *wdgt) {
+  if (g_stress_test) {
+    g_stress_test = false;
+    dynamic_cast<fw::gui::button *>(wdgt)->set_text("Stress test");
+  } else {
+    g_stress_test = true;
+    dynamic_cast<fw::gui::button *>(wdgt)->set_text("Stop stress test");
+  }
+  return true;
+}
+
 bool application::initialize(fw::framework *frmwrk) {
   fw::top_down_camera *cam = new fw::top_down_camera();
   cam->set_mouse_move(false);
   frmwrk->set_camera(cam);
 
   fw::gui::window *wnd;
-  wnd = fw::gui::builder<fw::gui::window>(fw::gui::px(20), fw::gui::px(20), fw::gui::px(150), fw::gui::px(130))
+  wnd = fw::gui::builder<fw::gui::window>(fw::gui::px(20), fw::gui::px(20), fw::gui::px(150), fw::gui::px(170))
       << fw::gui::window::background("frame")
       << (fw::gui::builder<fw::gui::button>(fw::gui::px(10), fw::gui::px(10), fw::gui::px(130), fw::gui::px(30))
           << fw::gui::button::text("Restart")
@@ -85,7 +99,10 @@ bool application::initialize(fw::framework *frmwrk) {
           << fw::gui::widget::click(std::bind<bool>(ground_handler, std::placeholders::_1)))
       << (fw::gui::builder<fw::gui::button>(fw::gui::px(10), fw::gui::px(90), fw::gui::px(130), fw::gui::px(30))
           << fw::gui::button::text("Rotate")
-          << fw::gui::widget::click(std::bind<bool>(rotate_handler, std::placeholders::_1)));
+          << fw::gui::widget::click(std::bind<bool>(rotate_handler, std::placeholders::_1)))
+      << (fw::gui::builder<fw::gui::button>(fw::gui::px(10), fw::gui::px(130), fw::gui::px(130), fw::gui::px(30))
+          << fw::gui::button::text("Stress test")
+          << fw::gui::widget::click(std::bind<bool>(stress_handler, std::placeholders::_1)));
   frmwrk->get_gui()->attach_widget(wnd);
 
   fw::settings stg;
@@ -114,8 +131,33 @@ void application::render(fw::sg::scenegraph &scenegraph) {
     scenegraph.add_node(g_ground);
   }
 
-  g_model->set_colour(fw::colour(1.0f, 1.0f, 0.0f, 0.0f));
-  g_model->render(scenegraph, fw::rotate_axis_angle(fw::vector(0, 1, 0), g_rotate_angle));
+  fw::matrix rotation = fw::rotate_axis_angle(fw::vector(0, 1, 0), g_rotate_angle);
+  if (g_stress_test) {
+    render_stress_test(scenegraph, rotation);
+  } else {
+    g_model->set_colour(fw::colour(1.0f, 1.0f, 0.0f, 0.0f));
+    g_model->render(scenegraph, rotation);
+  }
+}
+
+// renders a grid of copies of the model, each with a different colour, to see how well we cope with lots of
+// instances of the same mesh (run with --debug-view to see the number of draw calls)
+void application::render_stress_test(fw::sg::scenegraph &scenegraph, fw::matrix const &rotation) {
+  fw::settings stg;
+  int count = stg.get_value<int>("stress-count");
+  float spacing = stg.get_value<float>("stress-spacing");
+
+  int width = static_cast<int>(ceil(sqrt(static_cast<float>(count))));
+  float offset = (width - 1) * spacing * 0.5f;
+  for (int i = 0; i < count; i++) {
+    int x = i % width;
+    int z = i / width;
+    fw::matrix transform = rotation * fw::translation(x * spacing - offset, 0.0f, z * spacing - offset);
+
+    float hue = static_cast<float>(i) / count;
+    g_model->set_colour(fw::colour(hue, 1.0f - hue, 0.5f));
+    g_model->render(scenegraph, transform);
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -189,7 +231,11 @@ void settings_initialize(int argc, char** argv) {
   po::options_description options("Additional options");
   options.add_options()("mesh-file",
       po::value<std::string>()->default_value("factory"),
-      "Name of the mesh file to load, we assume it can be fw::resolve'd.");
+      "Name of the mesh file to load, we assume it can be fw::resolve'd.")
+      ("stress-count", po::value<int>()->default_value(500),
+          "Number of copies of the mesh to draw when the stress test is running.")
+      ("stress-spacing", po::value<float>()->default_value(8.0f),
+          "Distance between each copy of the mesh in the stress test.");
 
   fw::settings::initialize(options, argc, argv, "font-test.conf");
 }
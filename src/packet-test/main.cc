@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/exception/all.hpp>
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+
+#include <framework/exception.h>
+#include <framework/logging.h>
+#include <framework/packet.h>
+#include <framework/packet_buffer.h>
+#include <framework/settings.h>
+#include <framework/timer.h>
+
+#include <game/simulation/commands.h>
+#include <game/simulation/orders.h>
+#include <game/simulation/packets.h>
+
+namespace po = boost::program_options;
+using fw::net::packet;
+using fw::net::packet_buffer;
+using fw::net::compact_encoding;
+
+void settings_initialize(int argc, char** argv);
+
+typedef std::chrono::duration<double, std::milli> milliseconds;
+
+// how often (in turns) the game sends each of the packets that aren't sent every turn
+static const int STATE_HASH_INTERVAL = 50;
+static const int CHAT_INTERVAL = 200;
+
+char const *get_packet_name(uint16_t identifier) {
+  switch (identifier) {
+  case game::join_request_packet::identifier:
+    return "join_request";
+  case game::join_response_packet::identifier:
+    return "join_response";
+  case game::chat_packet::identifier:
+    return "chat";
+  case game::start_game_packet::identifier:
+    return "start_game";
+  case game::command_packet::identifier:
+    return "command";
+  case game::state_hash_packet::identifier:
+    return "state_hash";
+  default:
+    return "unknown";
+  }
+}
+
+fw::vector get_random_position(std::mt19937 &rng) {
+  // positions are quantized before they're sent, just like the game does
+  return packet_buffer::quantize_position(
+      fw::vector(static_cast<float>(rng() % 1024) + 0.5f, 0.0f, static_cast<float>(rng() % 1024) + 0.5f));
+}
+
+// Generates the packets one peer would send to another over a game of the given number of turns: the handshake, then
+// a command_packet every turn (mostly move orders, with the occasional new entity), a state_hash_packet every so
+// often and the odd chat message.
+void generate_packets(int num_turns, int commands_per_packet, std::mt19937 &rng,
+    std::vector<std::shared_ptr<packet>> &packets) {
+  static char const *template_names[] = {"factory", "tank", "harvester", "builder", "artillery"};
+  uint32_t next_entity_counter = 1;
+
+  std::shared_ptr<game::join_request_packet> join_request(new game::join_request_packet());
+  join_request->set_user_id(rng());
+  join_request->set_colour(fw::colour(1.0f, 0.0f, 0.0f));
+  join_request->set_supports_compact(true);
+  packets.push_back(join_request);
+
+  std::shared_ptr<game::join_response_packet> join_response(new game::join_response_packet());
+  join_response->set_map_name("ravaged-planets");
+  join_response->get_other_users().push_back(rng());
+  join_response->set_my_colour(fw::colour(0.0f, 1.0f, 0.0f));
+  join_response->set_your_colour(fw::colour(1.0f, 0.0f, 0.0f));
+  join_response->set_use_compact(true);
+  packets.push_back(join_response);
+
+  packets.push_back(std::shared_ptr<packet>(new game::start_game_packet()));
+
+  for (int turn = 1; turn <= num_turns; turn++) {
+    std::vector<std::shared_ptr<game::command>> commands;
+    for (int i = 0; i < commands_per_packet; i++) {
+      uint8_t player_no = static_cast<uint8_t>(1 + (rng() % 4));
+      if (rng() % 10 == 0) {
+        std::shared_ptr<game::create_entity_command> cmd(
+            game::create_command<game::create_entity_command>(player_no));
+        cmd->template_name = template_names[rng() % 5];
+        cmd->initial_goal = get_random_position(rng);
+        cmd->initial_position = packet_buffer::quantize_position(
+            fw::vector(cmd->initial_goal[0], 0.0f, cmd->initial_goal[2] + 3.0f));
+        commands.push_back(cmd);
+        next_entity_counter++;
+      } else {
+        std::shared_ptr<game::move_order> order(new game::move_order());
+        order->goal = get_random_position(rng);
+
+        std::shared_ptr<game::order_command> cmd(game::create_command<game::order_command>(player_no));
+        cmd->entity = (static_cast<uint32_t>(player_no) << 24) | (1 + (rng() % next_entity_counter));
+        cmd->order = order;
+        commands.push_back(cmd);
+      }
+    }
+
+    std::shared_ptr<game::command_packet> pkt(new game::command_packet());
+    pkt->set_turn(turn);
+    pkt->set_commands(commands);
+    packets.push_back(pkt);
+
+    if (turn % STATE_HASH_INTERVAL == 0) {
+      std::shared_ptr<game::state_hash_packet> hash(new game::state_hash_packet());
+      hash->set_turn(turn);
+      hash->set_state_hash((static_cast<uint64_t>(rng()) << 32) | rng());
+      packets.push_back(hash);
+    }
+
+    if (turn % CHAT_INTERVAL == 0) {
+      std::shared_ptr<game::chat_packet> chat(new game::chat_packet());
+      chat->set_msg((boost::format("gg, turn %1%") % turn).str());
+      packets.push_back(chat);
+    }
+  }
+}
+
+// Writes the given packet in the full encoding. We compare packets by comparing these, since the compact encoding of
+// a packet depends on what we've sent before it.
+std::string get_full_bytes(packet &pkt) {
+  packet_buffer buffer(pkt.get_identifier());
+  fw::net::write_packet(pkt, buffer);
+  return std::string(buffer.get_buffer(), buffer.get_size());
+}
+
+struct packet_type_result {
+  int num_packets;
+  std::size_t total_bytes;
+  double encode_ms;
+  double decode_ms;
+};
+
+struct encoding_result {
+  std::map<uint16_t, packet_type_result> by_type;
+  std::size_t total_bytes;
+  int num_failures;
+};
+
+// Sends every packet through write_packet and read_packet (in the compact encoding or not) the given number of times,
+// just like fw::net::peer does, and checks that what we read back is what we wrote. Each repeat is like a new
+// connection, so it starts a new string table.
+encoding_result run_encoding(std::vector<std::shared_ptr<packet>> const &packets, bool compact, int repeats) {
+  encoding_result result;
+  result.total_bytes = 0;
+  result.num_failures = 0;
+
+  for (int repeat = 0; repeat < repeats; repeat++) {
+    compact_encoding sender_state;
+    compact_encoding receiver_state;
+    for (std::shared_ptr<packet> const &pkt : packets) {
+      fw::chrono_clock::time_point start = fw::chrono_clock::now();
+      packet_buffer writer(pkt->get_identifier());
+      if (compact) {
+        writer.set_compact(&sender_state);
+      }
+      fw::net::write_packet(*pkt, writer);
+      std::size_t size = writer.get_size();
+      char *data = writer.release();
+      if (compact) {
+        writer.commit_strings(); // as peer::send does once the packet's been sent
+      }
+      fw::chrono_clock::time_point encoded = fw::chrono_clock::now();
+
+      packet_buffer reader(data, size);
+      if (compact) {
+        reader.set_compact(&receiver_state);
+      }
+      std::shared_ptr<packet> decoded = fw::net::read_packet(reader);
+      fw::chrono_clock::time_point end = fw::chrono_clock::now();
+
+      packet_type_result &type_result = result.by_type[pkt->get_identifier()];
+      type_result.num_packets++;
+      type_result.total_bytes += size;
+      type_result.encode_ms += std::chrono::duration_cast<milliseconds>(encoded - start).count();
+      type_result.decode_ms += std::chrono::duration_cast<milliseconds>(end - encoded).count();
+      result.total_bytes += size;
+
+      // only check the first time through, the rest are just for timing
+      if (repeat == 0) {
+        if (!decoded || reader.get_remaining() != 0 || decoded->get_identifier() != pkt->get_identifier()
+            || get_full_bytes(*decoded) != get_full_bytes(*pkt)) {
+          fw::debug << boost::format("FAILED: %1% packet didn't round-trip in the %2% encoding")
+              % get_packet_name(pkt->get_identifier()) % (compact ? "compact" : "full") << std::endl;
+          result.num_failures++;
+        }
+      }
+      free(data);
+    }
+  }
+  return result;
+}
+
+void print_result(char const *name, encoding_result const &result) {
+  fw::debug << boost::format("  %1%: %2% bytes") % name % result.total_bytes << std::endl;
+  for (auto const &it : result.by_type) {
+    packet_type_result const &type_result = it.second;
+    double megabytes = static_cast<double>(type_result.total_bytes) / (1024.0 * 1024.0);
+    fw::debug << boost::format("    %1$-13s: %2% packets, %3$.1f bytes/packet, encode %4$.1f MB/s (%5$.3fus/packet),"
+        " decode %6$.1f MB/s (%7$.3fus/packet)")
+        % get_packet_name(it.first) % type_result.num_packets
+        % (static_cast<double>(type_result.total_bytes) / type_result.num_packets)
+        % (megabytes / (type_result.encode_ms / 1000.0)) % ((type_result.encode_ms * 1000.0) / type_result.num_packets)
+        % (megabytes / (type_result.decode_ms / 1000.0)) % ((type_result.decode_ms * 1000.0) / type_result.num_packets)
+        << std::endl;
+  }
+}
+
+int main(int argc, char** argv) {
+  try {
+    settings_initialize(argc, argv);
+
+    fw::settings stg;
+    if (stg.is_set("help")) {
+      stg.print_help();
+      return 0;
+    }
+    fw::logging_initialize();
+
+    std::mt19937 rng(stg.get_value<int>("seed"));
+    int num_turns = stg.get_value<int>("turns");
+    int commands_per_packet = std::min(stg.get_value<int>("commands-per-packet"), 255);
+    int repeats = stg.is_set("verify") ? 1 : stg.get_value<int>("repeats");
+
+    std::vector<std::shared_ptr<packet>> packets;
+    generate_packets(num_turns, commands_per_packet, rng, packets);
+
+    encoding_result full = run_encoding(packets, false, repeats);
+    encoding_result compact = run_encoding(packets, true, repeats);
+    fw::debug << boost::format("%1% packets (%2% turns of %3% commands), %4% time(s)")
+        % packets.size() % num_turns % commands_per_packet % repeats << std::endl;
+    print_result("full", full);
+    print_result("compact", compact);
+    fw::debug << boost::format("  compact is %1$.1f%% of full") % ((100.0 * compact.total_bytes) / full.total_bytes)
+        << std::endl;
+
+    if (full.num_failures > 0 || compact.num_failures > 0) {
+      fw::debug << boost::format("%1% packet(s) didn't round-trip in the full encoding, %2% in the compact encoding")
+          % full.num_failures % compact.num_failures << std::endl;
+      return 1;
+    }
+  } catch(std::exception &e) {
+    std::string msg = boost::diagnostic_information(e);
+    fw::debug << "--------------------------------------------------------------------------------" << std::endl;
+    fw::debug << "UNHANDLED EXCEPTION!" << std::endl;
+    fw::debug << msg << std::endl;
+    return 1;
+  } catch (...) {
+    fw::debug << "--------------------------------------------------------------------------------" << std::endl;
+    fw::debug << "UNHANDLED EXCEPTION! (unknown exception)" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+void settings_initialize(int argc, char** argv) {
+  po::options_description options("Packet test options");
+  options.add_options()
+      ("turns", po::value<int>()->default_value(10000), "The number of turns of packets to generate.")
+      ("commands-per-packet", po::value<int>()->default_value(8), "The number of commands in each command packet (at most 255).")
+      ("repeats", po::value<int>()->default_value(20), "The number of times to encode and decode all of the packets.")
+      ("verify", "Encode and decode every packet once and just check they come back the same.")
+      ("seed", po::value<int>()->default_value(1), "The seed for the random number generator, so runs are reproducible.")
+    ;
+
+  fw::settings::initialize(options, argc, argv, "packet-test.conf");
+}
@@ -0,0 +1,365 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <utility>
+
+#include <boost/exception/all.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+
+#include <framework/exception.h>
+#include <framework/logging.h>
+#include <framework/path_find.h>
+#include <framework/paths.h>
+#include <framework/settings.h>
+#include <framework/timer.h>
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+void settings_initialize(int argc, char** argv);
+
+typedef std::chrono::duration<double, std::milli> milliseconds;
+typedef std::pair<fw::vector, fw::vector> path_query;
+
+// a passability grid, either loaded from one of the maps or generated at random
+struct grid {
+  int width;
+  int length;
+  std::vector<bool> passability;
+
+  bool is_passable(int x, int z) const {
+    return passability[(z * width) + x];
+  }
+};
+
+// exposes the searches that path_find only gives to its subclasses, so that we have something to check JPS against
+class exact_path_find : public fw::path_find {
+private:
+  region get_full_region() const {
+    region rgn = {0, 0, get_width(), get_length()};
+    return rgn;
+  }
+
+public:
+  exact_path_find(int width, int length, std::vector<bool> const &passability) :
+      fw::path_find(width, length, passability) {
+  }
+
+  // the cost of the cheapest path from start to end (found by flooding the whole grid), or -1 if there's no path
+  float find_cheapest_cost(fw::vector const &start, fw::vector const &end) {
+    std::vector<fw::vector> targets(1, end);
+    std::vector<float> costs;
+    find_costs_in_region(start, targets, get_full_region(), costs);
+    return costs[0];
+  }
+
+  // an A* search that ends exactly on 'end', rather than next to it like find() does
+  bool find_astar(std::vector<fw::vector> &path, fw::vector const &start, fw::vector const &end, float *cost) {
+    return find_in_region(path, start, end, get_full_region(), cost);
+  }
+};
+
+// loads the collision_data from the given map, which is in the same format world_reader reads
+void load_map_grid(std::string const &name, grid &g) {
+  fs::path full_path = fw::user_base_path() / "maps" / name / "collision_data";
+  if (!fs::exists(full_path)) {
+    full_path = fw::install_base_path() / "maps" / name / "collision_data";
+  }
+
+  std::ifstream ins(full_path.string().c_str(), std::ios::in | std::ios::binary);
+  if (!ins) {
+    BOOST_THROW_EXCEPTION(fw::exception() << fw::message_error_info("could not open " + full_path.string()));
+  }
+
+  int version;
+  ins.read(reinterpret_cast<char *>(&version), sizeof(int));
+  if (version != 1) {
+    BOOST_THROW_EXCEPTION(fw::exception() << fw::message_error_info("unknown collision_data version"));
+  }
+  ins.read(reinterpret_cast<char *>(&g.width), sizeof(int));
+  ins.read(reinterpret_cast<char *>(&g.length), sizeof(int));
+
+  g.passability.resize(g.width * g.length);
+  for (int i = 0; i < g.width * g.length; i++) {
+    uint8_t n = 0;
+    ins.read(reinterpret_cast<char *>(&n), sizeof(uint8_t));
+    g.passability[i] = (n != 0);
+  }
+}
+
+// generates a size x size grid where (roughly) obstacle_percent% of the cells are impassable
+void generate_random_grid(int size, int obstacle_percent, std::mt19937 &rng, grid &g) {
+  g.width = size;
+  g.length = size;
+  g.passability.resize(size * size);
+  for (int i = 0; i < size * size; i++) {
+    g.passability[i] = static_cast<int>(rng() % 100) >= obstacle_percent;
+  }
+}
+
+// picks num_queries random pairs of passable cells
+void generate_queries(grid const &g, int num_queries, std::mt19937 &rng, std::vector<path_query> &queries) {
+  auto random_cell = [&](fw::vector &loc) {
+    // give up eventually, in case the grid is (almost) completely blocked
+    for (int attempt = 0; attempt < 1000; attempt++) {
+      int x = static_cast<int>(rng() % g.width);
+      int z = static_cast<int>(rng() % g.length);
+      if (g.is_passable(x, z)) {
+        loc = fw::vector(x, 0, z);
+        return true;
+      }
+    }
+    return false;
+  };
+
+  for (int i = 0; i < num_queries; i++) {
+    path_query query;
+    if (random_cell(query.first) && random_cell(query.second)) {
+      queries.push_back(query);
+    }
+  }
+}
+
+// works out the cost of the given path, or returns -1 if it's not a valid path from start to end on the grid
+float get_path_cost(grid const &g, std::vector<fw::vector> const &path, fw::vector const &start,
+    fw::vector const &end) {
+  auto same_cell = [](fw::vector const &lhs, fw::vector const &rhs) {
+    return static_cast<int>(lhs[0]) == static_cast<int>(rhs[0]) && static_cast<int>(lhs[2]) == static_cast<int>(rhs[2]);
+  };
+  if (path.empty() || !same_cell(path.front(), start) || !same_cell(path.back(), end)) {
+    return -1.0f;
+  }
+
+  float cost = 0.0f;
+  for (int i = 1; i < static_cast<int>(path.size()); i++) {
+    int x = static_cast<int>(path[i][0]);
+    int z = static_cast<int>(path[i][2]);
+    int dx = std::abs(x - static_cast<int>(path[i - 1][0]));
+    int dz = std::abs(z - static_cast<int>(path[i - 1][2]));
+    dx = std::min(dx, g.width - dx);
+    dz = std::min(dz, g.length - dz);
+    if (dx > 1 || dz > 1 || (dx == 0 && dz == 0) || !g.is_passable(x, z)) {
+      return -1.0f;
+    }
+    cost += (dx == 0 || dz == 0) ? 1.0f : 1.41421356f;
+  }
+  return cost;
+}
+
+// Sends the starts of all the given queries, as a group, to the goal of the first one. Every path find_group returns
+// must be as cheap as the cheapest path from its start. Returns the number of paths that weren't.
+int verify_group(grid const &g, exact_path_find &astar, std::vector<path_query> const &queries) {
+  if (queries.empty()) {
+    return 0;
+  }
+
+  fw::vector goal = queries[0].second;
+  std::vector<fw::vector> starts;
+  BOOST_FOREACH(path_query const &query, queries) {
+    starts.push_back(query.first);
+  }
+
+  fw::path_find pf(g.width, g.length, g.passability);
+  std::vector<std::vector<fw::vector>> paths;
+  pf.find_group(paths, starts, goal);
+
+  int num_failed = 0;
+  for (int i = 0; i < static_cast<int>(starts.size()); i++) {
+    float cheapest_cost = astar.find_cheapest_cost(starts[i], goal);
+    float group_cost = paths[i].empty() ? -1.0f : get_path_cost(g, paths[i], starts[i], goal);
+    float epsilon = 0.001f * std::max(1.0f, cheapest_cost);
+
+    std::string error;
+    if (paths[i].empty() != (cheapest_cost < 0.0f)) {
+      error = (boost::format("reachable: %1%, group found: %2%") % (cheapest_cost >= 0.0f) % !paths[i].empty()).str();
+    } else if (!paths[i].empty() && group_cost < 0.0f) {
+      error = "the group returned an invalid path";
+    } else if (!paths[i].empty() && std::abs(group_cost - cheapest_cost) > epsilon) {
+      error = (boost::format("group path cost %1% but the cheapest path costs %2%") % group_cost % cheapest_cost).str();
+    }
+
+    if (!error.empty()) {
+      num_failed++;
+      fw::debug << boost::format("FAILED: %1%x%2% grid, group (%3%,%4%) to (%5%,%6%): %7%")
+          % g.width % g.length % starts[i][0] % starts[i][2] % goal[0] % goal[2] % error << std::endl;
+    }
+  }
+  return num_failed;
+}
+
+// Searches between random cells on lots of small random grids with both A* and JPS. JPS must always find the cheapest
+// path (we check it against a flood of the whole grid), so it can never be more expensive than A*'s path. We also send
+// each grid's starts to one goal as a group, and those paths must be the cheapest too. Returns the number of queries
+// that failed.
+int run_verify(int num_grids, int obstacle_percent, std::mt19937 &rng) {
+  const int queries_per_grid = 50;
+  int num_queries = 0;
+  int num_failed = 0;
+  int num_group_failed = 0;
+  int num_jps_cheaper = 0;
+
+  for (int i = 0; i < num_grids; i++) {
+    // grids aren't always square, and we vary the obstacles a bit around obstacle_percent
+    grid g;
+    g.width = 16 + static_cast<int>(rng() % 81);
+    g.length = 16 + static_cast<int>(rng() % 81);
+    int percent = std::max(0, obstacle_percent - 15 + static_cast<int>(rng() % 31));
+    g.passability.resize(g.width * g.length);
+    for (int j = 0; j < g.width * g.length; j++) {
+      g.passability[j] = static_cast<int>(rng() % 100) >= percent;
+    }
+
+    exact_path_find astar(g.width, g.length, g.passability);
+    fw::path_find jps(g.width, g.length, g.passability);
+    jps.set_search_mode(fw::path_find::search_jps);
+
+    std::vector<path_query> queries;
+    generate_queries(g, queries_per_grid, rng, queries);
+    BOOST_FOREACH(path_query const &query, queries) {
+      num_queries++;
+      float cheapest_cost = astar.find_cheapest_cost(query.first, query.second);
+
+      std::vector<fw::vector> astar_path;
+      float astar_cost = 0.0f;
+      bool astar_found = astar.find_astar(astar_path, query.first, query.second, &astar_cost);
+
+      std::vector<fw::vector> jps_path;
+      bool jps_found = jps.find(jps_path, query.first, query.second);
+      float jps_cost = jps_found ? get_path_cost(g, jps_path, query.first, query.second) : -1.0f;
+
+      // costs are sums of lots of floats, so they won't be exactly equal
+      float epsilon = 0.001f * std::max(1.0f, cheapest_cost);
+      std::string error;
+      if (jps_found != (cheapest_cost >= 0.0f) || astar_found != (cheapest_cost >= 0.0f)) {
+        error = (boost::format("reachable: %1%, A* found: %2%, JPS found: %3%")
+            % (cheapest_cost >= 0.0f) % astar_found % jps_found).str();
+      } else if (jps_found && jps_cost < 0.0f) {
+        error = "JPS returned an invalid path";
+      } else if (jps_found && std::abs(jps_cost - cheapest_cost) > epsilon) {
+        error = (boost::format("JPS cost %1% but the cheapest path costs %2%") % jps_cost % cheapest_cost).str();
+      } else if (jps_found && jps_cost > astar_cost + epsilon) {
+        error = (boost::format("JPS cost %1% but A* cost %2%") % jps_cost % astar_cost).str();
+      }
+
+      if (!error.empty()) {
+        num_failed++;
+        fw::debug << boost::format("FAILED: %1%x%2% grid, (%3%,%4%) to (%5%,%6%): %7%")
+            % g.width % g.length % query.first[0] % query.first[2] % query.second[0] % query.second[2] % error
+            << std::endl;
+      } else if (jps_found && jps_cost < astar_cost - epsilon) {
+        num_jps_cheaper++;
+      }
+    }
+
+    num_group_failed += verify_group(g, astar, queries);
+  }
+
+  fw::debug << boost::format("verify: %1% grids, %2% queries, %3% failed, %4% group paths failed, JPS cheaper than A*"
+      " in %5%") % num_grids % num_queries % num_failed % num_group_failed % num_jps_cheaper << std::endl;
+  return num_failed + num_group_failed;
+}
+
+// times every query with each kind of open set, so we can compare the original multiset against the binary heap
+void run_benchmark(grid const &g, std::vector<path_query> const &queries) {
+  fw::path_find pf(g.width, g.length, g.passability);
+  fw::path_find::open_set_kind kinds[] = {fw::path_find::open_set_multiset, fw::path_find::open_set_heap};
+  char const *names[] = {"multiset", "heap"};
+
+  std::vector<fw::vector> path;
+  for (int i = 0; i < 2; i++) {
+    pf.set_open_set_kind(kinds[i]);
+
+    // one untimed pass first, so that both kinds start with the nodes in the cache
+    BOOST_FOREACH(path_query const &query, queries) {
+      path.clear();
+      pf.find(path, query.first, query.second);
+    }
+
+    int num_found = 0;
+    double total_ms = 0.0;
+    double max_ms = 0.0;
+    BOOST_FOREACH(path_query const &query, queries) {
+      path.clear();
+      fw::chrono_clock::time_point start = fw::chrono_clock::now();
+      if (pf.find(path, query.first, query.second)) {
+        num_found++;
+      }
+      double ms = std::chrono::duration_cast<milliseconds>(fw::chrono_clock::now() - start).count();
+      total_ms += ms;
+      max_ms = std::max(max_ms, ms);
+    }
+
+    fw::debug << boost::format("%1$-8s: %2% queries (%3% found), %4$.3f ms/query, %5$.3f ms max, %6$.1f ms total")
+        % names[i] % queries.size() % num_found % (total_ms / queries.size()) % max_ms % total_ms << std::endl;
+  }
+}
+
+int main(int argc, char** argv) {
+  try {
+    settings_initialize(argc, argv);
+
+    fw::settings stg;
+    if (stg.is_set("help")) {
+      stg.print_help();
+      return 0;
+    }
+    fw::logging_initialize();
+
+    std::mt19937 rng(stg.get_value<int>("seed"));
+    if (stg.is_set("verify")) {
+      return run_verify(stg.get_value<int>("verify-grids"), stg.get_value<int>("obstacle-percent"), rng) == 0 ? 0 : 1;
+    }
+
+    grid g;
+    std::string map_name = stg.get_value<std::string>("map");
+    if (map_name != "") {
+      load_map_grid(map_name, g);
+      fw::debug << boost::format("map %1%: %2%x%3%") % map_name % g.width % g.length << std::endl;
+    } else {
+      int size = stg.get_value<int>("grid-size");
+      int obstacle_percent = stg.get_value<int>("obstacle-percent");
+      generate_random_grid(size, obstacle_percent, rng, g);
+      fw::debug << boost::format("random grid: %1%x%1%, %2%%% obstacles") % size % obstacle_percent << std::endl;
+    }
+
+    std::vector<path_query> queries;
+    generate_queries(g, stg.get_value<int>("queries"), rng, queries);
+    if (queries.empty()) {
+      fw::debug << "no passable cells to search between" << std::endl;
+      return 1;
+    }
+
+    run_benchmark(g, queries);
+  } catch(std::exception &e) {
+    std::string msg = boost::diagnostic_information(e);
+    fw::debug << "--------------------------------------------------------------------------------" << std::endl;
+    fw::debug << "UNHANDLED EXCEPTION!" << std::endl;
+    fw::debug << msg << std::endl;
+    return 1;
+  } catch (...) {
+    fw::debug << "--------------------------------------------------------------------------------" << std::endl;
+    fw::debug << "UNHANDLED EXCEPTION! (unknown exception)" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+void settings_initialize(int argc, char** argv) {
+  po::options_description options("Additional options");
+  options.add_options()
+      ("map", po::value<std::string>()->default_value(""), "The name of the map whose collision data we search. If empty, we use a random grid.")
+      ("grid-size", po::value<int>()->default_value(512), "The width and length of the random grid, if we're not using a map.")
+      ("obstacle-percent", po::value<int>()->default_value(25), "The percentage of cells in the random grid that are impassable.")
+      ("queries", po::value<int>()->default_value(100), "The number of random start/goal pairs to search between.")
+      ("seed", po::value<int>()->default_value(1), "The seed for the random number generator, so runs are reproducible.")
+      ("verify", "Rather than timing searches, check that JPS always finds the cheapest path on lots of small random grids.")
+      ("verify-grids", po::value<int>()->default_value(200), "The number of random grids to check, with --verify.")
+    ;
+
+  fw::settings::initialize(options, argc, argv, "path-test.conf");
+}
@@ -0,0 +1,351 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/exception/all.hpp>
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+
+#include <framework/exception.h>
+#include <framework/logging.h>
+#include <framework/net.h>
+#include <framework/packet_buffer.h>
+#include <framework/settings.h>
+#include <framework/timer.h>
+
+#include <game/session/session.h>
+#include <game/simulation/commands.h>
+#include <game/simulation/local_player.h>
+#include <game/simulation/player.h>
+#include <game/simulation/remote_player.h>
+#include <game/simulation/simulation_thread.h>
+
+namespace po = boost::program_options;
+
+namespace game {
+void settings_initialize(int argc, char** argv, po::options_description const &extra_options,
+    std::string const &config_file);
+}
+
+void settings_initialize(int argc, char** argv);
+
+// how long we wait after starting each peer before starting the next, so that it's listening before anybody tries to
+// connect to it
+static const int PEER_START_INTERVAL_MS = 1000;
+
+// the peers are all on this computer, so they can compare their steady_clock times
+uint64_t get_time_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * The command each peer posts in the soak test. It's about the size of an order_command with a move_order (an entity
+ * and a goal), plus the time it was posted so that whoever executes it can tell how long it took to get there.
+ */
+class soak_command: public game::command {
+public:
+  uint32_t batch;
+  ent::entity_id entity;
+  fw::vector goal;
+  uint64_t post_time;
+
+  soak_command(uint8_t player_no);
+  virtual ~soak_command();
+
+  virtual void serialize(fw::net::packet_buffer &buffer);
+  virtual void deserialize(fw::net::packet_buffer &buffer);
+
+  virtual void execute();
+
+  static const int identifier = 100;
+  virtual uint8_t get_identifier() const {
+    return identifier;
+  }
+};
+
+COMMAND_REGISTER(soak_command);
+
+// What this peer measures as the soak_commands are executed. They're executed on the simulation thread, while the
+// main thread waits for us to finish, so it's guarded by a mutex.
+struct soak_stats {
+  std::mutex mutex;
+  std::vector<float> latencies; // milliseconds between posting each command and executing it
+  std::map<uint8_t, uint32_t> batches_executed; // by player_no
+  uint64_t checksum;
+  int num_finished;
+};
+static soak_stats g_stats;
+
+// the "script" for this peer's player: it posts num_batches batches of commands_per_batch commands. These are set
+// before the game starts, and after that they're only used by the simulation thread.
+static int g_num_batches;
+static int g_commands_per_batch;
+static std::mt19937 g_rng;
+
+void post_batch(uint32_t batch) {
+  game::simulation_thread *sim = game::simulation_thread::get_instance();
+  uint8_t player_no = sim->get_local_player()->get_player_no();
+  for (int i = 0; i < g_commands_per_batch; i++) {
+    std::shared_ptr<soak_command> cmd(game::create_command<soak_command>(player_no));
+    cmd->batch = batch;
+    cmd->entity = (static_cast<uint32_t>(player_no) << 24) | (1 + (g_rng() % 1000));
+    // positions are quantized when they're sent, so we quantize ours too, so that every peer sees the same goal
+    cmd->goal = fw::net::packet_buffer::quantize_position(
+        fw::vector(static_cast<float>(g_rng() % 1024) + 0.5f, 0.0f, static_cast<float>(g_rng() % 1024) + 0.5f));
+    cmd->post_time = get_time_us();
+    sim->post_command(cmd);
+  }
+}
+
+soak_command::soak_command(uint8_t player_no) :
+    command(player_no), batch(0), entity(0), post_time(0) {
+}
+
+soak_command::~soak_command() {
+}
+
+void soak_command::serialize(fw::net::packet_buffer &buffer) {
+  buffer << batch;
+  game::write_entity_id(buffer, entity);
+  buffer.write_position(goal);
+  buffer << post_time;
+}
+
+void soak_command::deserialize(fw::net::packet_buffer &buffer) {
+  buffer >> batch;
+  entity = game::read_entity_id(buffer);
+  goal = buffer.read_position();
+  buffer >> post_time;
+}
+
+// Every peer executes every player's commands. When we execute the first command of one of our own batches, we post
+// the next one, like an AI reacting to its last orders being carried out.
+void soak_command::execute() {
+  uint64_t now = get_time_us();
+  uint8_t player_no = (get_player() != nullptr) ? get_player()->get_player_no() : 0;
+  bool post_next = false;
+  {
+    std::unique_lock<std::mutex> lock(g_stats.mutex);
+    g_stats.latencies.push_back(static_cast<float>(now - post_time) / 1000.0f);
+
+    // the order we execute a turn's commands in can be different on each peer, so this has to be a sum
+    uint64_t hash = (static_cast<uint64_t>(entity) * 2654435761u) ^ (static_cast<uint64_t>(batch) << 32);
+    hash += static_cast<uint64_t>(goal[0] * 8.0f) * 31 + static_cast<uint64_t>(goal[2] * 8.0f);
+    g_stats.checksum += hash;
+
+    uint32_t &batches_executed = g_stats.batches_executed[player_no];
+    if (batch + 1 > batches_executed) {
+      batches_executed = batch + 1;
+      if (batches_executed == static_cast<uint32_t>(g_num_batches)) {
+        g_stats.num_finished++;
+      }
+
+      game::simulation_thread *sim = game::simulation_thread::get_instance();
+      post_next = (player_no == sim->get_local_player()->get_player_no()
+          && batches_executed < static_cast<uint32_t>(g_num_batches));
+    }
+  }
+
+  if (post_next) {
+    post_batch(batch + 1);
+  }
+}
+
+// note: this sorts the samples
+float get_percentile(std::vector<float> &samples, float percentile) {
+  if (samples.empty()) {
+    return 0.0f;
+  }
+
+  std::sort(samples.begin(), samples.end());
+  size_t index = static_cast<size_t>(percentile * (samples.size() - 1) + 0.5f);
+  return samples[std::min(index, samples.size() - 1)];
+}
+
+// gets the number of remote players who've finished joining the game
+int get_num_joined() {
+  int num_joined = 0;
+  for (game::player *plyr : game::simulation_thread::get_instance()->get_players()) {
+    if (dynamic_cast<game::remote_player *>(plyr) != nullptr && plyr->get_player_no() != 0) {
+      num_joined++;
+    }
+  }
+  return num_joined;
+}
+
+// Runs one peer: player 1 hosts the game and everybody else joins it. Once everybody's joined, we start the game and
+// play until we've executed every player's last batch.
+int run_peer(fw::settings &stg) {
+  int peer = stg.get_value<int>("peer");
+  int num_peers = stg.get_value<int>("peers");
+  int base_port = stg.get_value<int>("base-port");
+  fw::chrono_clock::time_point deadline =
+      fw::chrono_clock::now() + std::chrono::seconds(stg.get_value<int>("timeout"));
+  g_num_batches = stg.get_value<int>("batches");
+  g_commands_per_batch = std::min(stg.get_value<int>("commands-per-batch"), 250);
+  g_rng.seed(stg.get_value<int>("seed") + peer);
+  g_stats.checksum = 0;
+  g_stats.num_finished = 0;
+
+  fw::net::initialize();
+  game::session *sess = game::session::get_instance();
+  sess->login_loopback(peer, base_port);
+
+  game::simulation_thread *sim = game::simulation_thread::get_instance();
+  sim->initialize();
+  while (sim->get_listen_port() == 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  if (peer == 1) {
+    sim->new_game(1);
+  } else {
+    sim->connect(1, (boost::format("127.0.0.1:%1%") % (base_port + 1)).str(), static_cast<uint8_t>(peer));
+  }
+
+  // the session confirms the players who join on this thread, just like it does in the game
+  while (get_num_joined() < num_peers - 1) {
+    if (fw::chrono_clock::now() > deadline) {
+      fw::debug << boost::format("  error: player %1% timed out waiting for the other players to join") % peer
+          << std::endl;
+      return 1;
+    }
+    sess->update();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  fw::debug << boost::format("player %1%: everybody's joined, starting the game") % peer << std::endl;
+  fw::chrono_clock::time_point start = fw::chrono_clock::now();
+  post_batch(0);
+  sim->start_game();
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(g_stats.mutex);
+      if (g_stats.num_finished == num_peers) {
+        break;
+      }
+    }
+    if (fw::chrono_clock::now() > deadline) {
+      fw::debug << boost::format("  error: player %1% timed out waiting for the other players' commands") % peer
+          << std::endl;
+      return 1;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  fw::chrono_clock::time_point end = fw::chrono_clock::now();
+
+  // our last command packets are still to be sent, and the other players might be waiting for them
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  sim->destroy();
+
+  float seconds = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() / 1000.0f;
+  fw::net::host *host = sim->get_host();
+  fw::debug << boost::format("player %1%: %2% batches of %3% commands from %4% players in %5$.1fs, checksum %6$016x")
+      % peer % g_num_batches % g_commands_per_batch % num_peers % seconds % g_stats.checksum << std::endl;
+  fw::debug << boost::format("player %1%:   command latency: p50=%2$.2fms p95=%3$.2fms p99=%4$.2fms")
+      % peer % get_percentile(g_stats.latencies, 0.5f) % get_percentile(g_stats.latencies, 0.95f)
+      % get_percentile(g_stats.latencies, 0.99f) << std::endl;
+  fw::debug << boost::format("player %1%:   network: %2$.1f bytes sent, %3$.1f bytes received per batch")
+      % peer % (static_cast<float>(host->get_bytes_sent()) / g_num_batches)
+      % (static_cast<float>(host->get_bytes_received()) / g_num_batches) << std::endl;
+  return 0;
+}
+
+// Starts each of the peers as a child process of this one, and waits for them all to finish.
+int run_peers(fw::settings &stg, char const *executable) {
+  int num_peers = stg.get_value<int>("peers");
+  int base_port = stg.get_value<int>("base-port");
+
+  std::vector<int> results(num_peers);
+  std::vector<std::thread> threads;
+  for (int peer = 1; peer <= num_peers; peer++) {
+    std::string cmdline = (boost::format("\"%1%\" --peer %2% --peers %3% --base-port %4% --listen-port %5%"
+        " --batches %6% --commands-per-batch %7% --timeout %8% --seed %9% --net-compact-encoding %10%"
+        " --turn-stats-interval %11%")
+        % executable % peer % num_peers % base_port % (base_port + peer) % stg.get_value<int>("batches")
+        % stg.get_value<int>("commands-per-batch") % stg.get_value<int>("timeout") % stg.get_value<int>("seed")
+        % stg.get_value<bool>("net-compact-encoding") % stg.get_value<int>("turn-stats-interval")).str();
+    fw::debug << boost::format("starting player %1%: %2%") % peer % cmdline << std::endl;
+    threads.push_back(std::thread([&results, peer, cmdline]() {
+      results[peer - 1] = std::system(cmdline.c_str());
+    }));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(PEER_START_INTERVAL_MS));
+  }
+
+  int num_failed = 0;
+  for (int peer = 1; peer <= num_peers; peer++) {
+    threads[peer - 1].join();
+    if (results[peer - 1] != 0) {
+      fw::debug << boost::format("player %1% failed (exit status %2%)") % peer % results[peer - 1] << std::endl;
+      num_failed++;
+    }
+  }
+
+  if (num_failed > 0) {
+    fw::debug << boost::format("%1% of %2% player(s) failed") % num_failed % num_peers << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  try {
+    settings_initialize(argc, argv);
+
+    fw::settings stg;
+    if (stg.is_set("help")) {
+      stg.print_help();
+      return 0;
+    }
+    fw::logging_initialize();
+
+    // a peer that connects to more than one other player doesn't know who it's connected to until they respond to
+    // its join request, so with four or more players it can end up connecting to somebody twice.
+    int num_peers = stg.get_value<int>("peers");
+    if (num_peers < 2 || num_peers > 3) {
+      fw::debug << boost::format("  error: --peers must be 2 or 3, not %1%") % num_peers << std::endl;
+      return 1;
+    }
+
+    if (stg.is_set("peer")) {
+      return run_peer(stg);
+    } else {
+      return run_peers(stg, argv[0]);
+    }
+  } catch(std::exception &e) {
+    std::string msg = boost::diagnostic_information(e);
+    fw::debug << "--------------------------------------------------------------------------------" << std::endl;
+    fw::debug << "UNHANDLED EXCEPTION!" << std::endl;
+    fw::debug << msg << std::endl;
+    return 1;
+  } catch (...) {
+    fw::debug << "--------------------------------------------------------------------------------" << std::endl;
+    fw::debug << "UNHANDLED EXCEPTION! (unknown exception)" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+void settings_initialize(int argc, char** argv) {
+  po::options_description options("Soak test options");
+  options.add_options()
+      ("peers", po::value<int>()->default_value(2), "The number of players (2 or 3), each of which runs in its own process.")
+      ("batches", po::value<int>()->default_value(1000), "The number of batches of commands each player posts. A player posts its next batch once it's executed its last one.")
+      ("commands-per-batch", po::value<int>()->default_value(8), "The number of commands in each batch (at most 250).")
+      ("base-port", po::value<int>()->default_value(9400), "Player n listens on 127.0.0.1, port base-port + n.")
+      ("timeout", po::value<int>()->default_value(300), "The number of seconds a player waits for the others before giving up.")
+      ("seed", po::value<int>()->default_value(1), "The seed for the random number generator, so runs are reproducible.")
+      ("peer", po::value<int>(), "Used internally: run as the given player, rather than starting all of them.")
+    ;
+
+  game::settings_initialize(argc, argv, options, "soak-test.conf");
+}